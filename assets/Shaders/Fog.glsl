@@ -1,11 +1,16 @@
-uniform vec3        uFogColor;
-uniform float       uFogDensity;
-
-uniform vec3        uSunColor;
-uniform vec3        uSunDirection;
-uniform float       uSunDispertion;
-uniform float       uSunIntensity;
-uniform vec3        uInscatteringCoeffs;
+// shared by every shader including this file, see Terrain::updateAtmosphere
+layout (std140) uniform Atmosphere {
+    vec3            uFogColor;
+    float           uFogDensity;
+    vec3            uSunColor;
+    float           uSunDispertion;
+    vec3            uInscatteringCoeffs;
+    float           uSunIntensity;
+    // updated every frame
+    vec3            uSunDirection;          // view space
+    float           uElapsedTime;
+    vec3            uCameraPosition;        // world space
+};
 
 // Fog adapted from from Iñigo Quilez article on fog
 // http://www.iquilezles.org/www/articles/fog/fog.htm
@@ -0,0 +1,31 @@
+#include "Shaders/Common.glsl"
+#include "Shaders/Fog.glsl"
+#include "Shaders/Impostor.glsl"
+
+in vec3             vPosition;
+in vec2             vTexCoord;
+flat in float       vImpostorBlend;
+
+uniform sampler2D   uImpostorAtlas;
+
+layout(location = 0) out vec3 oColor;
+layout(location = 1) out vec3 oDepthId;
+
+void main(){
+    // alpha tested silhouette and the other half of the dithered cross-fade
+    if( texture( uImpostorAtlas, vTexCoord ).r < 0.5 || getDitherThreshold( gl_FragCoord.xy ) >= vImpostorBlend ) discard;
+
+    float rayLength = length( vPosition );
+    vec3 rayDir     = vPosition / rayLength;
+    vec3 color      = applyFog( vec3(0), rayLength, rayDir ).rgb;
+    oColor          = color;
+
+    // pack depth to .rg and object data to .b
+    float depth     = gl_FragCoord.z * 256.0;
+    float depthX    = floor( depth );
+    depth           = ( depth - depthX ) * 256.0;
+    float depthY    = floor( depth );
+    depthX          *= 0.00390625;
+    depthY          *= 0.00390625; 
+    oDepthId        = vec3( depthX, depthY, 2.0 / 255.0f );
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+// distances at which the trees start to fade to their impostor and are fully replaced
+uniform vec2		uImpostorDistances;
+
+// returns how much of the impostor is visible for a tree at this view space position
+float getImpostorBlend( vec3 viewPos )
+{
+	return saturate( ( length( viewPos ) - uImpostorDistances.x ) / ( uImpostorDistances.y - uImpostorDistances.x ) );
+}
+
+// returns the 4x4 ordered dithering threshold at this fragment coordinate. the models keep
+// the fragments above the blend and the impostors the ones below so they never overlap
+float getDitherThreshold( vec2 fragCoord )
+{
+	const float bayer[16] = float[16]( 0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0 );
+	ivec2 p = ivec2( fragCoord ) & 3;
+	return ( bayer[p.x + p.y * 4] + 0.5 ) / 16.0;
+}
\ No newline at end of file
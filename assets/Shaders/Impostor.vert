@@ -0,0 +1,65 @@
+#include "Shaders/Common.glsl"
+#include "Shaders/Impostor.glsl"
+
+#define MAX_IMPOSTOR_MODELS 8
+
+in vec4				ciPosition;
+in vec4				aInstanceUvDelay;
+in vec4				aInstanceRotation;
+in float			aInstanceScale;
+
+out vec3			vPosition;
+out vec2			vTexCoord;
+flat out float		vImpostorBlend;
+
+uniform mat4		ciModelView;
+uniform mat4		ciProjectionMatrix;
+
+uniform sampler2D	uHeightMap;
+uniform sampler2D   uHeightMapTemp;
+uniform vec2		uHeightMapSize;
+uniform float       uHeightMapProgression;
+uniform float 		uElevation;
+
+uniform float 		uProgress;
+uniform vec3		uEyePosition;
+uniform vec2		uImpostorGridSize;
+uniform vec4		uImpostorExtents[MAX_IMPOSTOR_MODELS];
+
+// rotates v by the quaternion q
+vec3 rotate( vec4 q, vec3 v )
+{
+	return v + 2.0 * cross( q.xyz, cross( q.xyz, v ) + q.w * v );
+}
+
+void main(){
+	vec2 uv 		= aInstanceUvDelay.xy;
+	int model		= int( aInstanceUvDelay.w * 65535.0 + 0.5 );
+	float height	= mix( texture( uHeightMapTemp, uv ).r, texture( uHeightMap, uv ).r, uHeightMapProgression ) * uElevation - 0.5;
+	vec3 base		= vec3( uv.x * uHeightMapSize.x, height, uv.y * uHeightMapSize.y );
+
+	float delay 	= aInstanceUvDelay.z;
+	float progress 	= uProgress;
+	float delayedProgress = ( smoothstep( delay, delay + 0.4, progress * 1.4 ) );
+
+	// face the camera around the vertical axis
+	vec2 toEye		= normalize( uEyePosition.xz - base.xz );
+	vec3 right		= vec3( toEye.y, 0.0, -toEye.x );
+	vec3 extents	= uImpostorExtents[model].xyz * aInstanceScale * delayedProgress;
+	vec4 position	= vec4( base + right * ciPosition.x * extents.x + vec3( 0.0, mix( extents.y, extents.z, ciPosition.y ), 0.0 ), 1.0 );
+
+	// pick the atlas column rendered from the closest angle in model space
+	vec4 rotation	= normalize( aInstanceRotation );
+	vec3 localEye	= rotate( vec4( -rotation.xyz, rotation.w ), vec3( toEye.x, 0.0, toEye.y ) );
+	float angle		= atan( localEye.x, localEye.z ) / ( 2.0 * PI );
+	float column	= mod( floor( angle * uImpostorGridSize.x + 0.5 ), uImpostorGridSize.x );
+	vTexCoord		= ( vec2( column, float( model ) ) + vec2( ciPosition.x * 0.5 + 0.5, ciPosition.y ) ) / uImpostorGridSize;
+
+	vec4 viewPos	= ciModelView * position;
+	vPosition		= viewPos.xyz;
+	gl_Position		= ciProjectionMatrix * viewPos;
+
+	// collapse the quad while the model is still fully visible
+	vImpostorBlend	= getImpostorBlend( ( ciModelView * vec4( base, 1.0 ) ).xyz );
+	if( vImpostorBlend <= 0.0 ) gl_Position = vec4( 0.0 );
+}
\ No newline at end of file
@@ -1,26 +1,50 @@
-#version 150
+#include "Shaders/Common.glsl"
+#include "Shaders/Impostor.glsl"
 
-uniform mat4	ciModelView;
-uniform mat4	ciProjectionMatrix;
+in vec4				ciPosition;
+in vec4				aInstanceUvDelay;
+in vec4				aInstanceRotation;
+in float			aInstanceScale;
 
-in vec4			ciPosition;
-in vec4			ciColor;
-in vec4         aInstanceMat0;
-in vec4         aInstanceMat1;
-in vec4         aInstanceMat2;
-in vec4         aInstanceMat3;
-out vec3		vPosition;
-out vec4		vColor;
+out vec3			vPosition;
+flat out float		vImpostorBlend;
+
+uniform mat4		ciModelView;
+uniform mat4		ciProjectionMatrix;
+
+uniform sampler2D	uHeightMap;
+uniform sampler2D   uHeightMapTemp;
+uniform vec2		uHeightMapSize;
+uniform float       uHeightMapProgression;
+uniform float 		uElevation;
+
+uniform float 		uProgress;
+
+// rotates v by the quaternion q
+vec3 rotate( vec4 q, vec3 v )
+{
+	return v + 2.0 * cross( q.xyz, cross( q.xyz, v ) + q.w * v );
+}
 
 void main(){
-    mat4 m;
-    m[0] 			= aInstanceMat0;
-    m[1] 			= aInstanceMat1;
-    m[2] 			= aInstanceMat2;
-    m[3]			= aInstanceMat3;
-
-	vColor 			= ciColor;
-	vec4 viewPos	= ciModelView * m * ciPosition;
+	vec2 uv 		= aInstanceUvDelay.xy;
+	float height	= mix( texture( uHeightMapTemp, uv ).r, texture( uHeightMap, uv ).r, uHeightMapProgression ) * uElevation - 0.5;
+
+	// model space to tile space
+	vec3 local		= rotate( normalize( aInstanceRotation ), ciPosition.xyz * aInstanceScale );
+
+	float delay 	= aInstanceUvDelay.z;
+	float progress 	= uProgress;
+	float delayedProgress = ( smoothstep( delay, delay + 0.4, progress * 1.4 ) );
+
+	vec3 base		= vec3( uv.x * uHeightMapSize.x, height, uv.y * uHeightMapSize.y );
+	vec4 position	= vec4( base + local * ( delayedProgress ), 1.0 );
+
+	vec4 viewPos	= ciModelView * position;
 	vPosition		= viewPos.xyz;
 	gl_Position		= ciProjectionMatrix * viewPos;
+
+	// every vertex of the tree shares the same blend, collapse it once the impostor fully replaced it
+	vImpostorBlend	= getImpostorBlend( ( ciModelView * vec4( base, 1.0 ) ).xyz );
+	if( vImpostorBlend >= 1.0 ) gl_Position = vec4( 0.0 );
 }
\ No newline at end of file
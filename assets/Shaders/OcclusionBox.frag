@@ -0,0 +1,5 @@
+#include "Shaders/Common.glsl"
+
+// only the depth test matters to the occlusion queries
+void main(){
+}
@@ -0,0 +1,11 @@
+#include "Shaders/Common.glsl"
+
+uniform mat4	ciModelViewProjection;
+uniform vec3	uBoxMin;
+uniform vec3	uBoxSize;
+in vec4			ciPosition;
+
+void main(){
+	// the unit cube is stretched over the box of the tile
+	gl_Position	= ciModelViewProjection * vec4( uBoxMin + ciPosition.xyz * uBoxSize, 1.0 );
+}
@@ -10,7 +10,6 @@ in vec3             vWsPosition;
 uniform sampler2D   uNoiseLookupTable;
 uniform mat3        ciNormalMatrix;
 
-uniform float       uTime;
 
 layout(location = 0) out vec3 oColor;
 layout(location = 1) out vec3 oDepthId;
@@ -57,7 +56,7 @@ void main(){
     // stars
     float stars     = pow( noise( fract( vUv * 10.0 ) ), 25.0 ) * 2500.0;
     stars           += pow( noise( fract( -vUv * 15.0 ) ), 20.0 ) * 500.0;
-    stars           *= pow( clamp( noise( vUv * 8.0 + vec2( uTime * 0.0125 ) ), 0.0, 1.0 ), 2.0 );
+    stars           *= pow( clamp( noise( vUv * 8.0 + vec2( uElapsedTime * 0.0125 ) ), 0.0, 1.0 ), 2.0 );
     stars           = clamp( stars, 0.0, 1.0 );
     stars           = stars * smoothstep( 2.1, 0.0, sunDotV );
 
@@ -1,14 +1,12 @@
 #include "Shaders/Common.glsl"
+#include "Shaders/VertexPulling.glsl"
 
 uniform mat4		ciModelViewProjection;
 uniform mat4		ciModelView;
 uniform mat4		ciProjectionMatrix;
 //uniform mat3        ciNormalMatrix;
 
-in vec4				ciPosition;
 in vec4				ciColor;
-in vec2				ciTexCoord0;
-in vec4				ciTexCoord1;
 
 uniform sampler2D   uHeightMap;
 uniform sampler2D   uHeightMapTemp;
@@ -16,6 +14,8 @@ uniform sampler2D   uFlora;
 uniform sampler2D   uNoiseLookupTable;
 uniform float 		uElevation;
 uniform float       uHeightMapProgression;
+uniform vec3		uPositionScale;
+uniform vec3		uPositionOffset;
 //uniform sampler2D   uNormalMap;
 
 out vec3 			vPosition;
@@ -30,7 +30,11 @@ uniform vec3 	uTouch;
 uniform float uTouchSize;
 
 void main(){
-	vec2 uv 		= ciTexCoord0.st;
+	// fetch the packed vertex ( xz position, uv ) and its triangle
+	vec4 vertex		= getVertexTexel( getVertexIndex() );
+	vec4 triangle	= getTriangle();
+	
+	vec2 uv 		= vertex.zw;
 	float height	= mix( texture( uHeightMapTemp, uv ).r, texture( uHeightMap, uv ).r, uHeightMapProgression );
 
 	vec2 flora 		= texture( uFlora, uv ).rg;
@@ -39,12 +43,12 @@ void main(){
 	//vUv				= uv;
     //vNormal			= ciNormalMatrix * texture( uNormalMap, uv ).xyz;
 
-	vec4 position	= ciPosition;
-	vec3 center 	= ciTexCoord1.xyz;
+	vec4 position	= vec4( vec3( vertex.x, 0.0, vertex.y ) * uPositionScale + uPositionOffset, 1.0 );
+	vec3 center 	= triangle.xyz;
 	vec3 centerOff	= position.xyz - center.xyz;
-	vec3 noiseInput	= center.xyz * 0.025 + vec3( ciTexCoord1.w * 0.75 + uTime * 0.01 );
+	vec3 noiseInput	= center.xyz * 0.025 + vec3( triangle.w * 0.75 + uTime * 0.01 );
 	vec4 offset      = texture( uNoiseLookupTable, noiseInput.xz ) * vec4( 2.0 ) - vec4( 1.0 );
-	float delay 	= ciTexCoord1.w;
+	float delay 	= triangle.w;
 	float progress 	= uProgress;
 	float delayedProgress = smoothstep( delay, delay + 0.1, progress * 1.11111111 );
 	center.xyz		+= offset.xyz * ( 1.0f - delayedProgress ) * 50.0;
@@ -0,0 +1,19 @@
+// Terrain tiles drawn together from a MeshArena. Each vertex carries the id of its
+// tile and the data that used to be per draw uniforms is fetched from a texture
+// with two texels per tile: the position scale and the animation progress in w,
+// then the position offset.
+
+in uint					aDrawId;
+uniform highp sampler2D		uTileParams;
+
+// returns the scale of the normalized positions in xyz and the progress in w
+vec4 getTileScaleAndProgress()
+{
+	return texelFetch( uTileParams, ivec2( 0, int( aDrawId ) ), 0 );
+}
+
+// returns the offset of the scaled positions
+vec3 getTileOffset()
+{
+	return texelFetch( uTileParams, ivec2( 1, int( aDrawId ) ), 0 ).xyz;
+}
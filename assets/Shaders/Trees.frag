@@ -1,12 +1,17 @@
 #include "Shaders/Common.glsl"
 #include "Shaders/Fog.glsl"
+#include "Shaders/Impostor.glsl"
 
 in vec3             vPosition;
+flat in float       vImpostorBlend;
 
 layout(location = 0) out vec3 oColor;
 layout(location = 1) out vec3 oDepthId;
 
 void main(){
+    // dithered cross-fade with the impostors
+    if( getDitherThreshold( gl_FragCoord.xy ) < vImpostorBlend ) discard;
+
     float rayLength = length( vPosition );
     vec3 rayDir     = vPosition / rayLength;
     vec3 color      = applyFog( vec3(0), rayLength, rayDir ).rgb;
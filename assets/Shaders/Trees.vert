@@ -1,10 +1,12 @@
 #include "Shaders/Common.glsl"
+#include "Shaders/Impostor.glsl"
 
 in vec4				ciPosition;
-in vec3				ciTexCoord0;
+in vec2				ciTexCoord0;
 
 in vec4				ciColor;
 out vec3			vPosition;
+flat out float		vImpostorBlend;
 
 
 uniform mat4		ciModelView;
@@ -15,21 +17,28 @@ uniform sampler2D   uHeightMapTemp;
 uniform vec2		uHeightMapSize;
 uniform float       uHeightMapProgression;
 uniform float 		uElevation;
+uniform vec3		uPositionScale;
+uniform vec3		uPositionOffset;
 
 uniform float 		uProgress;
 
 void main(){
-	vec4 position 	= ciPosition;
+	vec4 position 	= vec4( ciPosition.xyz * uPositionScale + uPositionOffset, 1.0 );
 	vec2 uv 		= vec2( ciTexCoord0.x, ciTexCoord0.y );
 	float height	= mix( texture( uHeightMapTemp, uv ).r, texture( uHeightMap, uv ).r, uHeightMapProgression ) * uElevation - 0.5;
 
-	float delay 	= ciTexCoord0.z;
+	float delay 	= ciPosition.w;
 	float progress 	= uProgress;
 	float delayedProgress = ( smoothstep( delay, delay + 0.4, progress * 1.4 ) );
 
-	position.xyz 	= vec3( ciTexCoord0.x * uHeightMapSize.x, height, ( ciTexCoord0.y ) * uHeightMapSize.y ) + position.xyz * ( delayedProgress );
+	vec3 base		= vec3( ciTexCoord0.x * uHeightMapSize.x, height, ( ciTexCoord0.y ) * uHeightMapSize.y );
+	position.xyz 	= base + position.xyz * ( delayedProgress );
 
 	vec4 viewPos	= ciModelView * position;
 	vPosition		= viewPos.xyz;
 	gl_Position		= ciProjectionMatrix * viewPos;
+
+	// every vertex of the tree shares the same blend, collapse it once the impostor fully replaced it
+	vImpostorBlend	= getImpostorBlend( ( ciModelView * vec4( base, 1.0 ) ).xyz );
+	if( vImpostorBlend >= 1.0 ) gl_Position = vec4( 0.0 );
 }
\ No newline at end of file
@@ -1,8 +1,6 @@
 #include "Shaders/Common.glsl"
+#include "Shaders/VertexPulling.glsl"
 
-in vec4				ciPosition;
-in vec2				ciTexCoord0;
-in vec4				ciTexCoord1;
 in vec4				ciColor;
 out vec3			vPosition;
 out vec4			vColor;
@@ -15,6 +13,8 @@ uniform sampler2D   uHeightMapTemp;
 uniform sampler2D	uNoiseLookupTable;
 uniform float       uHeightMapProgression;
 uniform float 		uElevation;
+uniform vec3		uPositionScale;
+uniform vec3		uPositionOffset;
 
 uniform float 		uTime;
 uniform float 		uProgress;
@@ -23,21 +23,28 @@ uniform float 		uTouchSize;
 
 void main(){
 
+	// fetch the packed vertex ( xyz position, delay, uv ) and its triangle
+	int index		= getVertexIndex();
+	vec3 packed0	= getVertexTexel( index * 2 ).xyz;
+	vec3 packed1	= getVertexTexel( index * 2 + 1 ).xyz;
+	vec2 uv			= packed1.yz;
+	vec4 triangle	= getTriangle();
+
 	vColor 			= ciColor;
-	vec4 position 	= ciPosition;
-	vec3 center 	= ciTexCoord1.xyz;
-	float height	= mix( texture( uHeightMapTemp, ciTexCoord0 ).r, texture( uHeightMap, ciTexCoord0 ).r, uHeightMapProgression ) * uElevation - 0.5;
+	vec4 position 	= vec4( packed0 * uPositionScale + uPositionOffset, 1.0 );
+	vec3 center 	= triangle.xyz;
+	float height	= mix( texture( uHeightMapTemp, uv ).r, texture( uHeightMap, uv ).r, uHeightMapProgression ) * uElevation - 0.5;
 
 	// elevation
 	position.y 		+= height;
 	center.y 		+= height;
 
 	vec3 centerOff	= position.xyz - center.xyz;
-	vec3 noiseInput	= center.xyz * 0.0375 + vec3( ciTexCoord1.w * 50.0 + uTime * 0.02 );
+	vec3 noiseInput	= center.xyz * 0.0375 + vec3( triangle.w * 50.0 + uTime * 0.02 );
 	vec4 noise 		= texture( uNoiseLookupTable, 0.1* noiseInput.xz ) * vec4( 2.0 ) - vec4( 1.0 );// vec4(SimplexPerlin3D_Deriv( noiseInput ));
 
 	// create a small delay between objects and triangles
-	float delay 	= saturate(ciTexCoord1.w);
+	float delay 	= saturate(triangle.w);
 	float progress 	= uProgress;
 	float delayedProgress = ( smoothstep( delay, delay + 0.4, progress * 1.4 ) );
 
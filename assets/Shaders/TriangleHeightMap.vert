@@ -1,8 +1,9 @@
 #include "Shaders/Common.glsl"
+#include "Shaders/TileParams.glsl"
 
 uniform mat4 ciModelViewProjection;
 
-in vec4 ciPosition;
+in vec2 ciPosition;
 in vec2 ciTexCoord0;
 
 uniform sampler2D	uHeightMap;
@@ -11,7 +12,7 @@ out float vPosY;
 void main(){
   vec2 uv 		= ciTexCoord0.st;
   float height	= texture( uHeightMap, uv ).r;
-  vec4 position = ciPosition;
+  vec4 position = vec4( vec3( ciPosition.x, 0.0, ciPosition.y ) * getTileScaleAndProgress().xyz + getTileOffset(), 1.0 );
   position.y	+= height;
   vPosY			= position.y;
   gl_Position	= ciModelViewProjection * position;
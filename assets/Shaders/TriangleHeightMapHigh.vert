@@ -0,0 +1,19 @@
+#include "Shaders/Common.glsl"
+#include "Shaders/VertexPulling.glsl"
+
+uniform mat4 ciModelViewProjection;
+
+uniform sampler2D	uHeightMap;
+uniform vec3		uPositionScale;
+uniform vec3		uPositionOffset;
+
+out float vPosY;
+void main(){
+  vec4 vertex	= getVertexTexel( getVertexIndex() );
+  vec2 uv 		= vertex.zw;
+  float height	= texture( uHeightMap, uv ).r;
+  vec4 position = vec4( vec3( vertex.x, 0.0, vertex.y ) * uPositionScale + uPositionOffset, 1.0 );
+  position.y	+= height;
+  vPosY			= position.y;
+  gl_Position	= ciModelViewProjection * position;
+}
\ No newline at end of file
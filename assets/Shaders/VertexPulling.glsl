@@ -0,0 +1,30 @@
+// Indexed meshes with per-triangle data ( see PackedMesh ). The mesh is drawn with
+// glDrawArrays, gl_VertexID walks the index texture and the vertices and triangles
+// data are fetched from their own textures.
+
+uniform highp usampler2D	uIndices;
+uniform highp usampler2D	uVertices;
+uniform highp sampler2D		uTriangles;
+
+ivec2 getTexelCoord( int texel, int width )
+{
+	return ivec2( texel % width, texel / width );
+}
+
+// returns the index of the vertex currently processed
+int getVertexIndex()
+{
+	return int( texelFetch( uIndices, getTexelCoord( gl_VertexID, textureSize( uIndices, 0 ).x ), 0 ).r );
+}
+
+// returns the texel-th texel of the vertices as normalized values
+vec4 getVertexTexel( int texel )
+{
+	return vec4( texelFetch( uVertices, getTexelCoord( texel, textureSize( uVertices, 0 ).x ), 0 ) ) / 65535.0;
+}
+
+// returns the center of the current triangle in xyz and its normalized index in w
+vec4 getTriangle()
+{
+	return texelFetch( uTriangles, getTexelCoord( gl_VertexID / 3, textureSize( uTriangles, 0 ).x ), 0 );
+}
@@ -0,0 +1,173 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "BufferPool.h"
+
+#include "cinder/gl/scoped.h"
+#include "cinder/gl/wrapper.h"
+
+using namespace std;
+using namespace ci;
+
+namespace {
+	
+	//! returns whether the gpu has gone past \a fence, never waits
+	bool isSignaled( GLsync fence )
+	{
+		GLenum status = glClientWaitSync( fence, 0, 0 );
+		return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+	}
+	
+} // anonymous namespace
+
+BufferPoolRef BufferPool::create( size_t minSize, size_t maxFreeSize )
+{
+	return make_shared<BufferPool>( minSize, maxFreeSize );
+}
+
+BufferPool::BufferPool( size_t minSize, size_t maxFreeSize ) :
+mMaxVertexAttribs( 16 ),
+mMinSize( minSize ),
+mMaxFreeSize( maxFreeSize ),
+mFreeSize( 0 ),
+mLastPassSize( 0 ),
+mNumReleased( 0 )
+{
+	glGetIntegerv( GL_MAX_VERTEX_ATTRIBS, &mMaxVertexAttribs );
+}
+
+BufferPool::~BufferPool()
+{
+	for( const auto &freeBuffers : mFreeBuffers ){
+		for( const auto &buffer : freeBuffers.second ){
+			glDeleteSync( buffer.mFence );
+		}
+	}
+}
+
+size_t BufferPool::getSizeClass( size_t size ) const
+{
+	size_t sizeClass = mMinSize;
+	while( sizeClass < size ) sizeClass *= 2;
+	return sizeClass;
+}
+
+gl::VboRef BufferPool::acquire( GLenum target, size_t size, const void *data )
+{
+	size_t sizeClass	= getSizeClass( size );
+	auto &freeBuffers	= mFreeBuffers[make_pair( target, sizeClass )];
+	gl::VboRef vbo;
+	
+	// take the oldest buffer the gpu is done with
+	for( auto it = freeBuffers.begin(); it != freeBuffers.end(); ++it ){
+		if( isSignaled( it->mFence ) ){
+			vbo = it->mVbo;
+			glDeleteSync( it->mFence );
+			freeBuffers.erase( it );
+			mFreeSize -= sizeClass;
+			mStats.mNumReused++;
+			break;
+		}
+	}
+	
+	// or orphan the storage of the oldest one rather than waiting for the gpu
+	if( ! vbo && ! freeBuffers.empty() ){
+		vbo = freeBuffers.front().mVbo;
+		glDeleteSync( freeBuffers.front().mFence );
+		freeBuffers.pop_front();
+		mFreeSize -= sizeClass;
+		vbo->bufferData( sizeClass, nullptr, GL_STATIC_DRAW );
+		mStats.mNumOrphaned++;
+	}
+	
+	// and only create a new buffer when the class is empty
+	if( ! vbo ){
+		vbo = gl::Vbo::create( target, sizeClass, nullptr, GL_STATIC_DRAW );
+		mStats.mNumCreated++;
+	}
+	
+	mStats.mAcquiredSize += sizeClass;
+	vbo->bufferSubData( 0, size, data );
+	return vbo;
+}
+
+void BufferPool::release( const gl::VboRef &vbo )
+{
+	if( ! vbo )
+		return;
+	
+	GLsync fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	mFreeBuffers[make_pair( vbo->getTarget(), vbo->getSize() )].push_back( { vbo, fence, mNumReleased++ } );
+	mFreeSize += vbo->getSize();
+}
+
+gl::VaoRef BufferPool::acquireVao()
+{
+	if( mFreeVaos.empty() ){
+		mStats.mNumVaosCreated++;
+		return gl::Vao::create();
+	}
+	
+	// the previous layout might not match the new one
+	gl::VaoRef vao = mFreeVaos.back();
+	mFreeVaos.pop_back();
+	gl::ScopedVao scopedVao( vao );
+	for( GLint i = 0; i < mMaxVertexAttribs; ++i ){
+		gl::disableVertexAttribArray( i );
+		gl::vertexAttribDivisor( i, 0 );
+	}
+	return vao;
+}
+
+void BufferPool::releaseVao( const gl::VaoRef &vao )
+{
+	if( vao ){
+		mFreeVaos.push_back( vao );
+	}
+}
+
+void BufferPool::resetStats()
+{
+	mLastPassSize	= mStats.mAcquiredSize;
+	mStats			= Stats();
+}
+
+void BufferPool::trim()
+{
+	// keep enough for a pass as big as the last one or the current one
+	size_t budget = std::max( mMaxFreeSize, std::max( mLastPassSize, mStats.mAcquiredSize ) );
+	while( mFreeSize > budget ){
+		// the free lists are sorted by release, the oldest buffer is at the front of one of them
+		auto oldest = mFreeBuffers.end();
+		for( auto it = mFreeBuffers.begin(); it != mFreeBuffers.end(); ++it ){
+			if( ! it->second.empty() && ( oldest == mFreeBuffers.end() || it->second.front().mSerial < oldest->second.front().mSerial ) ){
+				oldest = it;
+			}
+		}
+		
+		// the driver frees the storage once the gpu is done with it
+		glDeleteSync( oldest->second.front().mFence );
+		oldest->second.pop_front();
+		mFreeSize -= oldest->first.second;
+		mStats.mNumTrimmed++;
+	}
+}
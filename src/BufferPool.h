@@ -0,0 +1,101 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/gl/Vbo.h"
+#include "cinder/gl/Vao.h"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+typedef std::shared_ptr<class BufferPool> BufferPoolRef;
+
+//! Recycles the gpu buffers and vaos of meshes that are replaced often. Buffers are grouped
+//! in power of two size classes and refilled with glBufferSubData. A released buffer is fenced
+//! and only handed out again once the gpu is done with it, when every buffer of a class is still
+//! in flight the oldest one is orphaned instead of creating a new one. The free buffers are kept
+//! within a byte budget that never drops below what the last pass acquired, so the next pass
+//! finds all of its buffers but a burst bigger than usual doesn't hold on to its peak.
+class BufferPool {
+public:
+	//! returns a new pool, buffers smaller than \a minSize bytes share the smallest size class and
+	//! the free buffers are trimmed past \a maxFreeSize bytes or the size of the last pass if larger
+	static BufferPoolRef create( size_t minSize = 16 * 1024, size_t maxFreeSize = 32 * 1024 * 1024 );
+	
+	//! returns a buffer of at least \a size bytes for \a target filled with \a data
+	ci::gl::VboRef	acquire( GLenum target, size_t size, const void *data );
+	//! gives back \a vbo, it will be reused once the commands issued so far are completed
+	void			release( const ci::gl::VboRef &vbo );
+	
+	//! returns an empty vao, recycled vaos have all their attributes disabled
+	ci::gl::VaoRef	acquireVao();
+	//! gives back \a vao
+	void			releaseVao( const ci::gl::VaoRef &vao );
+	
+	//! deletes the oldest free buffers until they fit in the budget, cheap when they already do
+	void			trim();
+	
+	//! the number of buffers handed out since the last reset
+	struct Stats {
+		Stats() : mNumCreated( 0 ), mNumReused( 0 ), mNumOrphaned( 0 ), mNumVaosCreated( 0 ), mNumTrimmed( 0 ), mAcquiredSize( 0 ) {}
+		size_t mNumCreated;
+		size_t mNumReused;
+		size_t mNumOrphaned;
+		size_t mNumVaosCreated;
+		size_t mNumTrimmed;
+		//! the bytes of the size classes handed out
+		size_t mAcquiredSize;
+	};
+	
+	//! returns the allocation stats
+	const Stats&	getStats() const { return mStats; }
+	//! resets the allocation stats and starts a new pass, the bytes acquired by the previous one stay in the budget
+	void			resetStats();
+	//! returns the number of bytes held by the free buffers
+	size_t			getFreeSize() const { return mFreeSize; }
+	
+	BufferPool( size_t minSize, size_t maxFreeSize );
+	~BufferPool();
+	
+protected:
+	//! returns the smallest size class holding \a size bytes
+	size_t getSizeClass( size_t size ) const;
+	
+	struct FreeBuffer {
+		ci::gl::VboRef	mVbo;
+		GLsync			mFence;
+		//! the release order, to trim the oldest buffers across the size classes
+		size_t			mSerial;
+	};
+	
+	//! free buffers by target and size class, oldest first
+	std::map<std::pair<GLenum, size_t>, std::deque<FreeBuffer>>	mFreeBuffers;
+	std::vector<ci::gl::VaoRef>										mFreeVaos;
+	GLint															mMaxVertexAttribs;
+	size_t															mMinSize;
+	size_t															mMaxFreeSize;
+	size_t															mFreeSize;
+	size_t															mLastPassSize;
+	size_t															mNumReleased;
+	Stats															mStats;
+};
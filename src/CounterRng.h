@@ -0,0 +1,77 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+//! Stateless counter based random number generator (Widynski's "Squares").
+//! Every value is a pure function of a key and a counter, so streams keyed
+//! by ( seed, tile, stream ) give the same values whatever thread or order
+//! they are consumed in.
+class CounterRng {
+public:
+	//! the independent streams used by the terrain generation
+	enum Stream : uint32_t { GLOBAL = 0, INITIAL_SAMPLES = 1, TREES = 2, IMPORTANCE = 3, POPULATION_SAMPLES = 4, MESH_SAMPLES = 5, BOUNDS_SAMPLES = 6 };
+	
+	//! \a substream splits a stream further, ie. the parts of a tile sampled separately
+	CounterRng( float seed, uint64_t tileId, uint32_t stream, uint32_t substream = 0 ) : mCounter( 0 )
+	{
+		uint32_t seedBits;
+		std::memcpy( &seedBits, &seed, sizeof( float ) );
+		// squares needs a key with well mixed bits, odd keys are fine
+		mKey = mix( mix( seedBits ) ^ ( (uint64_t) substream << 48 ) ^ ( tileId << 8 ) ^ stream ) | 1;
+	}
+	
+	//! returns the value at \a counter without advancing the stream
+	uint32_t at( uint64_t counter ) const
+	{
+		uint64_t x, y, z;
+		y = x = counter * mKey;
+		z = y + mKey;
+		x = x * x + y; x = ( x >> 32 ) | ( x << 32 );
+		x = x * x + z; x = ( x >> 32 ) | ( x << 32 );
+		x = x * x + y; x = ( x >> 32 ) | ( x << 32 );
+		return ( x * x + z ) >> 32;
+	}
+	
+	//! returns the next value of the stream
+	uint32_t nextUint() { return at( mCounter++ ); }
+	//! returns a float in [0,1)
+	float nextFloat() { return ( nextUint() >> 8 ) * ( 1.0f / 16777216.0f ); }
+	//! returns a float in [v1,v2)
+	float nextFloat( float v1, float v2 ) { return v1 + ( v2 - v1 ) * nextFloat(); }
+	//! returns an int in [v1,v2), same range as ci::Rand::nextInt
+	int32_t nextInt( int32_t v1, int32_t v2 ) { return v1 + (int32_t) ( ( (uint64_t) nextUint() * (uint32_t) ( v2 - v1 ) ) >> 32 ); }
+	
+protected:
+	//! splitmix64 finalizer
+	static uint64_t mix( uint64_t v )
+	{
+		v = ( v ^ ( v >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+		v = ( v ^ ( v >> 27 ) ) * 0x94d049bb133111ebull;
+		return v ^ ( v >> 31 );
+	}
+	
+	uint64_t	mKey;
+	uint64_t	mCounter;
+};
@@ -0,0 +1,90 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+//! Linear allocator for the data that only lives for a frame. Allocating is a pointer bump and
+//! everything is released at once by reset(). A frame needing more than the capacity gets extra
+//! blocks and the next reset grows the main block to the peak, so the steady state doesn't touch
+//! the heap. Only trivially destructible types can be allocated, nothing is ever destroyed.
+class FrameAllocator {
+public:
+	explicit FrameAllocator( size_t capacity = 64 * 1024 )
+	: mBuffer( new uint8_t[capacity] ), mCapacity( capacity ), mOffset( 0 ), mPeak( 0 ), mNumGrowths( 0 )
+	{
+	}
+	
+	//! returns uninitialized storage for \a count objects of type T, valid until the next reset
+	template<typename T>
+	T* allocate( size_t count )
+	{
+		static_assert( std::is_trivially_destructible<T>::value, "FrameAllocator never calls destructors" );
+		size_t size		= count * sizeof( T );
+		size_t offset	= ( mOffset + alignof( T ) - 1 ) & ~( alignof( T ) - 1 );
+		mPeak			= offset + size > mPeak ? offset + size : mPeak;
+		
+		// overflow to a separate block until the next reset
+		if( offset + size > mCapacity ){
+			mOverflow.emplace_back( new uint8_t[size + alignof( T )] );
+			uintptr_t address = reinterpret_cast<uintptr_t>( mOverflow.back().get() );
+			address = ( address + alignof( T ) - 1 ) & ~( alignof( T ) - 1 );
+			mOffset = offset + size;
+			return reinterpret_cast<T*>( address );
+		}
+		
+		mOffset = offset + size;
+		return reinterpret_cast<T*>( mBuffer.get() + offset );
+	}
+	
+	//! releases everything allocated since the last reset, grows the block if the last frame needed more
+	void reset()
+	{
+		if( mPeak > mCapacity ){
+			mCapacity	= mPeak + mPeak / 2;
+			mBuffer		= std::unique_ptr<uint8_t[]>( new uint8_t[mCapacity] );
+			mNumGrowths++;
+		}
+		mOverflow.clear();
+		mOffset	= 0;
+		mPeak	= 0;
+	}
+	
+	//! returns the size of the main block in bytes
+	size_t getCapacity() const { return mCapacity; }
+	//! returns the number of bytes allocated since the last reset
+	size_t getSize() const { return mOffset; }
+	//! returns the number of times the main block had to grow
+	size_t getNumGrowths() const { return mNumGrowths; }
+	
+protected:
+	std::unique_ptr<uint8_t[]>					mBuffer;
+	std::vector<std::unique_ptr<uint8_t[]>>		mOverflow;
+	size_t										mCapacity;
+	size_t										mOffset;
+	size_t										mPeak;
+	size_t										mNumGrowths;
+};
@@ -156,6 +156,7 @@ void Grove::setupRendering()
 		pp.addDefine( "CINDER_GL_PLATFORM", "CINDER_GL_ES_3" );
 		pp.setVersion( 300 );
 		mPostProcessing = gl::GlslProg::create( gl::GlslProg::Format().vertex( pp.parse( getAssetPath( "Shaders/Passtrough.vert" ) ).c_str() ).fragment( pp.parse( getAssetPath( "Shaders/PostProcessing.frag" ) ).c_str() ) );
+		mPostProcessingTexture = UniformHandle<int>( mPostProcessing, "uTexture" );
 	}
 	catch( gl::GlslProgExc exc ){
 		CI_LOG_E( exc.what() );
@@ -261,7 +262,7 @@ void Grove::draw()
 		gl::ScopedTextureBind scopedTexture( mFbo->getColorTexture(), 0 );
 		if( mPostProcessing ) {
 			gl::ScopedGlslProg scopedShader( mPostProcessing );
-			mPostProcessing->uniform( "uTexture", 0 );
+			mPostProcessingTexture.set( 0 );
 
 			gl::drawSolidRect( toPixels( getWindowBounds() ) );
 		}
@@ -377,6 +378,14 @@ void Grove::draw()
 		console() << "CPU trees: " << (int) ( mTerrain->cpuTimer1.getSeconds() * 1000.0f ) << endl;
 		console() << "CPU skybox: " << (int) ( mTerrain->cpuTimer2.getSeconds() * 1000.0f ) << endl;
 		console() << "CPU occlusion: " << (int) ( mTerrain->cpuTimer3.getSeconds() * 1000.0f ) << endl;
+		const auto &queueStats = mTerrain->getRenderQueueStats();
+		console() << "Draws: " << queueStats.mNumDraws << " ( " << mTerrain->getNumTileDrawCalls() << " terrain ), programs: " << queueStats.mNumProgramChanges << ", textures: " << queueStats.mNumTextureChanges << ", vaos: " << queueStats.mNumVaoChanges << ", skipped binds: " << queueStats.mNumSkippedBinds << endl;
+		const auto &occlusionStats = mTerrain->getSoftwareOcclusionStats();
+		console() << "Software occlusion: " << occlusionStats.mNumOccluded << " / " << occlusionStats.mNumTested << " occluded, " << occlusionStats.mNumTriangles << " triangles, raster " << occlusionStats.mRasterizeTime << "ms, pyramid " << occlusionStats.mPyramidTime << "ms, tests " << occlusionStats.mTestTime << "ms" << endl;
+		const auto &horizonStats = mTerrain->getHorizonCullingStats();
+		console() << "Horizon culling: " << horizonStats.mNumOccluded << " / " << horizonStats.mNumTested << " occluded by " << horizonStats.mNumOccluders << " tiles in " << horizonStats.mCullTime << "ms" << endl;
+		const auto &roadPvs = mTerrain->getRoadPvs();
+		console() << "Road PVS: " << roadPvs.getNumSegments() << " segments, " << roadPvs.getSize() / 1024 << "kb, built in " << roadPvs.getBuildTime() << "ms" << endl;
 		console() << "CPU update0: " << (int) ( mainTimer0.getSeconds() * 1000.0f ) << endl;
 		console() << "CPU update1: " << (int) ( mainTimer1.getSeconds() * 1000.0f ) << endl;
 		console() << "CPU update2: " << (int) ( mainTimer2.getSeconds() * 1000.0f ) << endl;
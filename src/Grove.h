@@ -35,6 +35,7 @@
 #include "cinder/CameraUI.h"
 
 #include "Terrain.h"
+#include "UniformHandle.h"
 #include "UserInterface.h"
 #include "GestureManager.h"
 
@@ -90,6 +91,7 @@ public:
 	ci::gl::Texture2dRef		mFboColorAtt;
 	ci::gl::Texture2dRef		mFboDepthAtt;
 	ci::gl::GlslProgRef			mPostProcessing;
+	UniformHandle<int>			mPostProcessingTexture;
 	
 	// frame time
 	float						mLastTime;
@@ -111,6 +111,16 @@ void Grove::edit( const Touch &touch )
 	vec3 position		= vec3( data );
 	Touch::Type type	= getPixelDataType( data );
 	
+	// and resolve the trees on the cpu, the picking buffer only stores the type so use the
+	// tree index to get the actual tree unless something else is closer
+	vec2 posNorm		= touch.mPos2d / vec2( getWindowSize() );
+	Ray ray				= mCamera.generateRay( posNorm.x, 1.0f - posNorm.y, getWindowAspectRatio() );
+	float treeDistance;
+	if( mTerrain->pickTree( ray, &treeDistance ) && ( type == Touch::TOUCH_SKY || treeDistance < glm::distance( ray.getOrigin(), position ) ) ){
+		position		= ray.calcPosition( treeDistance );
+		type			= Touch::Type::TOUCH_TREE;
+	}
+	
 	
 	// MARK: edit terrain
 	//---------------------------
@@ -0,0 +1,185 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "HorizonCuller.h"
+
+#include "cinder/CinderMath.h"
+#include "cinder/Timer.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+using namespace ci;
+
+HorizonCuller::HorizonCuller( size_t numBins )
+: mHorizon( std::max<size_t>( numBins, 1 ) ),
+mBinAngle( 2.0f * (float) M_PI / (float) std::max<size_t>( numBins, 1 ) )
+{
+}
+
+void HorizonCuller::clear()
+{
+	mOccluders.clear();
+	mBounds.clear();
+	mOccluded.clear();
+}
+void HorizonCuller::addOccluder( const AxisAlignedBox &bounds )
+{
+	mOccluders.push_back( bounds );
+}
+size_t HorizonCuller::addBounds( const AxisAlignedBox &bounds )
+{
+	mBounds.push_back( bounds );
+	mOccluded.push_back( 0 );
+	return mBounds.size() - 1;
+}
+
+void HorizonCuller::cull( const vec3 &eye )
+{
+	Timer timer( true );
+	mStats				= Stats();
+	mStats.mNumOccluders	= mOccluders.size();
+	mStats.mNumTested		= mBounds.size();
+	
+	// the occluders raise the horizon of their bins with the slope of their bottom, the
+	// bounds are tested with the slope of their top seen from their best distance
+	mSteps.clear();
+	for( size_t i = 0; i < mOccluders.size(); ++i ){
+		Footprint footprint	= getFootprint( i, mOccluders[i], eye );
+		footprint.mHeight	= mOccluders[i].getMin().y - eye.y;
+		if( ! footprint.mContainsEye ){
+			addSteps( footprint );
+		}
+	}
+	mBoundsFootprints.clear();
+	for( size_t i = 0; i < mBounds.size(); ++i ){
+		Footprint footprint	= getFootprint( i, mBounds[i], eye );
+		float height		= mBounds[i].getMax().y - eye.y;
+		footprint.mSlope	= height / ( height >= 0.0f ? footprint.mDistanceMin : footprint.mDistanceMax );
+		if( ! footprint.mContainsEye ){
+			mBoundsFootprints.push_back( footprint );
+		}
+	}
+	
+	// sweep outward, the steps only raise the horizon once the terrain they
+	// stand for is entirely closer than the next bounds
+	std::sort( mSteps.begin(), mSteps.end(), []( const Step &lhs, const Step &rhs ){
+		return lhs.mDistance < rhs.mDistance;
+	} );
+	std::sort( mBoundsFootprints.begin(), mBoundsFootprints.end(), []( const Footprint &lhs, const Footprint &rhs ){
+		return lhs.mDistanceMin < rhs.mDistanceMin;
+	} );
+	std::fill( mHorizon.begin(), mHorizon.end(), numeric_limits<float>::lowest() );
+	size_t nextStep = 0;
+	for( const auto &bounds : mBoundsFootprints ){
+		for( ; nextStep < mSteps.size() && mSteps[nextStep].mDistance <= bounds.mDistanceMin; ++nextStep ){
+			float &horizon = mHorizon[mSteps[nextStep].mBin];
+			horizon = std::max( horizon, mSteps[nextStep].mSlope );
+		}
+		mOccluded[bounds.mIndex] = isBelowHorizon( bounds ) ? 1 : 0;
+		mStats.mNumOccluded += mOccluded[bounds.mIndex];
+	}
+	
+	mStats.mCullTime = timer.getSeconds() * 1000.0;
+}
+
+HorizonCuller::Footprint HorizonCuller::getFootprint( size_t index, const AxisAlignedBox &bounds, const vec3 &eye ) const
+{
+	Footprint footprint;
+	footprint.mIndex	= index;
+	vec2 min			= vec2( bounds.getMin().x, bounds.getMin().z ) - vec2( eye.x, eye.z );
+	vec2 max			= vec2( bounds.getMax().x, bounds.getMax().z ) - vec2( eye.x, eye.z );
+	footprint.mMin		= min;
+	footprint.mMax		= max;
+	footprint.mContainsEye	= min.x <= 0.0f && min.y <= 0.0f && max.x >= 0.0f && max.y >= 0.0f;
+	footprint.mDistanceMin	= glm::length( glm::clamp( vec2( 0.0f ), min, max ) );
+	footprint.mDistanceMax	= glm::length( glm::max( glm::abs( min ), glm::abs( max ) ) );
+	
+	// the corners angles relative to the center one, a footprint
+	// that doesn't contain the eye spans less than half a turn
+	vec2 center			= ( min + max ) * 0.5f;
+	float centerAngle	= atan2( center.y, center.x );
+	footprint.mAngleMin	= footprint.mAngleMax = centerAngle;
+	for( int i = 0; i < 4; ++i ){
+		vec2 corner	= vec2( i & 1 ? max.x : min.x, i & 2 ? max.y : min.y );
+		float angle	= atan2( corner.y, corner.x ) - centerAngle;
+		if( angle > (float) M_PI ) angle -= 2.0f * (float) M_PI;
+		else if( angle < - (float) M_PI ) angle += 2.0f * (float) M_PI;
+		footprint.mAngleMin = std::min( footprint.mAngleMin, centerAngle + angle );
+		footprint.mAngleMax = std::max( footprint.mAngleMax, centerAngle + angle );
+	}
+	return footprint;
+}
+
+void HorizonCuller::addSteps( const Footprint &occluder )
+{
+	// only the bins entirely inside the footprint, every direction of those bins crosses it and
+	// the terrain over it before leaving it. seen from the eye that terrain is at least as steep as
+	// the bottom at the farthest exit when it is above the eye, at the closest point otherwise
+	int numBins	= (int) mHorizon.size();
+	int first	= (int) std::ceil( occluder.mAngleMin / mBinAngle );
+	int last	= (int) std::floor( occluder.mAngleMax / mBinAngle ) - 1;
+	for( int bin = first; bin <= last; ++bin ){
+		Step step;
+		step.mBin		= ( bin % numBins + numBins ) % numBins;
+		step.mDistance	= getExitDistance( occluder, bin * mBinAngle, ( bin + 1 ) * mBinAngle );
+		step.mSlope		= occluder.mHeight / ( occluder.mHeight >= 0.0f ? step.mDistance : occluder.mDistanceMin );
+		mSteps.push_back( step );
+	}
+}
+
+float HorizonCuller::getExitDistance( const Footprint &occluder, float angle0, float angle1 ) const
+{
+	// the exit distance of a direction is the closest of the two slabs exits. between the
+	// two angles it is the farthest at one of them or at a corner where the exit slab changes
+	auto getExit = [&occluder]( float angle ){
+		vec2 direction	= vec2( cos( angle ), sin( angle ) );
+		float exitX		= direction.x > 0.0f ? occluder.mMax.x / direction.x : ( direction.x < 0.0f ? occluder.mMin.x / direction.x : numeric_limits<float>::max() );
+		float exitZ		= direction.y > 0.0f ? occluder.mMax.y / direction.y : ( direction.y < 0.0f ? occluder.mMin.y / direction.y : numeric_limits<float>::max() );
+		return std::min( exitX, exitZ );
+	};
+	float distance = std::max( getExit( angle0 ), getExit( angle1 ) );
+	for( int i = 0; i < 4; ++i ){
+		vec2 corner	= vec2( i & 1 ? occluder.mMax.x : occluder.mMin.x, i & 2 ? occluder.mMax.y : occluder.mMin.y );
+		float angle	= atan2( corner.y, corner.x );
+		angle		+= std::round( ( angle0 - angle ) / ( 2.0f * (float) M_PI ) ) * 2.0f * (float) M_PI;
+		if( angle >= angle0 && angle <= angle1 ){
+			distance = std::max( distance, glm::length( corner ) );
+		}
+	}
+	return distance;
+}
+
+bool HorizonCuller::isBelowHorizon( const Footprint &bounds ) const
+{
+	// every bin touched by the footprint has to be above its top
+	int numBins	= (int) mHorizon.size();
+	int first	= (int) std::floor( bounds.mAngleMin / mBinAngle );
+	int last	= (int) std::floor( bounds.mAngleMax / mBinAngle );
+	for( int bin = first; bin <= last; ++bin ){
+		if( mHorizon[( bin % numBins + numBins ) % numBins] <= bounds.mSlope ){
+			return false;
+		}
+	}
+	return true;
+}
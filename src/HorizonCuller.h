@@ -0,0 +1,104 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/AxisAlignedBox.h"
+
+#include <vector>
+
+//! Occlusion culling for heightfields seen from above. The terrain blocks the view along each
+//! direction of the xz plane up to a horizon, the steepest slope of the terrain closer than a
+//! given distance. The horizon is kept in angular bins around the eye and raised outward by the
+//! occluders, each one at least as high as the bottom of its bounds over all of its footprint.
+//! Bounds whose top is below the horizon of every bin they span are hidden by the terrain in
+//! front of them. The sweep takes the bounds by distance and only lets an occluder raise a bin
+//! once the directions of that bin have left it.
+class HorizonCuller {
+public:
+	//! the work and the timing of the last cull
+	struct Stats {
+		Stats() : mNumOccluders( 0 ), mNumTested( 0 ), mNumOccluded( 0 ), mCullTime( 0.0 ) {}
+		size_t	mNumOccluders;
+		size_t	mNumTested;
+		size_t	mNumOccluded;
+		//! the time in milliseconds spent sweeping
+		double	mCullTime;
+	};
+	
+	//! creates a culler with \a numBins angular bins around the eye
+	HorizonCuller( size_t numBins = 512 );
+	
+	//! removes the occluders and the bounds of the previous cull
+	void	clear();
+	//! adds a footprint covered by terrain at least as high as the bottom of \a bounds
+	void	addOccluder( const ci::AxisAlignedBox &bounds );
+	//! adds \a bounds to the ones tested by the next cull and returns its index
+	size_t	addBounds( const ci::AxisAlignedBox &bounds );
+	
+	//! sweeps the occluders and the bounds outward from \a eye
+	void	cull( const ci::vec3 &eye );
+	//! returns whether the bounds \a index is below the horizon, valid after cull
+	bool	isOccluded( size_t index ) const { return mOccluded[index] != 0; }
+	
+	//! returns the stats of the last cull
+	const Stats& getStats() const { return mStats; }
+	
+protected:
+	//! the angles and the distances of a footprint seen from the eye
+	struct Footprint {
+		size_t	mIndex;
+		//! the footprint relative to the eye
+		ci::vec2	mMin, mMax;
+		float	mAngleMin, mAngleMax;
+		float	mDistanceMin, mDistanceMax;
+		//! the height of the bottom relative to the eye for the occluders
+		float	mHeight;
+		//! the slope of the top seen from the eye for the bounds
+		float	mSlope;
+		bool	mContainsEye;
+	};
+	
+	//! a bin raised to a slope by an occluder, from the distance where the bin directions leave it
+	struct Step {
+		size_t	mBin;
+		float	mDistance;
+		float	mSlope;
+	};
+	
+	//! returns the footprint of \a bounds seen from \a eye
+	Footprint	getFootprint( size_t index, const ci::AxisAlignedBox &bounds, const ci::vec3 &eye ) const;
+	//! adds the steps of the bins entirely inside \a occluder
+	void		addSteps( const Footprint &occluder );
+	//! returns the farthest distance at which the directions between \a angle0 and \a angle1 leave \a occluder
+	float		getExitDistance( const Footprint &occluder, float angle0, float angle1 ) const;
+	//! returns whether the horizon of every bin touched by \a bounds is above its top
+	bool		isBelowHorizon( const Footprint &bounds ) const;
+	
+	std::vector<float>				mHorizon;
+	std::vector<ci::AxisAlignedBox>	mOccluders;
+	std::vector<ci::AxisAlignedBox>	mBounds;
+	std::vector<uint8_t>			mOccluded;
+	std::vector<Step>				mSteps;
+	std::vector<Footprint>			mBoundsFootprints;
+	float							mBinAngle;
+	Stats							mStats;
+};
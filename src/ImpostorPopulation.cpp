@@ -0,0 +1,216 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "ImpostorPopulation.h"
+
+#include "cinder/gl/Batch.h"
+#include "cinder/gl/Fbo.h"
+#include "cinder/gl/scoped.h"
+#include "cinder/gl/Context.h"
+#include "cinder/gl/wrapper.h"
+
+using namespace std;
+using namespace ci;
+
+// MARK: ImpostorAtlas
+
+ImpostorAtlasRef ImpostorAtlas::create( const vector<TriMesh> &models, size_t numAngles, int cellSize )
+{
+	return make_shared<ImpostorAtlas>( models, numAngles, cellSize );
+}
+
+ImpostorAtlas::ImpostorAtlas( const vector<TriMesh> &models, size_t numAngles, int cellSize ) :
+mGridSize( numAngles, models.size() )
+{
+	// measure the models, the half width is the largest distance to the
+	// vertical axis so the silhouette fits the quad whatever the angle
+	for( const auto &mesh : models ){
+		const vec3* positions = mesh.getPositions<3>();
+		vec4 extents( 0.0f, 10000000.0f, -10000000.0f, 0.0f );
+		for( size_t i = 0; i < mesh.getNumVertices(); ++i ){
+			extents.x = glm::max( extents.x, glm::length( vec2( positions[i].x, positions[i].z ) ) );
+			extents.y = glm::min( extents.y, positions[i].y );
+			extents.z = glm::max( extents.z, positions[i].y );
+		}
+		mExtents.push_back( extents );
+	}
+	
+	// the atlas is mipmapped so the distant impostors don't shimmer
+	ivec2 size		= ivec2( mGridSize ) * cellSize;
+	auto format		= gl::Texture2d::Format().internalFormat( GL_RGBA8 ).mipmap().minFilter( GL_LINEAR_MIPMAP_LINEAR ).magFilter( GL_LINEAR ).wrap( GL_CLAMP_TO_EDGE );
+	mTexture		= gl::Texture2d::create( size.x, size.y, format );
+	
+	gl::Fbo::Format fboFormat;
+	fboFormat.attachment( GL_COLOR_ATTACHMENT0, mTexture );
+	auto fbo = gl::Fbo::create( size.x, size.y, fboFormat );
+	
+	{
+		gl::ScopedFramebuffer scopedFbo( fbo );
+		gl::ScopedViewport scopedViewport( ivec2(0), size );
+		gl::ScopedMatrices scopedMatrices;
+		gl::ScopedFaceCulling disableCulling( false );
+		gl::ScopedDepth disableDepth( false );
+		gl::ScopedBlend disableBlending( false );
+		gl::clear( ColorA::zero() );
+		
+		auto shader = gl::getStockShader( gl::ShaderDef().color() );
+		gl::ScopedGlslProg scopedShader( shader );
+		gl::ScopedColor scopedColor( ColorA::white() );
+		gl::setModelMatrix( mat4( 1.0f ) );
+		
+		for( size_t m = 0; m < models.size(); ++m ){
+			// fit the orthographic projection to the model extents
+			const vec4 &extents = mExtents[m];
+			auto batch = gl::Batch::create( models[m], shader );
+			gl::setProjectionMatrix( glm::ortho( -extents.x, extents.x, extents.y, extents.z, -extents.x - 1.0f, extents.x + 1.0f ) );
+			
+			for( size_t a = 0; a < numAngles; ++a ){
+				// looking at the model from an angle is the same as rotating it the other way
+				float angle = (float) a / (float) numAngles * 2.0f * M_PI;
+				gl::ScopedViewport cellViewport( ivec2( a, m ) * cellSize, ivec2( cellSize ) );
+				gl::setViewMatrix( glm::rotate( mat4( 1.0f ), -angle, vec3( 0, 1, 0 ) ) );
+				batch->draw();
+			}
+		}
+	}
+	
+	// the fbo only filled the first level
+	gl::ScopedTextureBind scopedTexture( mTexture );
+	glGenerateMipmap( GL_TEXTURE_2D );
+	
+	// and the unit quad, x goes from -1 to 1 and y from the bottom to the top of the model
+	vector<vec2> quad = { vec2( -1.0f, 0.0f ), vec2( 1.0f, 0.0f ), vec2( -1.0f, 1.0f ), vec2( 1.0f, 1.0f ) };
+	mQuad = gl::Vbo::create( GL_ARRAY_BUFFER, quad, GL_STATIC_DRAW );
+}
+
+size_t ImpostorAtlas::getSize() const
+{
+	// a full mipmap chain adds a third of the first level
+	return mTexture ? mTexture->getWidth() * mTexture->getHeight() * 4 * 4 / 3 : 0;
+}
+
+// MARK: ImpostorPopulation
+
+ImpostorPopulationRef ImpostorPopulation::create( const InstancedPopulation::Data &data, const ImpostorAtlasRef &atlas, const gl::GlslProgRef &shader, const BufferPoolRef &pool )
+{
+	// the instances of an impostors only population are sorted by importance, they are thinned out as a whole
+	auto instancesVbo = pool ? pool->acquire( GL_ARRAY_BUFFER, data.getSize(), data.mInstances.data() ) : gl::Vbo::create( GL_ARRAY_BUFFER, data.mInstances, GL_STATIC_DRAW );
+	return make_shared<ImpostorPopulation>( instancesVbo, vector<InstancedPopulation::InstanceRange>( 1, { 0, data.getNumInstances() } ), true, atlas, shader, pool );
+}
+
+ImpostorPopulationRef ImpostorPopulation::create( const InstancedPopulationRef &population, const ImpostorAtlasRef &atlas, const gl::GlslProgRef &shader, const BufferPoolRef &pool )
+{
+	// the shared instances are sorted by model, each model keeps its most important instances first
+	return make_shared<ImpostorPopulation>( population->getInstancesVbo(), population->getInstanceRanges(), false, atlas, shader, pool );
+}
+
+ImpostorPopulation::ImpostorPopulation( const gl::VboRef &instancesVbo, const vector<InstancedPopulation::InstanceRange> &ranges, bool ownsInstances, const ImpostorAtlasRef &atlas, const gl::GlslProgRef &shader, const BufferPoolRef &pool ) :
+mAtlas( atlas ),
+mInstancesVbo( instancesVbo ),
+mShader( shader ),
+mPool( pool ),
+mNumInstances( 0 ),
+mOwnsInstances( ownsInstances )
+{
+	for( const auto &range : ranges ){
+		mRanges.push_back( { range.mFirstInstance, range.mNumInstances, nullptr } );
+		mNumInstances += range.mNumInstances;
+	}
+	buildVaos();
+}
+
+ImpostorPopulation::~ImpostorPopulation()
+{
+	// a shared instances buffer goes back to the pool with its owner
+	if( mPool ){
+		if( mOwnsInstances ){
+			mPool->release( mInstancesVbo );
+		}
+		for( const auto &range : mRanges ){
+			mPool->releaseVao( range.mVao );
+		}
+	}
+}
+
+void ImpostorPopulation::buildVaos()
+{
+	if( ! mShader )
+		return;
+	
+	int positionLocation = mShader->getAttribSemanticLocation( geom::Attrib::POSITION );
+	int uvDelayLocation	= mShader->getAttribLocation( "aInstanceUvDelay" );
+	int rotationLocation = mShader->getAttribLocation( "aInstanceRotation" );
+	int scaleLocation	= mShader->getAttribLocation( "aInstanceScale" );
+	
+	for( auto &range : mRanges ){
+		if( mPool ){
+			mPool->releaseVao( range.mVao );
+			range.mVao = mPool->acquireVao();
+		}
+		else {
+			range.mVao = gl::Vao::create();
+		}
+		gl::ScopedVao scopedVao( range.mVao );
+		
+		// per-vertex quad corners
+		if( positionLocation >= 0 ){
+			gl::ScopedBuffer scopedQuad( mAtlas->getQuad() );
+			gl::enableVertexAttribArray( positionLocation );
+			gl::vertexAttribPointer( positionLocation, 2, GL_FLOAT, GL_FALSE, 0, (const GLvoid*) 0 );
+		}
+		
+		// and the same per-instance stream as the instanced population, from the first instance of the range
+		gl::ScopedBuffer scopedInstances( mInstancesVbo );
+		size_t base = range.mFirstInstance * sizeof( InstancedPopulation::Instance );
+		auto instanceAttrib = [base]( int location, GLint dims, GLenum type, GLboolean normalized, size_t offset ){
+			if( location < 0 )
+				return;
+			gl::enableVertexAttribArray( location );
+			gl::vertexAttribPointer( location, dims, type, normalized, sizeof( InstancedPopulation::Instance ), (const GLvoid*) ( base + offset ) );
+			gl::vertexAttribDivisor( location, 1 );
+		};
+		instanceAttrib( uvDelayLocation, 4, GL_UNSIGNED_SHORT, GL_TRUE, offsetof( InstancedPopulation::Instance, mUvDelay ) );
+		instanceAttrib( rotationLocation, 4, GL_SHORT, GL_TRUE, offsetof( InstancedPopulation::Instance, mRotation ) );
+		instanceAttrib( scaleLocation, 1, GL_FLOAT, GL_FALSE, offsetof( InstancedPopulation::Instance, mScale ) );
+	}
+}
+
+void ImpostorPopulation::replaceGlslProg( const gl::GlslProgRef &shader )
+{
+	if( mShader != shader ){
+		mShader = shader;
+		buildVaos();
+	}
+}
+
+void ImpostorPopulation::draw( float density )
+{
+	gl::ScopedGlslProg scopedShader( mShader );
+	for( const auto &range : mRanges ){
+		size_t numInstances = glm::min( (size_t) ceil( density * range.mNumInstances ), range.mNumInstances );
+		if( numInstances == 0 )
+			continue;
+		gl::ScopedVao scopedVao( range.mVao );
+		gl::context()->setDefaultShaderVars();
+		gl::drawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, numInstances );
+	}
+}
@@ -0,0 +1,107 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/gl/Vao.h"
+#include "cinder/gl/Vbo.h"
+#include "cinder/gl/Texture.h"
+#include "cinder/gl/GlslProg.h"
+#include "cinder/TriMesh.h"
+
+#include "InstancedPopulation.h"
+
+typedef std::shared_ptr<class ImpostorAtlas> ImpostorAtlasRef;
+typedef std::shared_ptr<class ImpostorPopulation> ImpostorPopulationRef;
+
+//! Silhouettes of the population models seen from a ring of horizontal angles, rendered once
+//! into a single texture. The trees are flat fog colored shapes so the coverage is all we need.
+//! Each row of the atlas is a model and each column one of the angles.
+class ImpostorAtlas {
+public:
+	//! renders \a models from \a numAngles directions into cells of \a cellSize pixels
+	static ImpostorAtlasRef create( const std::vector<ci::TriMesh> &models, size_t numAngles = 8, int cellSize = 128 );
+	
+	//! returns the atlas texture
+	const ci::gl::Texture2dRef&		getTexture() const { return mTexture; }
+	//! returns the number of columns and rows of the atlas
+	ci::vec2						getGridSize() const { return mGridSize; }
+	//! returns the billboard half width, bottom and top of each model in its local space
+	const std::vector<ci::vec4>&	getExtents() const { return mExtents; }
+	//! returns the unit quad shared by every impostor
+	const ci::gl::VboRef&			getQuad() const { return mQuad; }
+	//! returns the number of bytes used by the atlas texture and its mipmaps
+	size_t							getSize() const;
+	
+	ImpostorAtlas( const std::vector<ci::TriMesh> &models, size_t numAngles, int cellSize );
+	
+protected:
+	ci::gl::Texture2dRef	mTexture;
+	ci::gl::VboRef			mQuad;
+	ci::vec2				mGridSize;
+	std::vector<ci::vec4>	mExtents;
+};
+
+//! Tile population rendered as camera facing quads textured with the atlas, one instanced draw
+//! call for the whole tile. It reads the same per-instance stream as InstancedPopulation and can
+//! share its buffer, it is then drawn with a call per model range so each range can be thinned out.
+class ImpostorPopulation {
+public:
+	//! uploads the instances of \a data and returns a new population drawn with \a shader, the
+	//! instances buffer and the vao are recycled from \a pool when there is one
+	static ImpostorPopulationRef create( const InstancedPopulation::Data &data, const ImpostorAtlasRef &atlas, const ci::gl::GlslProgRef &shader, const BufferPoolRef &pool = nullptr );
+	//! returns a new population reading the instances buffer of \a population
+	static ImpostorPopulationRef create( const InstancedPopulationRef &population, const ImpostorAtlasRef &atlas, const ci::gl::GlslProgRef &shader, const BufferPoolRef &pool = nullptr );
+	
+	//! renders the first \a density fraction of the impostors, of each model range when the instances are shared
+	void draw( float density = 1.0f );
+	
+	//! replaces the shader and rebuilds the vao if needed
+	void replaceGlslProg( const ci::gl::GlslProgRef &shader );
+	//! returns the shader used to render the impostors
+	const ci::gl::GlslProgRef& getGlslProg() const { return mShader; }
+	
+	//! returns the number of impostors
+	size_t	getNumInstances() const { return mNumInstances; }
+	//! returns the number of bytes used by the instances buffer, zero when it is shared
+	size_t	getSize() const { return mOwnsInstances ? mNumInstances * sizeof( InstancedPopulation::Instance ) : 0; }
+	
+	ImpostorPopulation( const ci::gl::VboRef &instancesVbo, const std::vector<InstancedPopulation::InstanceRange> &ranges, bool ownsInstances, const ImpostorAtlasRef &atlas, const ci::gl::GlslProgRef &shader, const BufferPoolRef &pool );
+	~ImpostorPopulation();
+	
+protected:
+	void buildVaos();
+	
+	//! instances thinned out together, with a vao starting at the first one
+	struct Range {
+		size_t				mFirstInstance;
+		size_t				mNumInstances;
+		ci::gl::VaoRef		mVao;
+	};
+	
+	ImpostorAtlasRef		mAtlas;
+	ci::gl::VboRef			mInstancesVbo;
+	std::vector<Range>		mRanges;
+	ci::gl::GlslProgRef		mShader;
+	BufferPoolRef			mPool;
+	size_t					mNumInstances;
+	bool					mOwnsInstances;
+};
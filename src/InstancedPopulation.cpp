@@ -0,0 +1,227 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "InstancedPopulation.h"
+
+#include "cinder/gl/scoped.h"
+#include "cinder/gl/Context.h"
+#include "cinder/gl/wrapper.h"
+
+using namespace std;
+using namespace ci;
+
+namespace {
+	
+	//! maps a value from [0, 1] to a 16 bits normalized unsigned integer
+	uint16_t quantizeUnsigned( float value )
+	{
+		return static_cast<uint16_t>( glm::clamp( value, 0.0f, 1.0f ) * 65535.0f + 0.5f );
+	}
+	
+	//! maps a value from [-1, 1] to a 16 bits normalized signed integer
+	int16_t quantizeSigned( float value )
+	{
+		return static_cast<int16_t>( glm::round( glm::clamp( value, -1.0f, 1.0f ) * 32767.0f ) );
+	}
+	
+} // anonymous namespace
+
+// MARK: Model
+
+InstancedPopulation::ModelRef InstancedPopulation::Model::create( const TriMesh &mesh )
+{
+	return make_shared<Model>( mesh );
+}
+
+InstancedPopulation::Model::Model( const TriMesh &mesh ) :
+mNumIndices( mesh.getNumIndices() ),
+mBounds( mesh.calcBoundingBox() )
+{
+	// the models are small and shared by every tile so the positions are kept as floats
+	vector<vec3> positions( mesh.getNumVertices() );
+	const float* meshPositions	= mesh.getBufferPositions().data();
+	size_t positionsDims		= mesh.getPositionsDims();
+	for( size_t i = 0; i < positions.size(); ++i ){
+		positions[i] = vec3( meshPositions[i * positionsDims], meshPositions[i * positionsDims + 1], meshPositions[i * positionsDims + 2] );
+	}
+	mVbo = gl::Vbo::create( GL_ARRAY_BUFFER, positions, GL_STATIC_DRAW );
+	
+	// and the indices as 16 bits integers whenever possible
+	const auto &indices = mesh.getIndices();
+	if( positions.size() <= 65536 ){
+		vector<uint16_t> packed( indices.begin(), indices.end() );
+		mIndexType	= GL_UNSIGNED_SHORT;
+		mIbo		= gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, packed, GL_STATIC_DRAW );
+		mSize		= positions.size() * sizeof( vec3 ) + packed.size() * sizeof( uint16_t );
+	}
+	else {
+		mIndexType	= GL_UNSIGNED_INT;
+		mIbo		= gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, indices, GL_STATIC_DRAW );
+		mSize		= positions.size() * sizeof( vec3 ) + indices.size() * sizeof( uint32_t );
+	}
+}
+
+// MARK: Data
+
+void InstancedPopulation::Data::addInstance( size_t model, const vec2 &uv, float delay, const quat &rotation, float scale )
+{
+	Instance instance;
+	instance.mUvDelay[0]	= quantizeUnsigned( uv.x );
+	instance.mUvDelay[1]	= quantizeUnsigned( uv.y );
+	instance.mUvDelay[2]	= quantizeUnsigned( delay );
+	instance.mUvDelay[3]	= static_cast<uint16_t>( model );
+	instance.mRotation[0]	= quantizeSigned( rotation.x );
+	instance.mRotation[1]	= quantizeSigned( rotation.y );
+	instance.mRotation[2]	= quantizeSigned( rotation.z );
+	instance.mRotation[3]	= quantizeSigned( rotation.w );
+	instance.mScale			= scale;
+	mInstances.push_back( instance );
+}
+
+void InstancedPopulation::Data::sort()
+{
+	// keep the original order inside each model so the delays stay spread the same way
+	std::stable_sort( mInstances.begin(), mInstances.end(), []( const Instance &lhs, const Instance &rhs ){
+		return lhs.mUvDelay[3] < rhs.mUvDelay[3];
+	} );
+}
+
+// MARK: InstancedPopulation
+
+InstancedPopulationRef InstancedPopulation::create( const Data &data, const vector<ModelRef> &models, const gl::GlslProgRef &shader, const BufferPoolRef &pool )
+{
+	return make_shared<InstancedPopulation>( data, models, shader, pool );
+}
+
+InstancedPopulation::InstancedPopulation( const Data &data, const vector<ModelRef> &models, const gl::GlslProgRef &shader, const BufferPoolRef &pool ) :
+mShader( shader ),
+mPool( pool ),
+mNumInstances( data.getNumInstances() )
+{
+	// upload the instances
+	if( mPool ){
+		mInstancesVbo = mPool->acquire( GL_ARRAY_BUFFER, data.getSize(), data.mInstances.data() );
+	}
+	else {
+		mInstancesVbo = gl::Vbo::create( GL_ARRAY_BUFFER, data.mInstances, GL_STATIC_DRAW );
+	}
+	
+	// find the range of each model in the sorted instances
+	for( size_t i = 0; i < data.mInstances.size(); ){
+		size_t model = data.mInstances[i].mUvDelay[3];
+		size_t first = i;
+		while( i < data.mInstances.size() && data.mInstances[i].mUvDelay[3] == model ) ++i;
+		if( model < models.size() ){
+			mRanges.push_back( { models[model], first, i - first, nullptr } );
+		}
+	}
+	
+	// and bind them to the shader attributes
+	buildVaos();
+}
+
+InstancedPopulation::~InstancedPopulation()
+{
+	// give the buffer and the vaos back, the pool waits for the gpu before handing them out again
+	if( mPool ){
+		mPool->release( mInstancesVbo );
+		for( const auto &range : mRanges ){
+			mPool->releaseVao( range.mVao );
+		}
+	}
+}
+
+void InstancedPopulation::buildVaos()
+{
+	if( ! mShader )
+		return;
+	
+	int positionLocation = mShader->getAttribSemanticLocation( geom::Attrib::POSITION );
+	int uvDelayLocation	= mShader->getAttribLocation( "aInstanceUvDelay" );
+	int rotationLocation = mShader->getAttribLocation( "aInstanceRotation" );
+	int scaleLocation	= mShader->getAttribLocation( "aInstanceScale" );
+	
+	for( auto &range : mRanges ){
+		if( mPool ){
+			mPool->releaseVao( range.mVao );
+			range.mVao = mPool->acquireVao();
+		}
+		else {
+			range.mVao = gl::Vao::create();
+		}
+		gl::ScopedVao scopedVao( range.mVao );
+		
+		// per-vertex model positions
+		if( positionLocation >= 0 ){
+			gl::ScopedBuffer scopedVbo( range.mModel->mVbo );
+			gl::enableVertexAttribArray( positionLocation );
+			gl::vertexAttribPointer( positionLocation, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid*) 0 );
+		}
+		
+		// per-instance stream starting at the first instance of the range
+		gl::ScopedBuffer scopedInstances( mInstancesVbo );
+		size_t base = range.mFirstInstance * sizeof( Instance );
+		auto instanceAttrib = [base]( int location, GLint dims, GLenum type, GLboolean normalized, size_t offset ){
+			if( location < 0 )
+				return;
+			gl::enableVertexAttribArray( location );
+			gl::vertexAttribPointer( location, dims, type, normalized, sizeof( Instance ), (const GLvoid*) ( base + offset ) );
+			gl::vertexAttribDivisor( location, 1 );
+		};
+		instanceAttrib( uvDelayLocation, 4, GL_UNSIGNED_SHORT, GL_TRUE, offsetof( Instance, mUvDelay ) );
+		instanceAttrib( rotationLocation, 4, GL_SHORT, GL_TRUE, offsetof( Instance, mRotation ) );
+		instanceAttrib( scaleLocation, 1, GL_FLOAT, GL_FALSE, offsetof( Instance, mScale ) );
+		
+		// the element array binding is part of the vao state
+		range.mModel->mIbo->bind();
+	}
+}
+
+std::vector<InstancedPopulation::InstanceRange> InstancedPopulation::getInstanceRanges() const
+{
+	vector<InstanceRange> ranges;
+	for( const auto &range : mRanges ){
+		ranges.push_back( { range.mFirstInstance, range.mNumInstances } );
+	}
+	return ranges;
+}
+
+void InstancedPopulation::replaceGlslProg( const gl::GlslProgRef &shader )
+{
+	if( mShader != shader ){
+		mShader = shader;
+		buildVaos();
+	}
+}
+
+void InstancedPopulation::draw( float density )
+{
+	gl::ScopedGlslProg scopedShader( mShader );
+	for( const auto &range : mRanges ){
+		size_t numInstances = glm::min( (size_t) ceil( density * range.mNumInstances ), range.mNumInstances );
+		if( numInstances == 0 )
+			continue;
+		gl::ScopedVao scopedVao( range.mVao );
+		gl::context()->setDefaultShaderVars();
+		gl::drawElementsInstanced( GL_TRIANGLES, range.mModel->mNumIndices, range.mModel->mIndexType, 0, numInstances );
+	}
+}
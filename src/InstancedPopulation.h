@@ -0,0 +1,132 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/gl/Vao.h"
+#include "cinder/gl/Vbo.h"
+#include "cinder/gl/GlslProg.h"
+#include "cinder/AxisAlignedBox.h"
+#include "cinder/TriMesh.h"
+
+#include "BufferPool.h"
+
+typedef std::shared_ptr<class InstancedPopulation> InstancedPopulationRef;
+
+//! Tile population rendered with hardware instancing. The tree models are uploaded once and
+//! shared by every tile, each tile only stores a compact per-instance stream sorted by model.
+//! GLES 3 has no base instance so each model gets its own vao pointing at its instances range.
+class InstancedPopulation {
+public:
+	//! gpu version of a tree model, shared between every tile
+	class Model {
+	public:
+		static std::shared_ptr<Model> create( const ci::TriMesh &mesh );
+		
+		//! returns the model bounds in its local space
+		const ci::AxisAlignedBox& getBounds() const { return mBounds; }
+		//! returns the number of bytes used by the vertex and index buffers
+		size_t getSize() const { return mSize; }
+		
+		Model( const ci::TriMesh &mesh );
+		
+	protected:
+		ci::gl::VboRef		mVbo;
+		ci::gl::VboRef		mIbo;
+		size_t				mNumIndices;
+		GLenum				mIndexType;
+		ci::AxisAlignedBox	mBounds;
+		size_t				mSize;
+		
+		friend class InstancedPopulation;
+	};
+	typedef std::shared_ptr<Model> ModelRef;
+	
+	//! a single tree, 20 bytes
+	struct Instance {
+		uint16_t	mUvDelay[4];	//!< normalized height map uv, animation delay and model index
+		int16_t		mRotation[4];	//!< normalized quaternion
+		float		mScale;			//!< uniform scale
+	};
+	
+	//! instances drawn with the same model, contiguous in the instances buffer
+	struct InstanceRange {
+		size_t	mFirstInstance;
+		size_t	mNumInstances;
+	};
+	
+	//! cpu side of the population, can be built on any thread
+	struct Data {
+		//! adds an instance of \a model at \a uv on the height map
+		void	addInstance( size_t model, const ci::vec2 &uv, float delay, const ci::quat &rotation, float scale );
+		//! sorts the instances by model, has to be called before creating the population. the
+		//! order inside each model is kept so the most important instances stay first
+		void	sort();
+		
+		//! returns the number of instances
+		size_t	getNumInstances() const { return mInstances.size(); }
+		//! returns the number of bytes used by the instances
+		size_t	getSize() const { return mInstances.size() * sizeof( Instance ); }
+		
+		std::vector<Instance>	mInstances;
+	};
+	
+	//! uploads the instances of \a data and returns a new population drawing \a models with \a shader,
+	//! the instances buffer and the vaos are recycled from \a pool when there is one
+	static InstancedPopulationRef create( const Data &data, const std::vector<ModelRef> &models, const ci::gl::GlslProgRef &shader, const BufferPoolRef &pool = nullptr );
+	
+	//! renders the first \a density fraction of each model instances, one instanced draw call per model
+	void draw( float density = 1.0f );
+	
+	//! replaces the shader and rebuilds the vaos if needed
+	void replaceGlslProg( const ci::gl::GlslProgRef &shader );
+	//! returns the shader used to render the population
+	const ci::gl::GlslProgRef& getGlslProg() const { return mShader; }
+	
+	//! returns the number of instances
+	size_t	getNumInstances() const { return mNumInstances; }
+	//! returns the number of bytes used by the instances buffer, the models are shared and not included
+	size_t	getSize() const { return mNumInstances * sizeof( Instance ); }
+	//! returns the per-instance buffer, the impostors of the tile can share it
+	const ci::gl::VboRef& getInstancesVbo() const { return mInstancesVbo; }
+	//! returns the instances range of each model, in the buffer order
+	std::vector<InstanceRange> getInstanceRanges() const;
+	
+	InstancedPopulation( const Data &data, const std::vector<ModelRef> &models, const ci::gl::GlslProgRef &shader, const BufferPoolRef &pool );
+	~InstancedPopulation();
+	
+protected:
+	void buildVaos();
+	
+	//! range of instances sharing the same model
+	struct Range {
+		ModelRef			mModel;
+		size_t				mFirstInstance;
+		size_t				mNumInstances;
+		ci::gl::VaoRef		mVao;
+	};
+	
+	std::vector<Range>		mRanges;
+	ci::gl::VboRef			mInstancesVbo;
+	ci::gl::GlslProgRef		mShader;
+	BufferPoolRef			mPool;
+	size_t					mNumInstances;
+};
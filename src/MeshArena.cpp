@@ -0,0 +1,313 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "MeshArena.h"
+
+#include "cinder/gl/scoped.h"
+#include "cinder/gl/Context.h"
+#include "cinder/gl/wrapper.h"
+#include "cinder/CinderAssert.h"
+#include "cinder/Log.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+using namespace ci;
+
+namespace {
+	
+	//! returns a new buffer of \a capacity bytes starting with the first \a size bytes of \a vbo
+	gl::VboRef growBuffer( const gl::VboRef &vbo, size_t size, size_t capacity )
+	{
+		auto grown = gl::Vbo::create( vbo->getTarget(), capacity, nullptr, GL_STATIC_DRAW );
+		if( size ){
+			gl::ScopedBuffer scopedRead( GL_COPY_READ_BUFFER, vbo->getId() );
+			gl::ScopedBuffer scopedWrite( GL_COPY_WRITE_BUFFER, grown->getId() );
+			glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size );
+		}
+		return grown;
+	}
+	
+	//! returns \a capacity doubled until it holds \a size
+	size_t getGrownCapacity( size_t capacity, size_t size )
+	{
+		capacity = std::max<size_t>( capacity, 1 );
+		while( capacity < size ){
+			capacity *= 2;
+		}
+		return capacity;
+	}
+	
+} // anonymous namespace
+
+MeshArenaRef MeshArena::create( const gl::GlslProgRef &shader, size_t vertexCapacity, size_t indexCapacity )
+{
+	return make_shared<MeshArena>( shader, vertexCapacity, indexCapacity );
+}
+
+MeshArena::MeshArena( const gl::GlslProgRef &shader, size_t vertexCapacity, size_t indexCapacity ) :
+mShader( shader ),
+mStride( 0 ),
+mVertexCapacity( vertexCapacity ),
+mIndexCapacity( indexCapacity ),
+mNumVertices( 0 ),
+mNumIndices( 0 ),
+mNumDrawCalls( 0 )
+{
+}
+
+size_t MeshArena::add( uint32_t id, const PackedMesh::Data &data )
+{
+	// the first mesh decides of the vertex format, the vertex pulling meshes can't be merged
+	if( mAttribs.empty() ){
+		mAttribs	= data.mAttribs;
+		mStride		= data.mStride;
+		mVaos.clear();
+	}
+	CI_ASSERT( data.mStride == mStride && data.mTriangles.empty() );
+	CI_ASSERT( id <= numeric_limits<uint16_t>::max() );
+	
+	// the 16 bits indices can't reach past a page
+	if( data.mNumVertices > sPageSize ){
+		CI_LOG_E( "Mesh " << id << " has " << data.mNumVertices << " vertices, more than a page of the arena" );
+		return 0;
+	}
+	
+	// start a new page when the mesh doesn't fit in what is left of the current one
+	size_t pageStart = mNumVertices / sPageSize * sPageSize;
+	if( mNumVertices + data.mNumVertices > pageStart + sPageSize ){
+		pageStart		+= sPageSize;
+		mNumVertices	= pageStart;
+	}
+	reserve( data.mNumVertices, data.mNumIndices );
+	
+	Mesh mesh;
+	mesh.mFirstVertex		= mNumVertices;
+	mesh.mNumVertices		= data.mNumVertices;
+	mesh.mFirstIndex		= mNumIndices;
+	mesh.mNumIndices		= data.mNumIndices;
+	mesh.mPositionScale		= data.mPositionScale;
+	mesh.mPositionOffset	= data.mPositionOffset;
+	
+	// rebase the indices on the start of the page
+	size_t base = mesh.mFirstVertex - pageStart;
+	mIndices.resize( data.mNumIndices );
+	if( data.mIndexType == GL_UNSIGNED_SHORT ){
+		const uint16_t* indices = reinterpret_cast<const uint16_t*>( data.mIndices.data() );
+		for( size_t i = 0; i < data.mNumIndices; ++i ){
+			mIndices[i] = static_cast<uint16_t>( base + indices[i] );
+		}
+	}
+	else {
+		const uint32_t* indices = reinterpret_cast<const uint32_t*>( data.mIndices.data() );
+		for( size_t i = 0; i < data.mNumIndices; ++i ){
+			mIndices[i] = static_cast<uint16_t>( base + indices[i] );
+		}
+	}
+	mDrawIds.assign( data.mNumVertices, static_cast<uint16_t>( id ) );
+	
+	mVbo->bufferSubData( mesh.mFirstVertex * mStride, data.mNumVertices * mStride, data.mVertices.data() );
+	mDrawIdVbo->bufferSubData( mesh.mFirstVertex * sizeof( uint16_t ), mDrawIds.size() * sizeof( uint16_t ), mDrawIds.data() );
+	mIbo->bufferSubData( mesh.mFirstIndex * sizeof( uint16_t ), mIndices.size() * sizeof( uint16_t ), mIndices.data() );
+	mNumVertices	+= data.mNumVertices;
+	mNumIndices		+= data.mNumIndices;
+	
+	if( id >= mMeshes.size() ){
+		mMeshes.resize( id + 1 );
+	}
+	mMeshes[id] = mesh;
+	
+	return data.mNumVertices * ( mStride + sizeof( uint16_t ) ) + data.mNumIndices * sizeof( uint16_t );
+}
+
+void MeshArena::clear()
+{
+	mMeshes.clear();
+	mNumVertices	= 0;
+	mNumIndices		= 0;
+}
+
+void MeshArena::reorder( const vector<uint32_t> &ids )
+{
+	if( ! mIbo )
+		return;
+	
+	// the meshes in the requested order then the others
+	vector<uint32_t> order;
+	vector<bool> ordered( mMeshes.size(), false );
+	for( auto id : ids ){
+		if( contains( id ) && ! ordered[id] ){
+			order.push_back( id );
+			ordered[id] = true;
+		}
+	}
+	for( uint32_t id = 0; id < mMeshes.size(); ++id ){
+		if( contains( id ) && ! ordered[id] ){
+			order.push_back( id );
+		}
+	}
+	
+	// the indices are relative to the pages, which don't move, so the ranges can be copied as they are
+	auto ibo = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, mIndexCapacity * sizeof( uint16_t ), nullptr, GL_STATIC_DRAW );
+	gl::ScopedBuffer scopedRead( GL_COPY_READ_BUFFER, mIbo->getId() );
+	gl::ScopedBuffer scopedWrite( GL_COPY_WRITE_BUFFER, ibo->getId() );
+	size_t numIndices = 0;
+	for( auto id : order ){
+		Mesh &mesh = mMeshes[id];
+		glCopyBufferSubData( GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, mesh.mFirstIndex * sizeof( uint16_t ), numIndices * sizeof( uint16_t ), mesh.mNumIndices * sizeof( uint16_t ) );
+		mesh.mFirstIndex	= numIndices;
+		numIndices			+= mesh.mNumIndices;
+	}
+	
+	mIbo		= ibo;
+	mNumIndices	= numIndices;
+	mVaos.clear();
+}
+
+void MeshArena::draw( const uint32_t *ids, size_t count )
+{
+	draw( ids, count, mShader );
+}
+
+void MeshArena::draw( const uint32_t *ids, size_t count, const gl::GlslProgRef &shader )
+{
+	// gather the ranges of the meshes by page and in the buffer order
+	mRuns.clear();
+	for( size_t i = 0; i < count; ++i ){
+		if( contains( ids[i] ) ){
+			const Mesh &mesh = mMeshes[ids[i]];
+			mRuns.push_back( { mesh.mFirstVertex / sPageSize, mesh.mFirstIndex, mesh.mNumIndices } );
+		}
+	}
+	sort( mRuns.begin(), mRuns.end(), []( const Run &a, const Run &b ){ return a.mPage < b.mPage || ( a.mPage == b.mPage && a.mFirstIndex < b.mFirstIndex ); } );
+	
+	// and merge the adjacent ones sharing a page
+	size_t numRuns = 0;
+	for( size_t i = 0; i < mRuns.size(); ++i ){
+		if( numRuns && mRuns[numRuns - 1].mPage == mRuns[i].mPage && mRuns[numRuns - 1].mFirstIndex + mRuns[numRuns - 1].mNumIndices >= mRuns[i].mFirstIndex ){
+			if( mRuns[i].mFirstIndex != mRuns[numRuns - 1].mFirstIndex ){
+				mRuns[numRuns - 1].mNumIndices += mRuns[i].mNumIndices;
+			}
+		}
+		else {
+			mRuns[numRuns++] = mRuns[i];
+		}
+	}
+	mRuns.resize( numRuns );
+	mNumDrawCalls = 0;
+	
+	if( mRuns.empty() || ! shader )
+		return;
+	
+	// without base vertex draws each page has its own vao pointing at its first vertex
+	gl::ScopedGlslProg scopedShader( shader );
+	gl::ScopedVao scopedVao( getVao( shader, mRuns.front().mPage ) );
+	gl::context()->setDefaultShaderVars();
+	for( const auto &run : mRuns ){
+		gl::context()->bindVao( getVao( shader, run.mPage ).get() );
+		gl::drawElements( GL_TRIANGLES, (GLsizei) run.mNumIndices, GL_UNSIGNED_SHORT, (const GLvoid*) ( run.mFirstIndex * sizeof( uint16_t ) ) );
+	}
+	mNumDrawCalls = mRuns.size();
+}
+
+void MeshArena::replaceGlslProg( const gl::GlslProgRef &shader )
+{
+	mShader = shader;
+}
+
+size_t MeshArena::getSize() const
+{
+	size_t size = 0;
+	if( mVbo ) size += mVertexCapacity * ( mStride + sizeof( uint16_t ) );
+	if( mIbo ) size += mIndexCapacity * sizeof( uint16_t );
+	return size;
+}
+
+void MeshArena::reserve( size_t numVertices, size_t numIndices )
+{
+	// grow the buffers by copying the meshes already there, their offsets don't change
+	if( ! mVbo || mNumVertices + numVertices > mVertexCapacity ){
+		size_t capacity = getGrownCapacity( mVertexCapacity, mNumVertices + numVertices );
+		if( mVbo ){
+			mVbo		= growBuffer( mVbo, mNumVertices * mStride, capacity * mStride );
+			mDrawIdVbo	= growBuffer( mDrawIdVbo, mNumVertices * sizeof( uint16_t ), capacity * sizeof( uint16_t ) );
+		}
+		else {
+			mVbo		= gl::Vbo::create( GL_ARRAY_BUFFER, capacity * mStride, nullptr, GL_STATIC_DRAW );
+			mDrawIdVbo	= gl::Vbo::create( GL_ARRAY_BUFFER, capacity * sizeof( uint16_t ), nullptr, GL_STATIC_DRAW );
+		}
+		mVertexCapacity	= capacity;
+		mVaos.clear();
+	}
+	if( ! mIbo || mNumIndices + numIndices > mIndexCapacity ){
+		size_t capacity = getGrownCapacity( mIndexCapacity, mNumIndices + numIndices );
+		if( mIbo ){
+			mIbo = growBuffer( mIbo, mNumIndices * sizeof( uint16_t ), capacity * sizeof( uint16_t ) );
+		}
+		else {
+			mIbo = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, capacity * sizeof( uint16_t ), nullptr, GL_STATIC_DRAW );
+		}
+		mIndexCapacity	= capacity;
+		mVaos.clear();
+	}
+}
+
+const gl::VaoRef& MeshArena::getVao( const gl::GlslProgRef &shader, size_t page )
+{
+	for( const auto &vao : mVaos ){
+		if( vao.mShader == shader && vao.mPage == page )
+			return vao.mVao;
+	}
+	
+	mVaos.push_back( { shader, page, gl::Vao::create() } );
+	const auto &vao = mVaos.back().mVao;
+	if( ! mVbo )
+		return vao;
+	
+	// the attributes start at the first vertex of the page
+	size_t firstVertex = page * sPageSize;
+	gl::ScopedVao scopedVao( vao );
+	{
+		gl::ScopedBuffer scopedVbo( mVbo );
+		for( const auto &attrib : mAttribs ){
+			int location = shader->getAttribSemanticLocation( attrib.mSemantic );
+			if( location < 0 )
+				continue;
+			
+			gl::enableVertexAttribArray( location );
+			gl::vertexAttribPointer( location, attrib.mDims, attrib.mType, attrib.mNormalized, mStride, (const GLvoid*) ( firstVertex * mStride + attrib.mOffset ) );
+		}
+	}
+	
+	// the id of the mesh each vertex belongs to, read as an integer by the shader
+	int location = shader->getAttribLocation( "aDrawId" );
+	if( location >= 0 ){
+		gl::ScopedBuffer scopedVbo( mDrawIdVbo );
+		gl::enableVertexAttribArray( location );
+		gl::vertexAttribIPointer( location, 1, GL_UNSIGNED_SHORT, 0, (const GLvoid*) ( firstVertex * sizeof( uint16_t ) ) );
+	}
+	
+	// the element array binding is part of the vao state
+	mIbo->bind();
+	return vao;
+}
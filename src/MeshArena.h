@@ -0,0 +1,130 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/gl/Vao.h"
+#include "cinder/gl/Vbo.h"
+#include "cinder/gl/GlslProg.h"
+
+#include <vector>
+
+#include "PackedMesh.h"
+
+typedef std::shared_ptr<class MeshArena> MeshArenaRef;
+
+//! Vertex and index buffers shared by many meshes of the same packed format so they can be drawn
+//! with a few glDrawElements calls instead of one per mesh. Each mesh is added under an id that its
+//! vertices carry in the aDrawId attribute, the shader uses it to fetch the data that used to be
+//! per draw uniforms. The vertices are split in pages of 65536 and each mesh is kept inside a page
+//! so its indices stay 16 bits, rebased on the start of the page. ES3 has no base vertex draws so
+//! every page gets its own vao whose attributes start at the page. The index ranges can be moved
+//! around without touching the vertices and the visible meshes of a page whose ranges end up
+//! adjacent are drawn by the same call. The draw ids add 2 bytes per vertex, a quarter of the
+//! 8 bytes quantized terrain vertex, and a page wastes at most the size of a mesh at its end.
+class MeshArena {
+public:
+	//! returns a new arena drawn with \a shader, the buffers grow from the initial capacities as needed
+	static MeshArenaRef create( const ci::gl::GlslProgRef &shader, size_t vertexCapacity = 65536, size_t indexCapacity = 3 * 65536 );
+	
+	//! appends \a data under \a id and returns the number of gpu bytes it uses. A mesh already added
+	//! with the same id is replaced but its space is only reclaimed by clear()
+	size_t	add( uint32_t id, const PackedMesh::Data &data );
+	//! removes every mesh and keeps the buffers for the next ones
+	void	clear();
+	//! moves the index ranges so the meshes follow the order of \a ids, the meshes usually visible together
+	//! should be neighbours. The meshes missing from \a ids go last and the unused index space is reclaimed
+	void	reorder( const std::vector<uint32_t> &ids );
+	
+	//! draws the \a count meshes \a ids, adjacent index ranges are merged in the same draw call
+	void	draw( const uint32_t *ids, size_t count );
+	//! draws the \a count meshes \a ids with \a shader instead of the arena's shader
+	void	draw( const uint32_t *ids, size_t count, const ci::gl::GlslProgRef &shader );
+	
+	//! replaces the shader, the vaos of the shaders already used are kept until the buffers change
+	void	replaceGlslProg( const ci::gl::GlslProgRef &shader );
+	//! returns the shader used to render the meshes
+	const ci::gl::GlslProgRef& getGlslProg() const { return mShader; }
+	
+	//! returns whether a mesh was added under \a id
+	bool		contains( uint32_t id ) const { return id < mMeshes.size() && mMeshes[id].mNumIndices; }
+	//! returns the scale to apply to the normalized positions of the mesh \a id
+	ci::vec3	getPositionScale( uint32_t id ) const { return mMeshes[id].mPositionScale; }
+	//! returns the offset to apply to the scaled positions of the mesh \a id
+	ci::vec3	getPositionOffset( uint32_t id ) const { return mMeshes[id].mPositionOffset; }
+	//! returns the number of bytes allocated by the vertex and index buffers
+	size_t		getSize() const;
+	//! returns the number of draw calls issued by the last draw
+	size_t		getNumDrawCalls() const { return mNumDrawCalls; }
+	
+	MeshArena( const ci::gl::GlslProgRef &shader, size_t vertexCapacity, size_t indexCapacity );
+	
+protected:
+	//! the place of a mesh in the buffers
+	struct Mesh {
+		Mesh() : mFirstVertex( 0 ), mNumVertices( 0 ), mFirstIndex( 0 ), mNumIndices( 0 ) {}
+		size_t		mFirstVertex;
+		size_t		mNumVertices;
+		size_t		mFirstIndex;
+		size_t		mNumIndices;
+		ci::vec3	mPositionScale;
+		ci::vec3	mPositionOffset;
+	};
+	
+	//! a range of indices drawn by a single call
+	struct Run {
+		size_t mPage;
+		size_t mFirstIndex;
+		size_t mNumIndices;
+	};
+	
+	//! grows the buffers to hold \a numVertices and \a numIndices more
+	void	reserve( size_t numVertices, size_t numIndices );
+	//! returns the vao binding the vertices of \a page to the attributes of \a shader, built the first time
+	const ci::gl::VaoRef&	getVao( const ci::gl::GlslProgRef &shader, size_t page );
+	
+	//! the number of vertices a 16 bits index can reach
+	static const size_t sPageSize = 65536;
+	
+	struct PageVao {
+		ci::gl::GlslProgRef	mShader;
+		size_t				mPage;
+		ci::gl::VaoRef		mVao;
+	};
+	
+	//! the vaos of the shaders and pages the arena was drawn with, cleared when the buffers change
+	std::vector<PageVao>				mVaos;
+	ci::gl::VboRef						mVbo;
+	ci::gl::VboRef						mDrawIdVbo;
+	ci::gl::VboRef						mIbo;
+	ci::gl::GlslProgRef					mShader;
+	std::vector<PackedMesh::Attrib>		mAttribs;
+	size_t								mStride;
+	size_t								mVertexCapacity;
+	size_t								mIndexCapacity;
+	size_t								mNumVertices;
+	size_t								mNumIndices;
+	std::vector<Mesh>					mMeshes;
+	std::vector<Run>					mRuns;
+	std::vector<uint16_t>				mIndices;
+	std::vector<uint16_t>				mDrawIds;
+	size_t								mNumDrawCalls;
+};
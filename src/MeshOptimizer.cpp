@@ -0,0 +1,212 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "MeshOptimizer.h"
+
+using namespace std;
+using namespace ci;
+
+namespace MeshOptimizer {
+
+namespace {
+	
+	//! vertex to triangles adjacency stored as a compact offset table
+	struct Adjacency {
+		Adjacency( const uint32_t *indices, size_t numIndices, size_t numVertices )
+		: mOffsets( numVertices + 1, 0 ), mTriangles( numIndices )
+		{
+			for( size_t i = 0; i < numIndices; ++i ){
+				mOffsets[indices[i] + 1]++;
+			}
+			for( size_t i = 0; i < numVertices; ++i ){
+				mOffsets[i + 1] += mOffsets[i];
+			}
+			vector<uint32_t> cursors( mOffsets.begin(), mOffsets.end() - 1 );
+			for( size_t i = 0; i < numIndices; ++i ){
+				mTriangles[cursors[indices[i]]++] = static_cast<uint32_t>( i / 3 );
+			}
+		}
+		
+		vector<uint32_t> mOffsets;
+		vector<uint32_t> mTriangles;
+	};
+	
+	//! remaps a per-vertex attribute buffer of \a dims elements per vertex
+	template<typename T>
+	void remapBuffer( vector<T> *buffer, size_t dims, const vector<uint32_t> &remap )
+	{
+		if( dims == 0 || buffer->size() < remap.size() * dims )
+			return;
+		
+		vector<T> remapped( buffer->size() );
+		for( size_t i = 0; i < remap.size(); ++i ){
+			copy( buffer->begin() + i * dims, buffer->begin() + ( i + 1 ) * dims, remapped.begin() + remap[i] * dims );
+		}
+		buffer->swap( remapped );
+	}
+	
+} // anonymous namespace
+
+float getAcmr( const uint32_t *indices, size_t numIndices, size_t numVertices, size_t cacheSize )
+{
+	if( numIndices < 3 )
+		return 0.0f;
+	
+	// simulate a fifo cache: a vertex is still cached if less
+	// than cacheSize misses happened since it was inserted
+	vector<size_t> insertedAt( numVertices, 0 );
+	vector<bool> cached( numVertices, false );
+	size_t misses = 0;
+	for( size_t i = 0; i < numIndices; ++i ){
+		uint32_t v = indices[i];
+		if( ! cached[v] || misses - insertedAt[v] >= cacheSize ){
+			insertedAt[v]	= misses;
+			cached[v]		= true;
+			misses++;
+		}
+	}
+	
+	return static_cast<float>( misses ) / static_cast<float>( numIndices / 3 );
+}
+
+void optimizeVertexCache( uint32_t *indices, size_t numIndices, size_t numVertices, size_t cacheSize )
+{
+	size_t numTriangles = numIndices / 3;
+	if( numTriangles == 0 || numVertices == 0 )
+		return;
+	
+	Adjacency adjacency( indices, numIndices, numVertices );
+	
+	// number of non-emitted triangles and cache time stamp of each vertex
+	vector<uint32_t> liveTriangles( numVertices );
+	for( size_t i = 0; i < numVertices; ++i ){
+		liveTriangles[i] = adjacency.mOffsets[i + 1] - adjacency.mOffsets[i];
+	}
+	vector<int> cacheTimeStamps( numVertices, 0 );
+	vector<bool> emitted( numTriangles, false );
+	vector<uint32_t> deadEnds;
+	vector<uint32_t> candidates;
+	vector<uint32_t> output;
+	deadEnds.reserve( numIndices );
+	candidates.reserve( 64 );
+	output.reserve( numIndices );
+	
+	int timeStamp	= cacheSize + 1;
+	size_t cursor	= 0;
+	int fanning		= 0;
+	while( fanning >= 0 ){
+		// emit all the remaining triangles around the fanning vertex
+		candidates.clear();
+		for( uint32_t j = adjacency.mOffsets[fanning]; j < adjacency.mOffsets[fanning + 1]; ++j ){
+			uint32_t t = adjacency.mTriangles[j];
+			if( emitted[t] )
+				continue;
+			
+			for( size_t k = 0; k < 3; ++k ){
+				uint32_t v = indices[t * 3 + k];
+				output.push_back( v );
+				deadEnds.push_back( v );
+				candidates.push_back( v );
+				liveTriangles[v]--;
+				if( timeStamp - cacheTimeStamps[v] > static_cast<int>( cacheSize ) ){
+					cacheTimeStamps[v] = timeStamp++;
+				}
+			}
+			emitted[t] = true;
+		}
+		
+		// pick the next fanning vertex among the candidates still in cache
+		int next = -1, best = -1;
+		for( auto v : candidates ){
+			if( liveTriangles[v] > 0 ){
+				int priority = 0;
+				if( timeStamp - cacheTimeStamps[v] + 2 * static_cast<int>( liveTriangles[v] ) <= static_cast<int>( cacheSize ) ){
+					priority = timeStamp - cacheTimeStamps[v];
+				}
+				if( priority > best ){
+					best = priority;
+					next = v;
+				}
+			}
+		}
+		
+		// or skip to the last dead end or the next vertex with live triangles
+		if( next == -1 ){
+			while( ! deadEnds.empty() && next == -1 ){
+				uint32_t d = deadEnds.back();
+				deadEnds.pop_back();
+				if( liveTriangles[d] > 0 ) next = d;
+			}
+			while( next == -1 && cursor < numVertices ){
+				if( liveTriangles[cursor] > 0 ) next = cursor;
+				cursor++;
+			}
+		}
+		fanning = next;
+	}
+	
+	copy( output.begin(), output.end(), indices );
+}
+
+vector<uint32_t> optimizeVertexFetch( uint32_t *indices, size_t numIndices, size_t numVertices )
+{
+	const uint32_t unused = numeric_limits<uint32_t>::max();
+	vector<uint32_t> remap( numVertices, unused );
+	
+	// assign new ids in order of first use
+	uint32_t next = 0;
+	for( size_t i = 0; i < numIndices; ++i ){
+		uint32_t &v = remap[indices[i]];
+		if( v == unused ) v = next++;
+		indices[i] = v;
+	}
+	
+	// and move unreferenced vertices at the end
+	for( auto &v : remap ){
+		if( v == unused ) v = next++;
+	}
+	
+	return remap;
+}
+
+Stats optimize( TriMesh *mesh, size_t cacheSize )
+{
+	Stats stats;
+	auto &indices		= mesh->getIndices();
+	size_t numVertices	= mesh->getNumVertices();
+	stats.mNumTriangles	= indices.size() / 3;
+	stats.mAcmrBefore	= getAcmr( indices.data(), indices.size(), numVertices, cacheSize );
+	
+	optimizeVertexCache( indices.data(), indices.size(), numVertices, cacheSize );
+	auto remap = optimizeVertexFetch( indices.data(), indices.size(), numVertices );
+	
+	remapBuffer( &mesh->getBufferPositions(), mesh->getPositionsDims(), remap );
+	remapBuffer( &mesh->getBufferTexCoords0(), mesh->getTexCoords0Dims(), remap );
+	remapBuffer( &mesh->getBufferTexCoords1(), mesh->getTexCoords1Dims(), remap );
+	remapBuffer( &mesh->getBufferColors(), mesh->getColorDims(), remap );
+	remapBuffer( &mesh->getNormals(), 1, remap );
+	
+	stats.mAcmrAfter = getAcmr( indices.data(), indices.size(), numVertices, cacheSize );
+	return stats;
+}
+	
+} // namespace MeshOptimizer
@@ -0,0 +1,47 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/TriMesh.h"
+
+//! Post-transform vertex cache and vertex fetch optimizations for indexed triangle lists
+namespace MeshOptimizer {
+	
+	//! average cache miss ratios measured before and after optimizing a mesh
+	struct Stats {
+		Stats() : mNumTriangles( 0 ), mAcmrBefore( 0.0f ), mAcmrAfter( 0.0f ) {}
+		size_t	mNumTriangles;
+		float	mAcmrBefore;
+		float	mAcmrAfter;
+	};
+	
+	//! returns the average number of vertex shader invocations per triangle for a fifo cache of \a cacheSize entries
+	float getAcmr( const uint32_t *indices, size_t numIndices, size_t numVertices, size_t cacheSize = 16 );
+	//! reorders the triangles in place for post-transform cache locality (Tipsify, Sander et al. 2007)
+	void optimizeVertexCache( uint32_t *indices, size_t numIndices, size_t numVertices, size_t cacheSize = 16 );
+	//! reorders the indices in place so vertices are referenced in order of first use and returns the old to new vertex remap table
+	std::vector<uint32_t> optimizeVertexFetch( uint32_t *indices, size_t numIndices, size_t numVertices );
+	
+	//! optimizes both the triangles and the vertex attributes order of \a mesh and returns the acmr before and after
+	Stats optimize( ci::TriMesh *mesh, size_t cacheSize = 16 );
+	
+} // namespace MeshOptimizer
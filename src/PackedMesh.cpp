@@ -0,0 +1,322 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "PackedMesh.h"
+
+#include "cinder/gl/scoped.h"
+#include "cinder/gl/Context.h"
+#include "cinder/gl/wrapper.h"
+
+using namespace std;
+using namespace ci;
+
+namespace {
+	
+	//! maps a value from [offset, offset + 1 / invScale] to a 16 bits normalized integer
+	uint16_t quantize( float value, float offset, float invScale )
+	{
+		float normalized = glm::clamp( ( value - offset ) * invScale, 0.0f, 1.0f );
+		return static_cast<uint16_t>( normalized * 65535.0f + 0.5f );
+	}
+	
+	//! returns the inverse of a bounding box size, flat axes are mapped to 0
+	vec3 getInvScale( const vec3 &scale )
+	{
+		return vec3( scale.x > 0.0f ? 1.0f / scale.x : 0.0f, scale.y > 0.0f ? 1.0f / scale.y : 0.0f, scale.z > 0.0f ? 1.0f / scale.z : 0.0f );
+	}
+	
+	//! width of the vertex pulling textures, the minimum max texture size guaranteed by gles 3
+	const int sTexturesWidth = 2048;
+	//! texture units used by the vertex pulling textures, after the ones used by the terrain shaders
+	const int sIndicesUnit		= 5;
+	const int sVerticesUnit		= 6;
+	const int sTrianglesUnit	= 7;
+	
+	//! uploads \a numTexels of \a texelSize bytes to a nearest filtered texture sTexturesWidth texels wide
+	gl::Texture2dRef createDataTexture( const void* data, size_t numTexels, size_t texelSize, GLenum internalFormat, GLenum dataFormat, GLenum dataType )
+	{
+		// pad the data to fill the last row
+		int height = std::max<int>( 1, ( numTexels + sTexturesWidth - 1 ) / sTexturesWidth );
+		vector<uint8_t> padded( sTexturesWidth * height * texelSize, 0 );
+		memcpy( padded.data(), data, numTexels * texelSize );
+		
+		auto format = gl::Texture2d::Format().internalFormat( internalFormat ).dataType( dataType ).minFilter( GL_NEAREST ).magFilter( GL_NEAREST ).mipmap( false );
+		return gl::Texture2d::create( padded.data(), dataFormat, sTexturesWidth, height, format );
+	}
+	
+	//! copies the indices using 16 bits integers when the number of vertices allows it
+	void packIndices( const uint32_t* indices, size_t numIndices, PackedMesh::Data *data )
+	{
+		data->mNumIndices	= numIndices;
+		if( data->mNumVertices <= 65536 ){
+			data->mIndexType = GL_UNSIGNED_SHORT;
+			data->mIndices.resize( numIndices * sizeof( uint16_t ) );
+			uint16_t* packed = reinterpret_cast<uint16_t*>( data->mIndices.data() );
+			for( size_t i = 0; i < numIndices; ++i ){
+				packed[i] = static_cast<uint16_t>( indices[i] );
+			}
+		}
+		else {
+			data->mIndexType = GL_UNSIGNED_INT;
+			data->mIndices.resize( numIndices * sizeof( uint32_t ) );
+			memcpy( data->mIndices.data(), indices, data->mIndices.size() );
+		}
+	}
+	
+} // anonymous namespace
+
+PackedMesh::Data PackedMesh::packTerrainMesh( const TriMesh &mesh, const AxisAlignedBox &bounds, const vector<vec4> &triangles )
+{
+	Data data;
+	data.mNumVertices		= mesh.getNumVertices();
+	data.mPositionOffset	= bounds.getMin();
+	data.mPositionScale		= bounds.getSize();
+	
+	// the terrain is flat until displaced by the height map so we only need
+	// to store the xz coordinates. quantizing against the tile bounds instead
+	// of the actual samples bounds keeps the shared borders bit exact.
+	data.mAttribs.push_back( { geom::Attrib::POSITION, GL_UNSIGNED_SHORT, 2, GL_TRUE, 0 } );
+	data.mAttribs.push_back( { geom::Attrib::TEX_COORD_0, GL_UNSIGNED_SHORT, 2, GL_TRUE, 4 } );
+	data.mStride = 8;
+	data.mTriangles = triangles;
+	
+	// interleave and quantize the vertex data
+	const float* positions	= mesh.getBufferPositions().data();
+	const float* texCoords	= mesh.getBufferTexCoords0().data();
+	size_t positionsDims	= mesh.getPositionsDims();
+	size_t texCoordsDims	= mesh.getTexCoords0Dims();
+	vec3 invScale			= getInvScale( data.mPositionScale );
+	data.mVertices.resize( data.mNumVertices * data.mStride );
+	for( size_t i = 0; i < data.mNumVertices; ++i ){
+		uint16_t* packed	= reinterpret_cast<uint16_t*>( &data.mVertices[i * data.mStride] );
+		const float* p		= &positions[i * positionsDims];
+		const float* uv		= &texCoords[i * texCoordsDims];
+		packed[0]			= quantize( p[0], data.mPositionOffset.x, invScale.x );
+		packed[1]			= quantize( p[2], data.mPositionOffset.z, invScale.z );
+		packed[2]			= quantize( uv[0], 0.0f, 1.0f );
+		packed[3]			= quantize( uv[1], 0.0f, 1.0f );
+	}
+	
+	packIndices( mesh.getIndices().data(), mesh.getNumIndices(), &data );
+	return data;
+}
+
+PackedMesh::Data PackedMesh::packPopulationMesh( const vec3* positions, const vec3* texCoords, size_t numVertices, const uint32_t* indices, size_t numIndices, const vector<vec4> &triangles )
+{
+	Data data;
+	data.mNumVertices = numVertices;
+	
+	// the positions are quantized relative to their own bounds and
+	// the animation delay, if any, is stored in the position w component
+	data.mAttribs.push_back( { geom::Attrib::POSITION, GL_UNSIGNED_SHORT, 4, GL_TRUE, 0 } );
+	data.mAttribs.push_back( { geom::Attrib::TEX_COORD_0, GL_UNSIGNED_SHORT, 2, GL_TRUE, 8 } );
+	data.mStride = 12;
+	data.mTriangles = triangles;
+	
+	// find the positions bounds
+	vec3 min = vec3( numeric_limits<float>::max() ), max = vec3( -numeric_limits<float>::max() );
+	for( size_t i = 0; i < data.mNumVertices; ++i ){
+		min = glm::min( min, positions[i] );
+		max = glm::max( max, positions[i] );
+	}
+	data.mPositionOffset	= data.mNumVertices ? min : vec3( 0.0f );
+	data.mPositionScale		= data.mNumVertices ? max - min : vec3( 1.0f );
+	
+	// interleave and quantize the vertex data
+	vec3 invScale			= getInvScale( data.mPositionScale );
+	data.mVertices.resize( data.mNumVertices * data.mStride );
+	for( size_t i = 0; i < data.mNumVertices; ++i ){
+		uint16_t* packed	= reinterpret_cast<uint16_t*>( &data.mVertices[i * data.mStride] );
+		const vec3 &p		= positions[i];
+		const vec3 &uv		= texCoords[i];
+		packed[0]			= quantize( p.x, data.mPositionOffset.x, invScale.x );
+		packed[1]			= quantize( p.y, data.mPositionOffset.y, invScale.y );
+		packed[2]			= quantize( p.z, data.mPositionOffset.z, invScale.z );
+		packed[3]			= quantize( uv.z, 0.0f, 1.0f );
+		packed[4]			= quantize( uv.x, 0.0f, 1.0f );
+		packed[5]			= quantize( uv.y, 0.0f, 1.0f );
+	}
+	
+	packIndices( indices, numIndices, &data );
+	return data;
+}
+
+vector<vec4> PackedMesh::getTrianglesCenters( const TriMesh &mesh )
+{
+	const auto &indices		= mesh.getIndices();
+	const float* positions	= mesh.getBufferPositions().data();
+	size_t positionsDims	= mesh.getPositionsDims();
+	size_t numTriangles		= indices.size() / 3;
+	vector<vec4> triangles( numTriangles );
+	for( size_t i = 0; i < numTriangles; ++i ){
+		vec3 center = vec3( 0.0f );
+		for( size_t j = 0; j < 3; ++j ){
+			const float* p = &positions[indices[i * 3 + j] * positionsDims];
+			center += vec3( p[0], p[1], p[2] );
+		}
+		triangles[i] = vec4( center / 3.0f, (float) i / (float) numTriangles );
+	}
+	return triangles;
+}
+
+PackedMeshRef PackedMesh::create( const Data &data, const gl::GlslProgRef &shader, const BufferPoolRef &pool )
+{
+	return make_shared<PackedMesh>( data, shader, pool );
+}
+
+PackedMesh::PackedMesh( const Data &data, const gl::GlslProgRef &shader, const BufferPoolRef &pool ) :
+mShader( shader ),
+mPool( pool ),
+mAttribs( data.mAttribs ),
+mStride( data.mStride ),
+mNumVertices( data.mNumVertices ),
+mNumIndices( data.mNumIndices ),
+mIndexType( data.mIndexType ),
+mPositionScale( data.mPositionScale ),
+mPositionOffset( data.mPositionOffset ),
+mSize( data.getSize() )
+{
+	if( ! data.mTriangles.empty() ){
+		// per-triangle data can't be attached to shared vertices so everything goes
+		// to textures: the vertices as 16 bits integers texels ( one RGBA16UI per
+		// 8 bytes vertex, two RGB16UI per 12 bytes vertex ), the indices and the triangles
+		if( mStride % 8 == 0 ){
+			mVerticesTexture = createDataTexture( data.mVertices.data(), mNumVertices * mStride / 8, 8, GL_RGBA16UI, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT );
+		}
+		else {
+			mVerticesTexture = createDataTexture( data.mVertices.data(), mNumVertices * mStride / 6, 6, GL_RGB16UI, GL_RGB_INTEGER, GL_UNSIGNED_SHORT );
+		}
+		if( mIndexType == GL_UNSIGNED_SHORT ){
+			mIndicesTexture = createDataTexture( data.mIndices.data(), mNumIndices, 2, GL_R16UI, GL_RED_INTEGER, GL_UNSIGNED_SHORT );
+		}
+		else {
+			mIndicesTexture = createDataTexture( data.mIndices.data(), mNumIndices, 4, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT );
+		}
+		mTrianglesTexture = createDataTexture( data.mTriangles.data(), data.mTriangles.size(), sizeof( vec4 ), GL_RGBA32F, GL_RGBA, GL_FLOAT );
+	}
+	else if( mPool ){
+		// refill recycled buffers
+		mVbo = mPool->acquire( GL_ARRAY_BUFFER, data.mVertices.size(), data.mVertices.data() );
+		if( mNumIndices ){
+			mIbo = mPool->acquire( GL_ELEMENT_ARRAY_BUFFER, data.mIndices.size(), data.mIndices.data() );
+		}
+	}
+	else {
+		// upload the vertices and indices
+		mVbo = gl::Vbo::create( GL_ARRAY_BUFFER, data.mVertices.size(), data.mVertices.data(), GL_STATIC_DRAW );
+		if( mNumIndices ){
+			mIbo = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, data.mIndices.size(), data.mIndices.data(), GL_STATIC_DRAW );
+		}
+	}
+	
+	// and bind them to the shader attributes
+	buildVao();
+}
+
+PackedMesh::~PackedMesh()
+{
+	// give the buffers back, the pool waits for the gpu before handing them out again
+	if( mPool ){
+		mPool->release( mVbo );
+		mPool->release( mIbo );
+		mPool->releaseVao( mVao );
+	}
+}
+
+void PackedMesh::buildVao()
+{
+	if( ! mShader )
+		return;
+	
+	// the sampler uniforms of the vertex pulling shaders follow the shader
+	if( isVertexPulling() ){
+		mIndicesUniform		= UniformHandle<int>( mShader, "uIndices" );
+		mVerticesUniform	= UniformHandle<int>( mShader, "uVertices" );
+		mTrianglesUniform	= UniformHandle<int>( mShader, "uTriangles" );
+	}
+	
+	// vertex pulling meshes still need a vao to be drawn, just an empty one
+	if( mPool ){
+		mPool->releaseVao( mVao );
+		mVao = mPool->acquireVao();
+	}
+	else {
+		mVao = gl::Vao::create();
+	}
+	if( ! mVbo )
+		return;
+	
+	gl::ScopedVao scopedVao( mVao );
+	gl::ScopedBuffer scopedVbo( mVbo );
+	for( const auto &attrib : mAttribs ){
+		int location = mShader->getAttribSemanticLocation( attrib.mSemantic );
+		if( location < 0 )
+			continue;
+		
+		gl::enableVertexAttribArray( location );
+		gl::vertexAttribPointer( location, attrib.mDims, attrib.mType, attrib.mNormalized, mStride, (const GLvoid*) attrib.mOffset );
+	}
+	
+	// the element array binding is part of the vao state
+	if( mIbo ){
+		mIbo->bind();
+	}
+}
+
+void PackedMesh::replaceGlslProg( const gl::GlslProgRef &shader )
+{
+	if( mShader != shader ){
+		mShader = shader;
+		buildVao();
+	}
+}
+
+void PackedMesh::draw()
+{
+	draw( mIbo || isVertexPulling() ? mNumIndices : mNumVertices );
+}
+
+void PackedMesh::draw( size_t numIndices )
+{
+	if( numIndices == 0 )
+		return;
+	
+	gl::ScopedGlslProg scopedShader( mShader );
+	gl::ScopedVao scopedVao( mVao );
+	gl::context()->setDefaultShaderVars();
+	if( isVertexPulling() ){
+		gl::ScopedTextureBind scopedIndices( mIndicesTexture, sIndicesUnit );
+		gl::ScopedTextureBind scopedVertices( mVerticesTexture, sVerticesUnit );
+		gl::ScopedTextureBind scopedTriangles( mTrianglesTexture, sTrianglesUnit );
+		mIndicesUniform.set( sIndicesUnit );
+		mVerticesUniform.set( sVerticesUnit );
+		mTrianglesUniform.set( sTrianglesUnit );
+		// one invocation per index, gl_VertexID walks the index texture
+		gl::drawArrays( GL_TRIANGLES, 0, numIndices );
+	}
+	else if( mIbo ){
+		gl::drawElements( GL_TRIANGLES, numIndices, mIndexType, 0 );
+	}
+	else {
+		gl::drawArrays( GL_TRIANGLES, 0, numIndices );
+	}
+}
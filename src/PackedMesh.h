@@ -0,0 +1,130 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/gl/Vao.h"
+#include "cinder/gl/Vbo.h"
+#include "cinder/gl/Texture.h"
+#include "cinder/gl/GlslProg.h"
+#include "cinder/AxisAlignedBox.h"
+#include "cinder/TriMesh.h"
+
+#include "BufferPool.h"
+#include "UniformHandle.h"
+
+typedef std::shared_ptr<class PackedMesh> PackedMeshRef;
+
+//! Quantized gpu version of a TriMesh. Positions are stored as 16 bits normalized integers
+//! relative to a bounding box, texture coordinates as 16 bits normalized integers and indices
+//! as 16 bits integers whenever the mesh has less than 65536 vertices. Shaders decode the
+//! positions with the uPositionScale and uPositionOffset uniforms.
+//! When per-triangle data is provided the mesh is not bound as vertex attributes but
+//! uploaded to integer textures and drawn with glDrawArrays, the vertex shader fetches
+//! its index with gl_VertexID, then its vertex and its triangle data ( see VertexPulling.glsl ).
+class PackedMesh {
+public:
+	//! describes a single attribute of the interleaved vertex buffer
+	struct Attrib {
+		ci::geom::Attrib	mSemantic;
+		GLenum				mType;
+		GLint				mDims;
+		GLboolean			mNormalized;
+		size_t				mOffset;
+	};
+	
+	//! cpu side of a packed mesh, can be built on any thread
+	struct Data {
+		Data() : mStride( 0 ), mNumVertices( 0 ), mNumIndices( 0 ), mIndexType( GL_UNSIGNED_SHORT ), mPositionScale( 1.0f ), mPositionOffset( 0.0f ) {}
+		
+		//! returns the number of bytes used by the vertices and the indices
+		size_t getSize() const { return mVertices.size() + mIndices.size() + mTriangles.size() * sizeof( ci::vec4 ); }
+		
+		std::vector<Attrib>		mAttribs;
+		std::vector<uint8_t>	mVertices;
+		std::vector<uint8_t>	mIndices;
+		size_t					mStride;
+		size_t					mNumVertices;
+		size_t					mNumIndices;
+		GLenum					mIndexType;
+		ci::vec3				mPositionScale;
+		ci::vec3				mPositionOffset;
+		std::vector<ci::vec4>	mTriangles;
+	};
+	
+	//! packs a terrain mesh: xz positions relative to \a bounds and uvs as 16 bits, optional per-triangle \a triangles data
+	static Data packTerrainMesh( const ci::TriMesh &mesh, const ci::AxisAlignedBox &bounds, const std::vector<ci::vec4> &triangles = std::vector<ci::vec4>() );
+	//! packs a population mesh: xyz positions relative to the mesh bounds with the texCoords.z delay in w and uvs as 16 bits, optional per-triangle \a triangles data
+	static Data packPopulationMesh( const ci::vec3* positions, const ci::vec3* texCoords, size_t numVertices, const uint32_t* indices, size_t numIndices, const std::vector<ci::vec4> &triangles = std::vector<ci::vec4>() );
+	//! returns the triangles centers in xyz and their normalized index in w
+	static std::vector<ci::vec4> getTrianglesCenters( const ci::TriMesh &mesh );
+	
+	//! uploads \a data to the gpu and returns a new PackedMesh ready to be drawn with \a shader. the
+	//! buffers and the vao come from \a pool when there is one and go back to it with the mesh
+	static PackedMeshRef create( const Data &data, const ci::gl::GlslProgRef &shader, const BufferPoolRef &pool = nullptr );
+	
+	//! renders the whole mesh
+	void draw();
+	//! renders the first \a numIndices indices of the mesh, or vertices when it isn't indexed. nothing when 0
+	void draw( size_t numIndices );
+	
+	//! replaces the shader and rebuilds the vao if needed
+	void replaceGlslProg( const ci::gl::GlslProgRef &shader );
+	//! returns the shader used to render the mesh
+	const ci::gl::GlslProgRef& getGlslProg() const { return mShader; }
+	
+	//! returns the scale to apply to the normalized positions
+	ci::vec3	getPositionScale() const { return mPositionScale; }
+	//! returns the offset to apply to the scaled positions
+	ci::vec3	getPositionOffset() const { return mPositionOffset; }
+	//! returns the number of vertices
+	size_t		getNumVertices() const { return mNumVertices; }
+	//! returns the number of indices
+	size_t		getNumIndices() const { return mNumIndices; }
+	//! returns the number of bytes used by the vertex, index and triangle buffers
+	size_t		getSize() const { return mSize; }
+	//! returns whether the vertices are fetched from textures in the vertex shader
+	bool		isVertexPulling() const { return mIndicesTexture != nullptr; }
+	
+	PackedMesh( const Data &data, const ci::gl::GlslProgRef &shader, const BufferPoolRef &pool );
+	~PackedMesh();
+	
+protected:
+	void buildVao();
+	
+	ci::gl::VaoRef				mVao;
+	ci::gl::VboRef				mVbo;
+	ci::gl::VboRef				mIbo;
+	ci::gl::Texture2dRef		mVerticesTexture;
+	ci::gl::Texture2dRef		mIndicesTexture;
+	ci::gl::Texture2dRef		mTrianglesTexture;
+	ci::gl::GlslProgRef			mShader;
+	UniformHandle<int>			mIndicesUniform, mVerticesUniform, mTrianglesUniform;
+	BufferPoolRef				mPool;
+	std::vector<Attrib>			mAttribs;
+	size_t						mStride;
+	size_t						mNumVertices;
+	size_t						mNumIndices;
+	GLenum						mIndexType;
+	ci::vec3					mPositionScale;
+	ci::vec3					mPositionOffset;
+	size_t						mSize;
+};
@@ -0,0 +1,132 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "PoissonDisk.h"
+
+#include "cinder/CinderMath.h"
+
+using namespace std;
+using namespace ci;
+
+namespace PoissonDisk {
+
+namespace {
+	
+	//! uniform grid of the accepted samples used to find the neighbours of a candidate
+	class SampleGrid {
+	public:
+		SampleGrid( const Rectf &bounds, float cellSize )
+		: mOrigin( bounds.getUpperLeft() ), mCellSize( glm::max( cellSize, 0.0001f ) )
+		{
+			mNumCells	= glm::max( ivec2( glm::ceil( bounds.getSize() / mCellSize ) ), ivec2( 1 ) );
+			mCells.resize( mNumCells.x * mNumCells.y );
+		}
+		
+		void add( const vec2 &p )
+		{
+			mCells[getCellIndex( getCell( p ) )].push_back( p );
+		}
+		
+		//! returns whether a sample lies closer than \a radius from \a p
+		bool hasNeighbours( const vec2 &p, float radius ) const
+		{
+			ivec2 min = glm::max( getCell( p - vec2( radius ) ), ivec2( 0 ) );
+			ivec2 max = glm::min( getCell( p + vec2( radius ) ), mNumCells - ivec2( 1 ) );
+			float radiusSq = radius * radius;
+			for( int y = min.y; y <= max.y; ++y ){
+				for( int x = min.x; x <= max.x; ++x ){
+					for( const auto &sample : mCells[getCellIndex( ivec2( x, y ) )] ){
+						vec2 d = sample - p;
+						if( glm::dot( d, d ) < radiusSq )
+							return true;
+					}
+				}
+			}
+			return false;
+		}
+		
+	protected:
+		ivec2 getCell( const vec2 &p ) const { return ivec2( glm::floor( ( p - mOrigin ) / mCellSize ) ); }
+		size_t getCellIndex( const ivec2 &cell ) const
+		{
+			ivec2 c = glm::clamp( cell, ivec2( 0 ), mNumCells - ivec2( 1 ) );
+			return c.y * mNumCells.x + c.x;
+		}
+		
+		vec2					mOrigin;
+		float					mCellSize;
+		ivec2					mNumCells;
+		vector<vector<vec2>>	mCells;
+	};
+	
+} // anonymous namespace
+
+vector<vec2> distribution( CounterRng *rng, float separation, const Rectf &bounds, const vector<vec2> &initialSet, int k )
+{
+	return distribution( rng, [separation]( const vec2& ){ return separation; }, []( const vec2& ){ return true; }, bounds, initialSet, k );
+}
+
+vector<vec2> distribution( CounterRng *rng, const function<float(const vec2&)> &distFunction, const Rectf &bounds, const vector<vec2> &initialSet, int k )
+{
+	return distribution( rng, distFunction, []( const vec2& ){ return true; }, bounds, initialSet, k );
+}
+
+vector<vec2> distribution( CounterRng *rng, const function<float(const vec2&)> &distFunction, const function<bool(const vec2&)> &boundsFunction, const Rectf &bounds, const vector<vec2> &initialSet, int k )
+{
+	// start from the initial points or a random one
+	vector<vec2> output = initialSet;
+	if( output.empty() ){
+		output.push_back( vec2( rng->nextFloat( bounds.getX1(), bounds.getX2() ), rng->nextFloat( bounds.getY1(), bounds.getY2() ) ) );
+	}
+	
+	// the grid cells are sized by the spacing at the first point, the searches cover as many cells as the local spacing needs
+	SampleGrid grid( bounds, distFunction( output.front() ) / (float) M_SQRT2 );
+	for( const auto &p : output ){
+		grid.add( p );
+	}
+	
+	// grow the samples from a random active one until none can spawn new candidates. the
+	// active list is drained by swapping with its back so its order stays deterministic
+	vector<vec2> processing = output;
+	while( ! processing.empty() ){
+		size_t index	= rng->nextInt( 0, (int32_t) processing.size() );
+		vec2 current	= processing[index];
+		processing[index] = processing.back();
+		processing.pop_back();
+		
+		float separation = distFunction( current );
+		for( int i = 0; i < k; ++i ){
+			float radius	= rng->nextFloat( separation, separation * 2.0f );
+			float angle		= rng->nextFloat( 0.0f, 2.0f * (float) M_PI );
+			vec2 candidate	= current + vec2( cos( angle ), sin( angle ) ) * radius;
+			if( bounds.contains( candidate ) && boundsFunction( candidate ) && ! grid.hasNeighbours( candidate, distFunction( candidate ) ) ){
+				processing.push_back( candidate );
+				output.push_back( candidate );
+				grid.add( candidate );
+			}
+		}
+	}
+	
+	return output;
+}
+
+} // namespace PoissonDisk
@@ -0,0 +1,44 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/Rect.h"
+#include "cinder/Vector.h"
+
+#include <functional>
+#include <vector>
+
+#include "CounterRng.h"
+
+//! Poisson disk sampling (Bridson 2007) drawing every random value from a CounterRng, so the
+//! samples only depend on the stream they are given and not on the threads running the sampling.
+//! Seeded port of the PoissonDiskDistribution block, the initial points are part of the result.
+namespace PoissonDisk {
+	
+	//! returns samples of \a bounds at least \a separation apart, grown from \a initialSet or a random point, \a k candidates per sample
+	std::vector<ci::vec2> distribution( CounterRng *rng, float separation, const ci::Rectf &bounds, const std::vector<ci::vec2> &initialSet = std::vector<ci::vec2>(), int k = 30 );
+	//! returns samples of \a bounds spaced by \a distFunction at each sample
+	std::vector<ci::vec2> distribution( CounterRng *rng, const std::function<float(const ci::vec2&)> &distFunction, const ci::Rectf &bounds, const std::vector<ci::vec2> &initialSet = std::vector<ci::vec2>(), int k = 30 );
+	//! returns samples of \a bounds spaced by \a distFunction, the candidates rejected by \a boundsFunction are dropped
+	std::vector<ci::vec2> distribution( CounterRng *rng, const std::function<float(const ci::vec2&)> &distFunction, const std::function<bool(const ci::vec2&)> &boundsFunction, const ci::Rectf &bounds, const std::vector<ci::vec2> &initialSet = std::vector<ci::vec2>(), int k = 30 );
+	
+} // namespace PoissonDisk
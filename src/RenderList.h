@@ -0,0 +1,118 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/CinderAssert.h"
+
+#include "FrameAllocator.h"
+
+#include <cstring>
+
+//! List of pointers sorted by 64 bits keys, built every frame in a FrameAllocator. The keys are
+//! computed once per item and radix sorted, the sort passes whose byte is the same for every
+//! key are skipped.
+template<typename T>
+class RenderList {
+public:
+	//! a key and its item
+	struct Entry {
+		uint64_t	mKey;
+		T*			mItem;
+	};
+	
+	//! iterates the items in the order of the entries
+	struct Iterator {
+		const Entry* mEntry;
+		T*			operator*() const { return mEntry->mItem; }
+		Iterator&	operator++() { ++mEntry; return *this; }
+		bool		operator!=( const Iterator &other ) const { return mEntry != other.mEntry; }
+	};
+	
+	//! creates a list that can hold up to \a capacity items, the storage comes from \a allocator
+	RenderList( FrameAllocator *allocator, size_t capacity )
+	: mAllocator( allocator ), mEntries( allocator->allocate<Entry>( capacity ) ), mSize( 0 ), mCapacity( capacity )
+	{
+	}
+	
+	//! adds \a item with its sort \a key, the list can't grow past its capacity
+	void push( uint64_t key, T *item )
+	{
+		CI_ASSERT( mSize < mCapacity );
+		mEntries[mSize++] = { key, item };
+	}
+	
+	//! sorts the items by ascending keys, stable
+	void sort()
+	{
+		if( mSize < 2 )
+			return;
+		
+		// count every byte of every key in a single pass
+		uint32_t histograms[8][256];
+		std::memset( histograms, 0, sizeof( histograms ) );
+		for( size_t i = 0; i < mSize; ++i ){
+			for( size_t b = 0; b < 8; ++b ){
+				histograms[b][( mEntries[i].mKey >> ( b * 8 ) ) & 0xff]++;
+			}
+		}
+		
+		// then scatter one byte at a time, least significant first
+		Entry* src = mEntries;
+		Entry* dst = mAllocator->allocate<Entry>( mSize );
+		for( size_t b = 0; b < 8; ++b ){
+			uint32_t* histogram = histograms[b];
+			if( histogram[( src[0].mKey >> ( b * 8 ) ) & 0xff] == mSize )
+				continue;
+			
+			uint32_t offset = 0;
+			for( size_t i = 0; i < 256; ++i ){
+				uint32_t count	= histogram[i];
+				histogram[i]	= offset;
+				offset			+= count;
+			}
+			for( size_t i = 0; i < mSize; ++i ){
+				dst[histogram[( src[i].mKey >> ( b * 8 ) ) & 0xff]++] = src[i];
+			}
+			std::swap( src, dst );
+		}
+		mEntries = src;
+	}
+	
+	Iterator	begin() const { return { mEntries }; }
+	Iterator	end() const { return { mEntries + mSize }; }
+	size_t		size() const { return mSize; }
+	bool		empty() const { return mSize == 0; }
+	
+	//! returns an unsigned integer with the same order as \a value, for the keys
+	static uint32_t getOrderedBits( float value )
+	{
+		uint32_t bits;
+		std::memcpy( &bits, &value, sizeof( float ) );
+		return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+	}
+	
+protected:
+	FrameAllocator*	mAllocator;
+	Entry*			mEntries;
+	size_t			mSize;
+	size_t			mCapacity;
+};
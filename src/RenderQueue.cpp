@@ -0,0 +1,156 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "RenderQueue.h"
+
+#include "cinder/gl/Context.h"
+
+using namespace std;
+using namespace ci;
+
+RenderQueue::RenderQueue( FrameAllocator *allocator, size_t capacity ) :
+mAllocator( allocator ),
+mItems( allocator, capacity ),
+mNumPrograms( 0 ),
+mNumTextureSets( 0 )
+{
+}
+
+void RenderQueue::push( uint8_t layer, float depth, const Item &item )
+{
+	Item* copy = mAllocator->allocate<Item>( 1 );
+	*copy = item;
+	
+	// the layer first, then the state and the depth, the low bits of the depth don't matter
+	uint64_t key = (uint64_t) layer << 56 | getProgramId( copy->mProgram ) << 50 | getTexturesId( *copy ) << 44 | RenderList<Item>::getOrderedBits( depth ) >> 4;
+	mItems.push( key, copy );
+}
+
+RenderQueue::Stats RenderQueue::submit()
+{
+	Stats stats;
+	if( mItems.empty() )
+		return stats;
+	
+	mItems.sort();
+	
+	// the bindings of the first item are pushed so they can be restored at the end
+	auto ctx = gl::context();
+	const gl::GlslProg* program		= nullptr;
+	const gl::TextureBase* textures[sMaxTextures] = {};
+	GLenum pushedTargets[sMaxTextures] = {};
+	const void* vao					= nullptr;
+	bool pushedProgram				= false;
+	
+	for( const Item* item : mItems ){
+		if( item->mProgram != program ){
+			if( pushedProgram ){
+				ctx->bindGlslProg( item->mProgram );
+			}
+			else {
+				ctx->pushGlslProg( item->mProgram );
+				pushedProgram = true;
+			}
+			program = item->mProgram;
+			stats.mNumProgramChanges++;
+		}
+		else {
+			stats.mNumSkippedBinds++;
+		}
+		
+		for( uint8_t unit = 0; unit < sMaxTextures; ++unit ){
+			const gl::TextureBase* texture = item->mTextures[unit];
+			if( ! texture )
+				continue;
+			
+			if( texture != textures[unit] ){
+				if( pushedTargets[unit] ){
+					ctx->bindTexture( texture->getTarget(), texture->getId(), unit );
+				}
+				else {
+					ctx->pushTextureBinding( texture->getTarget(), texture->getId(), unit );
+					pushedTargets[unit] = texture->getTarget();
+				}
+				textures[unit] = texture;
+				stats.mNumTextureChanges++;
+			}
+			else {
+				stats.mNumSkippedBinds++;
+			}
+		}
+		
+		if( item->mVao != vao ){
+			vao = item->mVao;
+			stats.mNumVaoChanges++;
+		}
+		
+		item->mDraw( item->mContext, *item );
+		stats.mNumDraws++;
+	}
+	
+	// restore the previous bindings
+	for( uint8_t unit = 0; unit < sMaxTextures; ++unit ){
+		if( pushedTargets[unit] ){
+			ctx->popTextureBinding( pushedTargets[unit], unit );
+		}
+	}
+	if( pushedProgram ){
+		ctx->popGlslProg();
+	}
+	
+	return stats;
+}
+
+uint64_t RenderQueue::getProgramId( const gl::GlslProg *program )
+{
+	for( size_t i = 0; i < mNumPrograms; ++i ){
+		if( mPrograms[i] == program )
+			return i;
+	}
+	if( mNumPrograms == sMaxStates )
+		return sMaxStates - 1;
+	
+	mPrograms[mNumPrograms] = program;
+	return mNumPrograms++;
+}
+
+uint64_t RenderQueue::getTexturesId( const Item &item )
+{
+	auto isSameTextures = [&item]( const Item *other ){
+		for( size_t unit = 0; unit < sMaxTextures; ++unit ){
+			if( item.mTextures[unit] != other->mTextures[unit] )
+				return false;
+		}
+		return true;
+	};
+	
+	for( size_t i = 0; i < mNumTextureSets; ++i ){
+		if( isSameTextures( mTextureSets[i] ) )
+			return i;
+	}
+	if( mNumTextureSets == sMaxStates )
+		return sMaxStates - 1;
+	
+	// the items are kept until the end of the frame, refer to the first one with this set
+	mTextureSets[mNumTextureSets] = &item;
+	return mNumTextureSets++;
+}
@@ -0,0 +1,104 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/gl/GlslProg.h"
+#include "cinder/gl/Texture.h"
+
+#include "FrameAllocator.h"
+#include "RenderList.h"
+
+//! Collects the draws of a frame with the state they need, then submits them sorted by layer,
+//! program, textures and depth so that consecutive draws share as much state as possible. Only
+//! the program and the textures that differ from the previous draw are bound, the draw function
+//! of each item sets its own uniforms and binds its vertex state. Like RenderList the queue lives
+//! in a FrameAllocator and only for the frame it was created in.
+class RenderQueue {
+public:
+	//! the number of texture units an item can bind
+	static const size_t sMaxTextures = 4;
+	
+	struct Item;
+	//! issues the draw of \a item once its program and textures are bound
+	typedef void (*DrawFn)( void *context, const Item &item );
+	
+	//! the state and the draw function of a single draw
+	struct Item {
+		Item() : mProgram( nullptr ), mTextures(), mVao( nullptr ), mDraw( nullptr ), mContext( nullptr ), mObject( nullptr ), mIndex( 0 ), mValue( 0.0f ) {}
+		Item( ci::gl::GlslProg *program, DrawFn draw, void *context ) : mProgram( program ), mTextures(), mVao( nullptr ), mDraw( draw ), mContext( context ), mObject( nullptr ), mIndex( 0 ), mValue( 0.0f ) {}
+		
+		//! sets the program of the draw and the function issuing it
+		Item& program( ci::gl::GlslProg *program, DrawFn draw, void *context ) { mProgram = program; mDraw = draw; mContext = context; return *this; }
+		//! binds \a texture to \a unit for the draw
+		Item& texture( uint8_t unit, ci::gl::TextureBase *texture ) { mTextures[unit] = texture; return *this; }
+		//! identifies the vertex state bound by the draw function, only counted in the stats
+		Item& vao( const void *vao ) { mVao = vao; return *this; }
+		//! sets the values passed to the draw function
+		Item& object( const void *object, size_t index = 0, float value = 0.0f ) { mObject = object; mIndex = index; mValue = value; return *this; }
+		
+		ci::gl::GlslProg*		mProgram;
+		ci::gl::TextureBase*	mTextures[sMaxTextures];
+		const void*				mVao;
+		DrawFn					mDraw;
+		void*					mContext;
+		const void*				mObject;
+		size_t					mIndex;
+		float					mValue;
+	};
+	
+	//! the state changes of a submit
+	struct Stats {
+		Stats() : mNumDraws( 0 ), mNumProgramChanges( 0 ), mNumTextureChanges( 0 ), mNumVaoChanges( 0 ), mNumSkippedBinds( 0 ) {}
+		size_t mNumDraws;
+		size_t mNumProgramChanges;
+		size_t mNumTextureChanges;
+		size_t mNumVaoChanges;
+		//! the binds avoided because the previous draw already had the same program or texture
+		size_t mNumSkippedBinds;
+	};
+	
+	//! creates a queue that can hold up to \a capacity items, the storage comes from \a allocator
+	RenderQueue( FrameAllocator *allocator, size_t capacity );
+	
+	//! adds \a item to \a layer, the layers are drawn in ascending order and the items of a state front to back by \a depth
+	void	push( uint8_t layer, float depth, const Item &item );
+	//! sorts and draws every item, the program and textures bindings are restored afterwards
+	Stats	submit();
+	
+	size_t	size() const { return mItems.size(); }
+	
+protected:
+	//! returns the id of \a program in this frame
+	uint64_t getProgramId( const ci::gl::GlslProg *program );
+	//! returns the id of the textures of \a item in this frame
+	uint64_t getTexturesId( const Item &item );
+	
+	//! the number of distinct programs and texture sets sorted apart, the others share the last id
+	static const size_t sMaxStates = 64;
+	
+	FrameAllocator*				mAllocator;
+	RenderList<Item>			mItems;
+	const ci::gl::GlslProg*		mPrograms[sMaxStates];
+	size_t						mNumPrograms;
+	const Item*					mTextureSets[sMaxStates];
+	size_t						mNumTextureSets;
+};
@@ -0,0 +1,124 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "RoadPvs.h"
+#include "HorizonCuller.h"
+
+#include "cinder/Timer.h"
+
+using namespace std;
+using namespace ci;
+
+namespace {
+	
+	//! the number of steps used to measure the spline
+	const int sSplineSteps = 4096;
+	
+	//! returns \a bounds grown by \a radius on every side
+	AxisAlignedBox grow( const AxisAlignedBox &bounds, float radius )
+	{
+		return AxisAlignedBox( bounds.getMin() - vec3( radius ), bounds.getMax() + vec3( radius ) );
+	}
+	
+} // anonymous namespace
+
+RoadPvs::RoadPvs()
+: mNumWords( 0 ),
+mRadius( 0.0f ),
+mBuildTime( 0.0 )
+{
+}
+
+RoadPvs RoadPvs::build( const BSpline3f &spline, float elevation, float eyeHeight, const vector<Tile> &tiles, size_t numTiles, float interval )
+{
+	Timer timer( true );
+	RoadPvs pvs;
+	
+	// walk the spline with the heights the camera sees and
+	// drop a segment center every interval, starting half way
+	auto getEye = [&]( float t ){
+		vec3 position = spline.getPosition( t );
+		return vec3( position.x, position.y * elevation + eyeHeight, position.z );
+	};
+	vec3 previous		= getEye( 0.0f );
+	float travelled		= 0.0f;
+	float nextCenter	= interval * 0.5f;
+	for( int i = 1; i <= sSplineSteps; ++i ){
+		vec3 eye	= getEye( i / (float) sSplineSteps );
+		travelled	+= glm::distance( previous, eye );
+		previous	= eye;
+		if( travelled >= nextCenter ){
+			pvs.mCenters.push_back( eye );
+			nextCenter += interval;
+		}
+	}
+	
+	// the eyes between two centers are at most half an interval away from one of them
+	pvs.mRadius		= interval * 0.75f;
+	pvs.mNumWords	= ( numTiles * 2 + 63 ) / 64;
+	pvs.mBits.assign( pvs.mCenters.size() * pvs.mNumWords, 0 );
+	
+	// moving the eye by up to the radius is the same as moving everything else the other way: the
+	// tested bounds grow by the radius and the occluders only keep what they cover in every position
+	HorizonCuller culler;
+	for( size_t segment = 0; segment < pvs.mCenters.size(); ++segment ){
+		culler.clear();
+		for( const auto &tile : tiles ){
+			vec3 min = tile.mTerrainBounds.getMin() + vec3( pvs.mRadius, - pvs.mRadius, pvs.mRadius );
+			vec3 max = tile.mTerrainBounds.getMax() - vec3( pvs.mRadius, 0.0f, pvs.mRadius );
+			if( min.x < max.x && min.z < max.z ){
+				culler.addOccluder( AxisAlignedBox( min, vec3( max.x, std::max( min.y, max.y ), max.z ) ) );
+			}
+			culler.addBounds( grow( tile.mTerrainBounds, pvs.mRadius ) );
+			culler.addBounds( grow( tile.mPopulationBounds, pvs.mRadius ) );
+		}
+		culler.cull( pvs.mCenters[segment] );
+		
+		uint64_t *bits = &pvs.mBits[segment * pvs.mNumWords];
+		for( size_t i = 0; i < tiles.size(); ++i ){
+			for( size_t part = 0; part < 2; ++part ){
+				size_t bit = tiles[i].mId * 2 + part;
+				if( ! culler.isOccluded( i * 2 + part ) ){
+					bits[bit / 64] |= (uint64_t) 1 << ( bit % 64 );
+				}
+			}
+		}
+	}
+	
+	pvs.mBuildTime = timer.getSeconds() * 1000.0;
+	return pvs;
+}
+
+int RoadPvs::findSegment( const vec3 &eye ) const
+{
+	int closest			= -1;
+	float closestDist	= mRadius * mRadius;
+	for( size_t i = 0; i < mCenters.size(); ++i ){
+		vec3 offset	= eye - mCenters[i];
+		float dist	= glm::dot( offset, offset );
+		if( dist <= closestDist ){
+			closest		= (int) i;
+			closestDist	= dist;
+		}
+	}
+	return closest;
+}
@@ -0,0 +1,73 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/AxisAlignedBox.h"
+#include "cinder/BSpline.h"
+
+#include <vector>
+
+//! Potentially visible sets of the terrain tiles along the road. The road is cut in segments of
+//! equal length, each one keeps two bits per tile telling whether its terrain and its trees can
+//! be seen from anywhere within a radius of the segment center, in any direction. The sets are
+//! computed with a HorizonCuller from the center against the bounds grown by the radius and the
+//! occluders shrunk by it, which covers every eye within the radius.
+class RoadPvs {
+public:
+	//! the bounds of a tile as seen by the visibility computation
+	struct Tile {
+		size_t				mId;
+		ci::AxisAlignedBox	mTerrainBounds;
+		ci::AxisAlignedBox	mPopulationBounds;
+	};
+	
+	RoadPvs();
+	
+	//! computes the sets of the eyes along \a spline, its heights scaled by \a elevation and raised by \a eyeHeight,
+	//! every \a interval units. \a tiles are the occluders and the visibility of the tiles ids below \a numTiles
+	static RoadPvs build( const ci::BSpline3f &spline, float elevation, float eyeHeight, const std::vector<Tile> &tiles, size_t numTiles, float interval );
+	
+	//! returns the segment whose center is the closest to \a eye, -1 when the eye isn't within the radius of any
+	int		findSegment( const ci::vec3 &eye ) const;
+	//! returns whether the terrain of the tile \a tileId can be seen from \a segment
+	bool	isTerrainVisible( int segment, size_t tileId ) const { return getBit( segment, tileId * 2 ); }
+	//! returns whether the trees of the tile \a tileId can be seen from \a segment
+	bool	isPopulationVisible( int segment, size_t tileId ) const { return getBit( segment, tileId * 2 + 1 ); }
+	
+	//! returns whether there's no set to look up
+	bool	isEmpty() const { return mCenters.empty(); }
+	//! returns the number of segments along the road
+	size_t	getNumSegments() const { return mCenters.size(); }
+	//! returns the number of bytes used by the sets
+	size_t	getSize() const { return mBits.size() * sizeof( uint64_t ); }
+	//! returns the time in milliseconds the sets took to build
+	double	getBuildTime() const { return mBuildTime; }
+	
+protected:
+	bool	getBit( int segment, size_t bit ) const { return ( mBits[segment * mNumWords + bit / 64] >> ( bit % 64 ) ) & 1; }
+	
+	std::vector<ci::vec3>	mCenters;
+	std::vector<uint64_t>	mBits;
+	size_t					mNumWords;
+	float					mRadius;
+	double					mBuildTime;
+};
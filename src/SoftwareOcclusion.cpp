@@ -0,0 +1,423 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "SoftwareOcclusion.h"
+
+#include "cinder/Timer.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#if defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+	#include <arm_neon.h>
+	#define SOFTWARE_OCCLUSION_NEON
+#elif defined( __SSE__ ) || defined( _M_X64 )
+	#include <xmmintrin.h>
+	#define SOFTWARE_OCCLUSION_SSE
+#endif
+
+using namespace std;
+using namespace ci;
+
+namespace {
+	
+	//! returns the pixel coordinates and the normalized depth of \a clip, which has to be in front of the near plane
+	vec3 toScreen( const vec4 &clip, const vec2 &size )
+	{
+		vec3 ndc = vec3( clip ) / clip.w;
+		return vec3( ( ndc.x * 0.5f + 0.5f ) * size.x, ( ndc.y * 0.5f + 0.5f ) * size.y, ndc.z * 0.5f + 0.5f );
+	}
+	
+	//! returns whether \a clip is in front of the near plane
+	bool isInFront( const vec4 &clip )
+	{
+		return clip.w > 0.0f && clip.z >= -clip.w;
+	}
+	
+	//! clips the triangle \a a, \a b, \a c against the near plane and writes the resulting
+	//! triangle or quad to \a polygon in screen space. returns its number of vertices
+	size_t clipNear( const vec4 &a, const vec4 &b, const vec4 &c, const vec2 &size, vec3 *polygon )
+	{
+		const vec4 vertices[3] = { a, b, c };
+		size_t numVertices = 0;
+		for( size_t i = 0; i < 3; ++i ){
+			const vec4 &current	= vertices[i];
+			const vec4 &next	= vertices[( i + 1 ) % 3];
+			float currentDistance	= current.z + current.w;
+			float nextDistance		= next.z + next.w;
+			if( currentDistance >= 0.0f ){
+				polygon[numVertices++] = toScreen( current, size );
+			}
+			if( ( currentDistance >= 0.0f ) != ( nextDistance >= 0.0f ) ){
+				polygon[numVertices++] = toScreen( glm::mix( current, next, currentDistance / ( currentDistance - nextDistance ) ), size );
+			}
+		}
+		return numVertices;
+	}
+	
+	//! returns the edge function of \a p, \a q at \a x, \a y, positive on the left of the edge
+	float getEdge( const vec3 &p, const vec3 &q, float x, float y )
+	{
+		return ( q.x - p.x ) * ( y - p.y ) - ( q.y - p.y ) * ( x - p.x );
+	}
+	
+	//! writes the closest of \a depth and the interpolated depth to the \a numBlocks blocks of four pixels starting at
+	//! \a pixels, only where the three edge functions are positive. \a edges and \a depth are the values at the first
+	//! pixel, \a edgeSteps and \a depthStep their increments from one pixel to the next
+	void rasterizeSpan( float *pixels, int numBlocks, const vec3 &edges, const vec3 &edgeSteps, float depth, float depthStep )
+	{
+#if defined( SOFTWARE_OCCLUSION_SSE )
+		__m128 lanes = _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f );
+		__m128 zero = _mm_setzero_ps();
+		__m128 e0 = _mm_add_ps( _mm_set1_ps( edges.x ), _mm_mul_ps( _mm_set1_ps( edgeSteps.x ), lanes ) );
+		__m128 e1 = _mm_add_ps( _mm_set1_ps( edges.y ), _mm_mul_ps( _mm_set1_ps( edgeSteps.y ), lanes ) );
+		__m128 e2 = _mm_add_ps( _mm_set1_ps( edges.z ), _mm_mul_ps( _mm_set1_ps( edgeSteps.z ), lanes ) );
+		__m128 z = _mm_add_ps( _mm_set1_ps( depth ), _mm_mul_ps( _mm_set1_ps( depthStep ), lanes ) );
+		__m128 s0 = _mm_set1_ps( 4.0f * edgeSteps.x ), s1 = _mm_set1_ps( 4.0f * edgeSteps.y ), s2 = _mm_set1_ps( 4.0f * edgeSteps.z );
+		__m128 sz = _mm_set1_ps( 4.0f * depthStep );
+		for( int i = 0; i < numBlocks; ++i, pixels += 4 ){
+			__m128 inside = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( e0, zero ), _mm_cmpge_ps( e1, zero ) ), _mm_cmpge_ps( e2, zero ) );
+			if( _mm_movemask_ps( inside ) ){
+				__m128 current = _mm_loadu_ps( pixels );
+				_mm_storeu_ps( pixels, _mm_or_ps( _mm_and_ps( inside, _mm_min_ps( current, z ) ), _mm_andnot_ps( inside, current ) ) );
+			}
+			e0 = _mm_add_ps( e0, s0 );
+			e1 = _mm_add_ps( e1, s1 );
+			e2 = _mm_add_ps( e2, s2 );
+			z = _mm_add_ps( z, sz );
+		}
+#elif defined( SOFTWARE_OCCLUSION_NEON )
+		const float laneOffsets[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+		float32x4_t lanes = vld1q_f32( laneOffsets );
+		float32x4_t zero = vdupq_n_f32( 0.0f );
+		float32x4_t e0 = vmlaq_n_f32( vdupq_n_f32( edges.x ), lanes, edgeSteps.x );
+		float32x4_t e1 = vmlaq_n_f32( vdupq_n_f32( edges.y ), lanes, edgeSteps.y );
+		float32x4_t e2 = vmlaq_n_f32( vdupq_n_f32( edges.z ), lanes, edgeSteps.z );
+		float32x4_t z = vmlaq_n_f32( vdupq_n_f32( depth ), lanes, depthStep );
+		float32x4_t s0 = vdupq_n_f32( 4.0f * edgeSteps.x ), s1 = vdupq_n_f32( 4.0f * edgeSteps.y ), s2 = vdupq_n_f32( 4.0f * edgeSteps.z );
+		float32x4_t sz = vdupq_n_f32( 4.0f * depthStep );
+		for( int i = 0; i < numBlocks; ++i, pixels += 4 ){
+			uint32x4_t inside = vandq_u32( vandq_u32( vcgeq_f32( e0, zero ), vcgeq_f32( e1, zero ) ), vcgeq_f32( e2, zero ) );
+			uint32x2_t any = vorr_u32( vget_low_u32( inside ), vget_high_u32( inside ) );
+			if( vget_lane_u32( vpmax_u32( any, any ), 0 ) ){
+				float32x4_t current = vld1q_f32( pixels );
+				vst1q_f32( pixels, vbslq_f32( inside, vminq_f32( current, z ), current ) );
+			}
+			e0 = vaddq_f32( e0, s0 );
+			e1 = vaddq_f32( e1, s1 );
+			e2 = vaddq_f32( e2, s2 );
+			z = vaddq_f32( z, sz );
+		}
+#else
+		for( int i = 0; i < numBlocks * 4; ++i ){
+			float x = (float) i;
+			if( edges.x + edgeSteps.x * x >= 0.0f && edges.y + edgeSteps.y * x >= 0.0f && edges.z + edgeSteps.z * x >= 0.0f ){
+				pixels[i] = std::min( pixels[i], depth + depthStep * x );
+			}
+		}
+#endif
+	}
+	
+} // anonymous namespace
+
+SoftwareOcclusionRef SoftwareOcclusion::create( const ivec2 &size, size_t numBands )
+{
+	return make_shared<SoftwareOcclusion>( size, numBands );
+}
+
+SoftwareOcclusion::SoftwareOcclusion( const ivec2 &size, size_t numBands )
+: mSize( ( std::max( size.x, 4 ) + 3 ) / 4 * 4, std::max( size.y, 1 ) ),
+mNumBands( std::min( std::max<size_t>( numBands, 1 ), (size_t) mSize.y ) ),
+mFrame( 0 ),
+mNumBusy( 0 ),
+mQuit( false )
+{
+	// the width is a multiple of four so the rows are made of whole blocks
+	mDepth.assign( mSize.x * mSize.y, 1.0f );
+	
+	// every level halves the previous one down to a single texel
+	mLevels.push_back( { mSize.x, mSize.y, mDepth.data(), mDepth.data() } );
+	size_t pyramidSize = 0;
+	while( mLevels.back().mWidth > 1 || mLevels.back().mHeight > 1 ){
+		Level level = { ( mLevels.back().mWidth + 1 ) / 2, ( mLevels.back().mHeight + 1 ) / 2, nullptr, nullptr };
+		pyramidSize += level.mWidth * level.mHeight;
+		mLevels.push_back( level );
+	}
+	mPyramid.resize( pyramidSize * 2 );
+	size_t offset = 0;
+	for( size_t i = 1; i < mLevels.size(); ++i ){
+		size_t levelSize	= mLevels[i].mWidth * mLevels[i].mHeight;
+		mLevels[i].mMin		= &mPyramid[offset];
+		mLevels[i].mMax		= &mPyramid[offset + levelSize];
+		offset += 2 * levelSize;
+	}
+	
+	// the calling thread takes the first band, the workers wait for the others
+	for( size_t i = 1; i < mNumBands; ++i ){
+		mThreads.emplace_back( new thread( bind( &SoftwareOcclusion::work, this, i ) ) );
+	}
+}
+
+SoftwareOcclusion::~SoftwareOcclusion()
+{
+	// wake the workers up and wait for them to return
+	{
+		lock_guard<mutex> lock( mMutex );
+		mQuit = true;
+	}
+	mStartCondition.notify_all();
+	for( auto &thread : mThreads ){
+		thread->join();
+	}
+}
+
+void SoftwareOcclusion::setOccluders( vector<vec3> positions, vector<uint32_t> indices )
+{
+	mPositions	= std::move( positions );
+	mIndices	= std::move( indices );
+	mVertices.resize( mPositions.size() );
+}
+void SoftwareOcclusion::clearOccluders()
+{
+	mPositions.clear();
+	mIndices.clear();
+	mVertices.clear();
+}
+
+void SoftwareOcclusion::render( const mat4 &viewProjection, const mat4 &occludersTransform )
+{
+	Timer timer( true );
+	mViewProjection			= viewProjection;
+	mStats					= Stats();
+	mStats.mNumTriangles	= mIndices.size() / 3;
+	
+	// project the vertices once, the bands only read them
+	mat4 transform	= viewProjection * occludersTransform;
+	vec2 size		= vec2( mSize );
+	for( size_t i = 0; i < mPositions.size(); ++i ){
+		Vertex &vertex	= mVertices[i];
+		vertex.mClip	= transform * vec4( mPositions[i], 1.0f );
+		vertex.mInFront	= isInFront( vertex.mClip );
+		if( vertex.mInFront ){
+			vertex.mScreen = toScreen( vertex.mClip, size );
+		}
+	}
+	
+	// start the workers, fill the first band and wait for the others
+	{
+		lock_guard<mutex> lock( mMutex );
+		mNumBusy = mThreads.size();
+		mFrame++;
+	}
+	mStartCondition.notify_all();
+	rasterize( 0 );
+	{
+		unique_lock<mutex> lock( mMutex );
+		mDoneCondition.wait( lock, [this](){ return mNumBusy == 0; } );
+	}
+	mStats.mRasterizeTime = timer.getSeconds() * 1000.0;
+	
+	timer.start();
+	buildPyramid();
+	mStats.mPyramidTime = timer.getSeconds() * 1000.0;
+}
+
+bool SoftwareOcclusion::isOccluded( const AxisAlignedBox &bounds )
+{
+	Timer timer( true );
+	mStats.mNumTested++;
+	
+	// project the corners, the bounds crossing the near plane are never occluded
+	vec2 size		= vec2( mSize );
+	vec2 rectMin	= vec2( numeric_limits<float>::max() );
+	vec2 rectMax	= vec2( numeric_limits<float>::lowest() );
+	float depth		= 1.0f;
+	bool crossesNear = false;
+	const vec3 &min = bounds.getMin();
+	const vec3 &max = bounds.getMax();
+	for( int i = 0; i < 8 && ! crossesNear; ++i ){
+		vec4 clip = mViewProjection * vec4( i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z, 1.0f );
+		crossesNear = ! isInFront( clip );
+		if( ! crossesNear ){
+			vec3 screen	= toScreen( clip, size );
+			rectMin		= glm::min( rectMin, vec2( screen ) );
+			rectMax		= glm::max( rectMax, vec2( screen ) );
+			depth		= std::min( depth, screen.z );
+		}
+	}
+	
+	// leave the bounds outside of the screen to the frustum culling
+	bool occluded = false;
+	if( ! crossesNear && rectMax.x >= 0.0f && rectMax.y >= 0.0f && rectMin.x < size.x && rectMin.y < size.y ){
+		// grow the rectangle by a pixel as the occluders are only sampled at the pixel centers
+		int x0 = std::max( (int) rectMin.x - 1, 0 );
+		int y0 = std::max( (int) rectMin.y - 1, 0 );
+		int x1 = std::min( (int) std::min( rectMax.x, size.x ) + 1, mSize.x - 1 );
+		int y1 = std::min( (int) std::min( rectMax.y, size.y ) + 1, mSize.y - 1 );
+		
+		// start from the level where the rectangle covers two or three texels per side
+		int extent		= std::max( x1 - x0, y1 - y0 ) + 1;
+		size_t level	= 0;
+		while( level + 1 < mLevels.size() && ( 2 << level ) < extent ){
+			level++;
+		}
+		occluded = isHidden( level, x0, y0, x1, y1, depth );
+	}
+	
+	mStats.mNumOccluded += occluded ? 1 : 0;
+	mStats.mTestTime += timer.getSeconds() * 1000.0;
+	return occluded;
+}
+
+void SoftwareOcclusion::rasterize( size_t band )
+{
+	int y0 = (int) ( band * mSize.y / mNumBands );
+	int y1 = (int) ( ( band + 1 ) * mSize.y / mNumBands );
+	std::fill( mDepth.begin() + y0 * mSize.x, mDepth.begin() + y1 * mSize.x, 1.0f );
+	
+	vec2 size = vec2( mSize );
+	for( size_t i = 0; i + 2 < mIndices.size(); i += 3 ){
+		const Vertex &a = mVertices[mIndices[i]];
+		const Vertex &b = mVertices[mIndices[i + 1]];
+		const Vertex &c = mVertices[mIndices[i + 2]];
+		if( a.mInFront && b.mInFront && c.mInFront ){
+			// skip the triangles of the other bands before any setup
+			if( std::max( { a.mScreen.y, b.mScreen.y, c.mScreen.y } ) < y0 || std::min( { a.mScreen.y, b.mScreen.y, c.mScreen.y } ) >= y1 )
+				continue;
+			rasterizeTriangle( a.mScreen, b.mScreen, c.mScreen, y0, y1 );
+		}
+		else if( a.mInFront || b.mInFront || c.mInFront ){
+			// the triangles crossing the near plane become a triangle or a quad
+			vec3 polygon[4];
+			size_t numVertices = clipNear( a.mClip, b.mClip, c.mClip, size, polygon );
+			for( size_t j = 1; j + 1 < numVertices; ++j ){
+				rasterizeTriangle( polygon[0], polygon[j], polygon[j + 1], y0, y1 );
+			}
+		}
+	}
+}
+
+void SoftwareOcclusion::rasterizeTriangle( const vec3 &a, const vec3 &b, const vec3 &c, int y0, int y1 )
+{
+	// skip the degenerate triangles and make the others counter-clockwise
+	float area = ( b.x - a.x ) * ( c.y - a.y ) - ( b.y - a.y ) * ( c.x - a.x );
+	if( std::abs( area ) < 1e-6f )
+		return;
+	const vec3 &v1 = area > 0.0f ? b : c;
+	const vec3 &v2 = area > 0.0f ? c : b;
+	area = std::abs( area );
+	
+	// the rows of the band and the blocks of four pixels covered by the bounding box
+	float width		= (float) mSize.x;
+	int minX		= (int) glm::clamp( std::min( { a.x, v1.x, v2.x } ), 0.0f, width ) & ~3;
+	int maxX		= (int) std::ceil( glm::clamp( std::max( { a.x, v1.x, v2.x } ), 0.0f, width ) );
+	int minY		= std::max( (int) glm::clamp( std::min( { a.y, v1.y, v2.y } ), 0.0f, (float) mSize.y ), y0 );
+	int maxY		= std::min( (int) std::ceil( glm::clamp( std::max( { a.y, v1.y, v2.y } ), 0.0f, (float) mSize.y ) ), y1 );
+	if( minX >= maxX || minY >= maxY )
+		return;
+	int numBlocks	= ( maxX - minX + 3 ) / 4;
+	
+	// the edge functions and the depth plane step the same way along the rows
+	vec3 edgeSteps	= vec3( a.y - v1.y, v1.y - v2.y, v2.y - a.y );
+	float depthStepX = ( ( v1.z - a.z ) * ( v2.y - a.y ) - ( v2.z - a.z ) * ( v1.y - a.y ) ) / area;
+	float depthStepY = ( ( v2.z - a.z ) * ( v1.x - a.x ) - ( v1.z - a.z ) * ( v2.x - a.x ) ) / area;
+	
+	float x = minX + 0.5f;
+	for( int row = minY; row < maxY; ++row ){
+		float y		= row + 0.5f;
+		vec3 edges	= vec3( getEdge( a, v1, x, y ), getEdge( v1, v2, x, y ), getEdge( v2, a, x, y ) );
+		float depth	= a.z + depthStepX * ( x - a.x ) + depthStepY * ( y - a.y );
+		rasterizeSpan( &mDepth[row * mSize.x + minX], numBlocks, edges, edgeSteps, depth, depthStepX );
+	}
+}
+
+void SoftwareOcclusion::buildPyramid()
+{
+	for( size_t i = 1; i < mLevels.size(); ++i ){
+		const Level &source	= mLevels[i - 1];
+		Level &level		= mLevels[i];
+		for( int y = 0; y < level.mHeight; ++y ){
+			// the last texel of an odd row or column only has one child on that side
+			const float *min0	= source.mMin + 2 * y * source.mWidth;
+			const float *min1	= source.mMin + std::min( 2 * y + 1, source.mHeight - 1 ) * source.mWidth;
+			const float *max0	= source.mMax + 2 * y * source.mWidth;
+			const float *max1	= source.mMax + std::min( 2 * y + 1, source.mHeight - 1 ) * source.mWidth;
+			for( int x = 0; x < level.mWidth; ++x ){
+				int x0 = 2 * x, x1 = std::min( 2 * x + 1, source.mWidth - 1 );
+				level.mMin[y * level.mWidth + x] = std::min( std::min( min0[x0], min0[x1] ), std::min( min1[x0], min1[x1] ) );
+				level.mMax[y * level.mWidth + x] = std::max( std::max( max0[x0], max0[x1] ), std::max( max1[x0], max1[x1] ) );
+			}
+		}
+	}
+}
+
+bool SoftwareOcclusion::isHidden( size_t level, int x0, int y0, int x1, int y1, float depth ) const
+{
+	const Level &texels = mLevels[level];
+	for( int ty = y0 >> level; ty <= ( y1 >> level ); ++ty ){
+		for( int tx = x0 >> level; tx <= ( x1 >> level ); ++tx ){
+			size_t i = ty * texels.mWidth + tx;
+			
+			// every pixel under the texel is closer than the bounds
+			if( texels.mMax[i] < depth )
+				continue;
+			
+			// the texel can't be refined or, covered by the rectangle, has its closest pixel behind the bounds
+			int px0 = tx << level, px1 = ( ( tx + 1 ) << level ) - 1;
+			int py0 = ty << level, py1 = ( ( ty + 1 ) << level ) - 1;
+			bool covered = px0 >= x0 && px1 <= x1 && py0 >= y0 && py1 <= y1;
+			if( level == 0 || ( covered && texels.mMin[i] >= depth ) )
+				return false;
+			
+			// otherwise look at the part of the rectangle under the texel one level down
+			if( ! isHidden( level - 1, std::max( x0, px0 ), std::max( y0, py0 ), std::min( x1, px1 ), std::min( y1, py1 ), depth ) )
+				return false;
+		}
+	}
+	return true;
+}
+
+void SoftwareOcclusion::work( size_t band )
+{
+	size_t frame = 0;
+	while( true ){
+		// wait for the next render
+		{
+			unique_lock<mutex> lock( mMutex );
+			mStartCondition.wait( lock, [this,&frame](){ return mQuit || mFrame != frame; } );
+			if( mQuit )
+				return;
+			frame = mFrame;
+		}
+		
+		rasterize( band );
+		
+		// the last band done wakes the render up
+		{
+			lock_guard<mutex> lock( mMutex );
+			if( --mNumBusy == 0 ){
+				mDoneCondition.notify_one();
+			}
+		}
+	}
+}
@@ -0,0 +1,124 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/AxisAlignedBox.h"
+#include "cinder/Matrix.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::shared_ptr<class SoftwareOcclusion> SoftwareOcclusionRef;
+
+//! Occlusion culling on the cpu against a low resolution depth buffer. The occluders are rasterized
+//! four pixels at a time by a set of worker threads, each one filling its own band of rows, then the
+//! depth buffer is reduced to a pyramid keeping the closest and farthest depth of each texel. Bounds
+//! are tested against the level where their screen rectangle covers a couple of texels and only
+//! refined where that level can't decide. The occluders have to be conservative: they must never
+//! cover anything the real geometry doesn't.
+class SoftwareOcclusion {
+public:
+	//! returns a new buffer of \a size pixels filled by \a numBands threads, the calling thread included
+	static SoftwareOcclusionRef create( const ci::ivec2 &size = ci::ivec2( 256, 128 ), size_t numBands = 4 );
+	
+	//! the work and the timings of the last render and tests
+	struct Stats {
+		Stats() : mNumTriangles( 0 ), mNumTested( 0 ), mNumOccluded( 0 ), mRasterizeTime( 0.0 ), mPyramidTime( 0.0 ), mTestTime( 0.0 ) {}
+		//! the occluder triangles and the bounds tested since the render
+		size_t	mNumTriangles;
+		size_t	mNumTested;
+		size_t	mNumOccluded;
+		//! the times in milliseconds spent rasterizing, building the pyramid and testing bounds
+		double	mRasterizeTime;
+		double	mPyramidTime;
+		double	mTestTime;
+	};
+	
+	//! replaces the occluders by the triangles \a indices of the world space \a positions
+	void	setOccluders( std::vector<ci::vec3> positions, std::vector<uint32_t> indices );
+	//! removes every occluder, every bounds is visible until the next ones are set
+	void	clearOccluders();
+	//! returns whether there's anything to rasterize
+	bool	hasOccluders() const { return ! mIndices.empty(); }
+	
+	//! clears the depth buffer, rasterizes the occluders transformed by \a occludersTransform and seen
+	//! through \a viewProjection, then rebuilds the pyramid. the bounds are tested in \a viewProjection alone
+	void	render( const ci::mat4 &viewProjection, const ci::mat4 &occludersTransform = ci::mat4( 1.0f ) );
+	//! returns whether \a bounds is entirely hidden by the occluders of the last render
+	bool	isOccluded( const ci::AxisAlignedBox &bounds );
+	
+	//! returns the resolution of the depth buffer
+	ci::ivec2		getSize() const { return mSize; }
+	//! returns the depth buffer of the last render, normalized depths from the bottom row up
+	const std::vector<float>& getDepthBuffer() const { return mDepth; }
+	//! returns the stats of the last render and of the tests that followed
+	const Stats&	getStats() const { return mStats; }
+	
+	SoftwareOcclusion( const ci::ivec2 &size, size_t numBands );
+	~SoftwareOcclusion();
+	
+protected:
+	//! an occluder vertex in clip space and, when in front of the near plane, in screen space
+	struct Vertex {
+		ci::vec4	mClip;
+		ci::vec3	mScreen;
+		bool		mInFront;
+	};
+	
+	//! a level of the pyramid, the first one points twice to the depth buffer
+	struct Level {
+		int				mWidth, mHeight;
+		float*			mMin;
+		float*			mMax;
+	};
+	
+	//! clears and fills the rows of band \a band
+	void	rasterize( size_t band );
+	//! fills the pixels of the triangle \a a, \a b, \a c between rows \a y0 and \a y1
+	void	rasterizeTriangle( const ci::vec3 &a, const ci::vec3 &b, const ci::vec3 &c, int y0, int y1 );
+	void	buildPyramid();
+	//! returns whether every pixel of the rectangle \a x0, \a y0, \a x1, \a y1 is closer than \a depth, starting from \a level
+	bool	isHidden( size_t level, int x0, int y0, int x1, int y1, float depth ) const;
+	void	work( size_t band );
+	
+	ci::ivec2					mSize;
+	ci::mat4					mViewProjection;
+	std::vector<ci::vec3>		mPositions;
+	std::vector<uint32_t>		mIndices;
+	std::vector<Vertex>			mVertices;
+	std::vector<float>			mDepth;
+	std::vector<float>			mPyramid;
+	std::vector<Level>			mLevels;
+	Stats						mStats;
+	
+	size_t						mNumBands;
+	std::vector<std::unique_ptr<std::thread>> mThreads;
+	std::mutex					mMutex;
+	std::condition_variable		mStartCondition;
+	std::condition_variable		mDoneCondition;
+	size_t						mFrame;
+	size_t						mNumBusy;
+	bool						mQuit;
+};
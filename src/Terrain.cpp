@@ -33,17 +33,20 @@
 #include "cinder/Log.h"
 #include "cinder/Perlin.h"
 #include "cinder/Rand.h"
-#include "cinder/Frustum.h"
 #include "cinder/Utilities.h"
 #include "cinder/Timeline.h"
+#include "cinder/Timer.h"
 
 #include "cinder/app/App.h"
 
 #include "glm/gtc/noise.hpp"
 
-#include "PoissonDiskDistribution.h"
+#include "CounterRng.h"
+#include "PoissonDisk.h"
 #include "Triangulation.h"
 
+#include <limits>
+
 using namespace std;
 using namespace ci;
 
@@ -51,6 +54,26 @@ using namespace ci;
 // MARK: rendering, fbo and shader utils
 namespace {
 	
+	//! uniform buffer binding point of the Atmosphere block of Fog.glsl
+	const GLuint sAtmosphereBinding = 0;
+	
+	//! the render queue layers, drawn in this order
+	const uint8_t sTerrainLayer		= 0;
+	const uint8_t sTreesLayer		= 1;
+	const uint8_t sImpostorsLayer	= 2;
+	const uint8_t sSkyLayer			= 3;
+	
+	//! the parts of a tile hidden by the occlusion culling pass
+	const uint8_t sTerrainOccluded		= 1;
+	const uint8_t sPopulationOccluded	= 2;
+	
+	//! the number of cells per side of the software occlusion occluders grid
+	const int sOccluderGridSize = 64;
+	
+	//! the height of the eye above the road and the length of the road segments sharing a visible set
+	const float sPvsEyeHeight	= 4.0f;
+	const float sPvsInterval	= 16.0f;
+	
 	gl::Texture2dRef blitFromFbo( const gl::FboRef &fbo, const gl::Texture2d::Format &texFormat )
 	{
 		// create a new texture and a temporary fbo
@@ -159,9 +182,161 @@ namespace {
 		return loadShader( name, name, format );
 	}
 	
+	//! reports the vertex cache optimization results of a population model
+	void logModelOptimization( const string &model, const MeshOptimizer::Stats &stats )
+	{
+		CI_LOG_V( model << " " << stats.mNumTriangles << " triangles, ACMR " << stats.mAcmrBefore << " -> " << stats.mAcmrAfter );
+	}
+	
+	//! builds a grid of \a gridSize x \a gridSize cells lying under the terrain of \a heights. each vertex takes
+	//! the lowest height of the cells around it so the grid never rises above the terrain, anything it hides
+	//! from a camera above the terrain is hidden by the terrain too
+	void buildOccluderGrid( const Channel32fRef &heights, int gridSize, vector<vec3> *positions, vector<uint32_t> *indices )
+	{
+		// the lowest height of each cell, a pixel wider on every side. the
+		// channel comes from an 8 bits texture so lower them by a step too
+		ivec2 size		= heights->getSize();
+		vec2 cellSize	= vec2( size - ivec2( 1 ) ) / (float) gridSize;
+		vector<float> cellHeights( gridSize * gridSize );
+		for( int y = 0; y < gridSize; ++y ){
+			for( int x = 0; x < gridSize; ++x ){
+				ivec2 ul		= glm::max( ivec2( vec2( x, y ) * cellSize ) - ivec2( 1 ), ivec2( 0 ) );
+				ivec2 lr		= glm::min( ivec2( glm::ceil( vec2( x + 1, y + 1 ) * cellSize ) ) + ivec2( 1 ), size - ivec2( 1 ) );
+				float lowest	= numeric_limits<float>::max();
+				for( int py = ul.y; py <= lr.y; ++py ){
+					for( int px = ul.x; px <= lr.x; ++px ){
+						lowest = std::min( lowest, heights->getValue( ivec2( px, py ) ) );
+					}
+				}
+				cellHeights[y * gridSize + x] = lowest - 1.0f / 255.0f;
+			}
+		}
+		
+		// the vertices take the lowest of their cells
+		positions->resize( ( gridSize + 1 ) * ( gridSize + 1 ) );
+		for( int y = 0; y <= gridSize; ++y ){
+			for( int x = 0; x <= gridSize; ++x ){
+				float lowest = numeric_limits<float>::max();
+				for( int cy = std::max( y - 1, 0 ); cy <= std::min( y, gridSize - 1 ); ++cy ){
+					for( int cx = std::max( x - 1, 0 ); cx <= std::min( x, gridSize - 1 ); ++cx ){
+						lowest = std::min( lowest, cellHeights[cy * gridSize + cx] );
+					}
+				}
+				(*positions)[y * ( gridSize + 1 ) + x] = vec3( x * cellSize.x, lowest, y * cellSize.y );
+			}
+		}
+		
+		// and two triangles per cell
+		indices->clear();
+		indices->reserve( gridSize * gridSize * 6 );
+		for( int y = 0; y < gridSize; ++y ){
+			for( int x = 0; x < gridSize; ++x ){
+				uint32_t i = y * ( gridSize + 1 ) + x;
+				indices->insert( indices->end(), { i, i + gridSize + 1, i + 1, i + 1, i + gridSize + 1, i + gridSize + 2 } );
+			}
+		}
+	}
+	
 } // anonymous namespace
 
 
+// MARK: Tiles borders
+namespace {
+	
+	// spacing range of the terrain mesh samples
+	const float sMeshMinDistance = 0.75f;
+	const float sMeshMaxDistance = 45.0f;
+	
+	//! returns the area covered by a tile
+	Area getTileArea( size_t tileId, size_t numTilesPerRow, const vec2 &tileSize, const Area &area )
+	{
+		vec2 pos		= vec2( tileId % numTilesPerRow, tileId / numTilesPerRow );
+		vec2 ul			= pos * ceil( tileSize );
+		vec2 lr			= pos * ceil( tileSize ) + ceil( tileSize );
+		Area tileArea	= Area( ul, lr );
+		tileArea.clipBy( area );
+		return tileArea;
+	}
+	
+	//! samples an edge from \a a to \a b with the same spacing as the interior poisson distribution. \a a and \a b are excluded
+	vector<vec2> sampleEdge( const vec2 &a, const vec2 &b, const Channel32fRef &densityMap, const Area &area )
+	{
+		vector<vec2> samples;
+		float length	= glm::distance( a, b );
+		vec2 dir		= ( b - a ) / length;
+		float t			= 0.0f;
+		while( t < length ){
+			vec2 p			= glm::clamp( a + dir * t, vec2( area.getUL() ), vec2( area.getLR() - ivec2( 1 ) ) );
+			float s			= densityMap->getValue( p );
+			float spacing	= glm::clamp( sMeshMaxDistance - s * sMeshMaxDistance, sMeshMinDistance, sMeshMaxDistance );
+			t += spacing;
+			
+			// stop before getting too close to the end of the edge
+			if( t > length - spacing * 0.5f )
+				break;
+			samples.push_back( a + dir * t );
+		}
+		return samples;
+	}
+	
+	//! returns the border samples of each tile. each edge is only sampled once and handed to both of its tiles
+	vector<vector<vec2>> sampleTilesBorders( size_t numTilesPerRow, const vec2 &tileSize, const Area &area, const Channel32fRef &densityMap )
+	{
+		// sample each horizontal and vertical edge of the grid, without its end points
+		size_t numEdges = numTilesPerRow * ( numTilesPerRow + 1 );
+		vector<vector<vec2>> horizontalEdges( numEdges ), verticalEdges( numEdges );
+		for( size_t i = 0; i < numTilesPerRow * numTilesPerRow; ++i ){
+			size_t x = i % numTilesPerRow, y = i / numTilesPerRow;
+			Area tileArea = getTileArea( i, numTilesPerRow, tileSize, area );
+			vec2 ul = tileArea.getUL(), lr = tileArea.getLR();
+			horizontalEdges[y * numTilesPerRow + x]			= sampleEdge( ul, vec2( lr.x, ul.y ), densityMap, area );
+			verticalEdges[x * numTilesPerRow + y]			= sampleEdge( ul, vec2( ul.x, lr.y ), densityMap, area );
+			if( y == numTilesPerRow - 1 )
+				horizontalEdges[( y + 1 ) * numTilesPerRow + x]	= sampleEdge( vec2( ul.x, lr.y ), lr, densityMap, area );
+			if( x == numTilesPerRow - 1 )
+				verticalEdges[( x + 1 ) * numTilesPerRow + y]	= sampleEdge( vec2( lr.x, ul.y ), lr, densityMap, area );
+		}
+		
+		// gather the four edges and the four corners of each tile
+		vector<vector<vec2>> borders( numTilesPerRow * numTilesPerRow );
+		for( size_t i = 0; i < borders.size(); ++i ){
+			size_t x = i % numTilesPerRow, y = i / numTilesPerRow;
+			Area tileArea = getTileArea( i, numTilesPerRow, tileSize, area );
+			vec2 ul = tileArea.getUL(), lr = tileArea.getLR();
+			auto &border = borders[i];
+			border = { ul, vec2( lr.x, ul.y ), vec2( ul.x, lr.y ), lr };
+			const vector<vec2>* edges[4] = { &horizontalEdges[y * numTilesPerRow + x], &horizontalEdges[( y + 1 ) * numTilesPerRow + x], &verticalEdges[x * numTilesPerRow + y], &verticalEdges[( x + 1 ) * numTilesPerRow + y] };
+			for( auto edge : edges ){
+				border.insert( border.end(), edge->begin(), edge->end() );
+			}
+		}
+		return borders;
+	}
+	
+	//! returns the ids of a grid of tiles in z-order, the tiles under any node of the culling quadtree follow each other
+	vector<uint32_t> getTilesMortonOrder( size_t numTilesPerRow )
+	{
+		vector<pair<uint32_t, uint32_t>> keys;
+		for( uint32_t y = 0; y < numTilesPerRow; ++y ){
+			for( uint32_t x = 0; x < numTilesPerRow; ++x ){
+				uint32_t key = 0;
+				for( uint32_t b = 0; b < 16; ++b ){
+					key |= ( ( x >> b ) & 1 ) << ( 2 * b ) | ( ( y >> b ) & 1 ) << ( 2 * b + 1 );
+				}
+				keys.push_back( { key, y * (uint32_t) numTilesPerRow + x } );
+			}
+		}
+		sort( keys.begin(), keys.end() );
+		
+		vector<uint32_t> ids;
+		for( const auto &key : keys ){
+			ids.push_back( key.second );
+		}
+		return ids;
+	}
+	
+} // anonymous namespace
+
 // MARK: Terrain
 TerrainRef Terrain::create( const Format &format )
 {
@@ -180,6 +355,8 @@ mBlurIterations( format.getBlurIterations() ),
 mSobelBlurIterations( format.getSobelBlurIterations() ),
 mNumTilesPerRow( format.getNumTilesPerRow() ),
 mNumWorkingThreads( format.getNumWorkingThreads() ),
+mTileMemoryPolicy( format.getTileMemoryPolicy() ),
+mPopulationMode( format.getPopulationMode() ),
 mFogDensity( 0.129 ),
 mFogColor( 0.25, 0.29, 0.47 ),
 mSunColor( 1.0f, 0.77, 0.60 ),
@@ -188,6 +365,13 @@ mSunDispertion( 0.3f ),
 mSunIntensity( 0.166 ),
 mSunDirection( 0, 0.3, -1 ),
 mOcclusionCullingEnabled( true ),
+mOcclusionMode( OcclusionMode::GPU_QUERIES ),
+mPvsDirty( true ),
+mPvsEnabled( true ),
+mTilesBoundsDirty( false ),
+mAtmosphereDirty( true ),
+mImpostorDistances( 180.0f, 240.0f ),
+mPopulationDecimation( 0.35f, 0.3f ),
 mTileExplosionSize( 0.001 ),
 mTilePopulationExplosionSize( 0.001f ),
 mBuildingTiles( false ),
@@ -212,6 +396,30 @@ mHeightMapProgression( 0.0f )
 #else
 		mTileContentShader = loadShader( "Trees" );
 #endif
+		mTileInstancedContentShader = loadShader( "InstancedTrees", "Trees" );
+#ifndef HIGH_QUALITY_ANIMATIONS
+		mTileImpostorShader = loadShader( "Impostor" );
+#endif
+		mOcclusionShader = loadShader( "OcclusionBox" );
+	
+	// resolve the uniforms set every frame once
+	mTileUniforms					= TileUniforms( mTileShader );
+	mTileContentUniforms			= TileUniforms( mTileContentShader );
+	mTileInstancedContentUniforms	= TileUniforms( mTileInstancedContentShader );
+	mTileImpostorUniforms			= TileUniforms( mTileImpostorShader );
+	mSkyNoiseLookupTable			= UniformHandle<int>( mSkyShader, "uNoiseLookupTable" );
+	
+#ifndef HIGH_QUALITY_ANIMATIONS
+	// the tiles meshes share the same buffers and are drawn together
+	mTileMeshArena = MeshArena::create( mTileShader );
+#endif
+	
+	// the shaders including Fog.glsl read the atmosphere from the same uniform buffer
+	mAtmosphereUbo = gl::Ubo::create( sizeof( AtmosphereBlock ), nullptr, GL_DYNAMIC_DRAW );
+	auto shadersWithFog = { mTileShader, mTileContentShader, mTileInstancedContentShader, mTileImpostorShader, mSkyShader };
+	for( const auto &shader : shadersWithFog ){
+		if( shader ) shader->uniformBlock( "Atmosphere", sAtmosphereBinding );
+	}
 	
 	// create the noise lookup table
 	Perlin p( 6, mNoiseSeed );
@@ -234,6 +442,9 @@ mHeightMapProgression( 0.0f )
 	// setup the skybox mesh
 	auto sphereMesh	= gl::VboMesh::create( geom::Sphere().radius( 7000 ) );
 	mSkyBatch		= gl::Batch::create( sphereMesh, mSkyShader );
+	
+	// and the geometry shared by the occlusion queries of every tile
+	buildOcclusionGeometry();
 
 	// add our timeline to the main app timeline
 	app::timeline().add( mTimeline );
@@ -241,35 +452,33 @@ mHeightMapProgression( 0.0f )
 	// load and prepare the base 3d models
 	auto models = { "Tree01", "Tree02", "Tree03", "PineTree01", "PineTree02", "PineTree03"/*, "Cube", "Crystal"*/ };
 	
-#ifdef HIGH_QUALITY_ANIMATIONS
-	for( auto model : models ){
-		// prepare trimesh
-		TriMesh mesh( TriMesh::Format().positions().texCoords0().texCoords1(4) );
-		// load the model
-		mesh.read( app::loadAsset( "Models/" + string( model ) + ".trimesh" ) );
-		// copy the triangle center and triangle id to the texcoords1 slot
-		const vector<uint32_t> indices = mesh.getIndices();
-		vec3* vertices = mesh.getPositions<3>();
-		vector<vec4> extras( mesh.getNumVertices(), vec4(0) );
-		for( size_t i = 0; i < indices.size(); i+=3 ){
-			float indice		= ( (float) indices[i] / 3.0f ) / (float) mesh.getNumTriangles();
-			vec3 center			= ( vertices[indices[i]] + vertices[indices[i+1]] + vertices[indices[i+2]] ) / 3.0f;
-			extras[indices[i]]	= vec4( center, indice );
-			extras[indices[i+1]]	= vec4( center, indice );
-			extras[indices[i+2]]	= vec4( center, indice );
-		}
-		mesh.appendTexCoords1( &extras[0], extras.size() );
-		mPopulationMeshes.push_back( mesh );
-	}
-#else
 	for( auto model : models ){
 		// prepare trimesh
 		TriMesh mesh( TriMesh::Format().positions().texCoords0().texCoords1(4) );
 		// load the model
 		mesh.read( app::loadAsset( "Models/" + string( model ) + ".trimesh" ) );
+		// optimize the model once so every baked instance shares the cache friendly order
+		logModelOptimization( model, MeshOptimizer::optimize( &mesh ) );
+#ifdef HIGH_QUALITY_ANIMATIONS
+		// keep the triangles centers and ids next to the indexed model
+		mPopulationTriangles.push_back( PackedMesh::getTrianglesCenters( mesh ) );
+#endif
 		mPopulationMeshes.push_back( mesh );
+		// keep a structure of arrays copy of the positions for the baking kernel
+		mPopulationPositions.push_back( VertexTransform::Positions( mesh.getPositions<3>(), mesh.getNumVertices() ) );
+		// and upload it once for the instanced population mode
+		mPopulationModels.push_back( InstancedPopulation::Model::create( mesh ) );
 	}
+	
+	// render the models silhouettes once for the distant trees, the per-triangle
+	// animations of the high quality version can't be reproduced by the impostors
+#ifndef HIGH_QUALITY_ANIMATIONS
+	mImpostorAtlas = ImpostorAtlas::create( mPopulationMeshes );
+	CI_LOG_V( "Impostor atlas: " << mImpostorAtlas->getTexture()->getSize() << " " << mImpostorAtlas->getSize() / 1024 << "kb" );
 #endif
+	
+	// the population buffers are recycled between regenerations
+	mPopulationBufferPool = BufferPool::create();
 }
 
 void Terrain::start()
@@ -312,17 +521,37 @@ void Terrain::render( const CameraPersp &camera )
 	frustumCam.setNearClip( 0.1f );
 	frustumCam.setFov( camera.getFov() + 2 );
 
-	// use the new camera to create a Frustum
-	Frustumf frustum( camera );
+	// refit the quadtree only when the tiles or the elevation changed, the road visible sets are stale then
+	bool boundsChanged = mTilesBoundsDirty;
+	if( mTilesBoundsDirty ){
+		for( const auto &tile : mTiles ){
+			mTileQuadtree.setBounds( tile->getTileId(), tile->getBounds( getElevation() ) );
+		}
+		mTilesBoundsDirty	= false;
+		mPvsDirty			= true;
+		mRoadPvs			= RoadPvs();
+	}
 	
-	vector<Terrain::TileRef> tiles = mTiles;
+	// the cpu occluders and the road visible sets only match the tiles once they stopped moving
+	bool tilesSettled = ! mBuildingTiles && mHeightMapProgression >= 1.0f;
+	for( const auto &tile : mTiles ){
+		tilesSettled = tilesSettled && tile->mTerrainCompletion >= 1.0f;
+	}
+	updatePvs( tilesSettled, boundsChanged );
 	
-	// start by removing every tiles that are not in the frustum
-	auto frutumRange = std::remove_if( tiles.begin(), tiles.end(), [&frustum,this]( const Terrain::TileRef &tile ){
-		bool outsideFrustum = !frustum.intersects( tile->getBounds( getElevation() ) );
-		return outsideFrustum;
-	});
-	tiles.erase( frutumRange, tiles.end() );
+	// the precomputed sets replace the other occlusion tests while the eye is on the road
+	vec3 eye		= camera.getEyePoint();
+	int pvsSegment	= mOcclusionCullingEnabled && mPvsEnabled && tilesSettled && ! mRoadPvs.isEmpty() ? mRoadPvs.findSegment( eye ) : -1;
+	
+	// the render lists only live for this frame
+	mFrameAllocator.reset();
+	
+	// let the population buffers left over by a burst of regenerations go
+	mPopulationBufferPool->trim();
+	
+	// start by keeping only the tiles in the frustum of the new camera
+	size_t* visibleTileIds	= mFrameAllocator.allocate<size_t>( mTileQuadtree.getNumTiles() );
+	size_t numVisibleTiles	= mTileQuadtree.cull( frustumCam.getProjectionMatrix() * frustumCam.getViewMatrix(), visibleTileIds );
 	
 	// then tiles that are too far away to be seen
 	/*auto frutumFarRange = std::remove_if( tiles.begin(), tiles.end(), [&camera,&wtf]( const Terrain::TileRef &tile ){
@@ -333,119 +562,280 @@ void Terrain::render( const CameraPersp &camera )
 	tiles.erase( frutumFarRange, tiles.end() );
 	*/
 
-	// and finally, sort the remaining tiles from front to back
-	std::sort( tiles.begin(), tiles.end(), [&camera,this]( const Terrain::TileRef &lhs, const Terrain::TileRef &rhs ) {
-		return camera.worldToEyeDepth( lhs->getBounds( getElevation() ).getCenter() ) < camera.worldToEyeDepth( rhs->getBounds( getElevation() ).getCenter() );
-	} );
+	// and finally, sort the remaining tiles by eye depth. the keys are computed once per tile from the
+	// cached bounds: the depth in the high bits, then the kind of population and the tile id
+	RenderList<Tile> tiles( &mFrameAllocator, numVisibleTiles );
+	for( size_t i = 0; i < numVisibleTiles; ++i ){
+		Tile* tile = mTilesById[visibleTileIds[i]].get();
+		if( ! tile || ( pvsSegment >= 0 && ! mRoadPvs.isTerrainVisible( pvsSegment, tile->getTileId() ) && ! mRoadPvs.isPopulationVisible( pvsSegment, tile->getTileId() ) ) )
+			continue;
+		
+		float depth				= camera.worldToEyeDepth( mTileQuadtree.getBounds( tile->getTileId() ).getCenter() );
+		uint64_t population		= tile->mPopulation[tile->mPopulationCurrent] ? 1 : ( tile->mInstancedPopulation[tile->mPopulationCurrent] ? 2 : 0 );
+		tiles.push( (uint64_t) RenderList<Tile>::getOrderedBits( depth ) << 32 | population << 30 | tile->getTileId(), tile );
+	}
+	tiles.sort();
+	
+	// MARK: Occlusion tests
+	// flag the parts of the visible tiles hidden by the occlusion culling. the gpu queries come from the previous
+	// frames, the software occlusion rasterizes the terrain seen from this camera and tests this frame's bounds
+	uint8_t* occluded = mFrameAllocator.allocate<uint8_t>( mTileQuadtree.getNumTiles() );
+	std::fill( occluded, occluded + mTileQuadtree.getNumTiles(), 0 );
+	if( pvsSegment >= 0 ){
+		for( auto tile : tiles ){
+			uint8_t &flags = occluded[tile->getTileId()];
+			flags |= mRoadPvs.isTerrainVisible( pvsSegment, tile->getTileId() ) ? 0 : sTerrainOccluded;
+			flags |= mRoadPvs.isPopulationVisible( pvsSegment, tile->getTileId() ) ? 0 : sPopulationOccluded;
+			// the queries are paused on the road, they would be stale once the eye leaves it
+			if( mOcclusionMode == OcclusionMode::GPU_QUERIES ){
+				tile->resetOccludedFrameCount();
+			}
+		}
+	}
+	else if( mOcclusionCullingEnabled && mOcclusionMode == OcclusionMode::GPU_QUERIES ){
+		for( auto tile : tiles ){
+			occluded[tile->getTileId()] = tile->isOccluded() ? sTerrainOccluded | sPopulationOccluded : 0;
+		}
+	}
+	else if( mOcclusionCullingEnabled ){
+		if( tilesSettled && mOcclusionMode == OcclusionMode::SOFTWARE && mSoftwareOcclusion && mSoftwareOcclusion->hasOccluders() ){
+			mSoftwareOcclusion->render( camera.getProjectionMatrix() * camera.getViewMatrix(), glm::scale( mat4( 1.0f ), vec3( 1.0f, getElevation(), 1.0f ) ) );
+			for( auto tile : tiles ){
+				// the terrain and the trees of a tile are tested separately, the trees stand above it
+				uint8_t &flags = occluded[tile->getTileId()];
+				if( mSoftwareOcclusion->isOccluded( tile->getTerrainBounds( getElevation() ) ) ){
+					flags |= sTerrainOccluded;
+				}
+				bool populationOccluded = true;
+				for( size_t i = 0; i < 2 && populationOccluded; ++i ){
+					if( tile->mPopulation[i] || tile->mInstancedPopulation[i] || tile->mImpostorPopulation[i] ){
+						populationOccluded = mSoftwareOcclusion->isOccluded( tile->getPopulationBounds( i, getElevation() ) );
+					}
+				}
+				if( populationOccluded ){
+					flags |= sPopulationOccluded;
+				}
+			}
+		}
+		else if( tilesSettled && mOcclusionMode == OcclusionMode::HORIZON ){
+			// every tile occludes, only the visible ones and their trees are tested. the
+			// bounds of the trees are the ones of the terrain when there are none
+			mHorizonCuller.clear();
+			for( const auto &tile : mTiles ){
+				mHorizonCuller.addOccluder( tile->getTerrainBounds( getElevation() ) );
+			}
+			for( auto tile : tiles ){
+				mHorizonCuller.addBounds( tile->getTerrainBounds( getElevation() ) );
+				mHorizonCuller.addBounds( tile->getPopulationBounds( getElevation() ) );
+			}
+			mHorizonCuller.cull( camera.getEyePoint() );
+			
+			size_t index = 0;
+			for( auto tile : tiles ){
+				uint8_t &flags = occluded[tile->getTileId()];
+				flags |= mHorizonCuller.isOccluded( index++ ) ? sTerrainOccluded : 0;
+				flags |= mHorizonCuller.isOccluded( index++ ) ? sPopulationOccluded : 0;
+			}
+		}
+	}
 
 	// MARK: Update uniforms
 	
-	// update shaders that needs fog uniform data
-	vec3 sun = normalize( vec3( camera.getViewMatrix() * vec4( mSunDirection,0 ) ) );
-	auto shadersWithFog = { mTileShader, mTileContentShader, mSkyShader/*, mClearingObjectsShader*/ };
-	for( const auto &shader : shadersWithFog ){
-		gl::ScopedGlslProg scopedShader( shader );
-		shader->uniform( "uInscatteringCoeffs", mSunScatteringCoeffs );
-		shader->uniform( "uSunDispertion", mSunDispertion );
-		shader->uniform( "uSunIntensity", mSunIntensity );
-		shader->uniform( "uFogColor", mFogColor );
-		shader->uniform( "uFogDensity", mFogDensity );
-		shader->uniform( "uSunColor", mSunColor );
-		shader->uniform( "uSunDirection", sun );
-	}
+	// update the uniform block shared by the shaders that needs fog data
+	updateAtmosphere( camera );
 
 #ifdef HIGH_QUALITY_ANIMATIONS
-	mTileShader->uniform( "uTime", (float) cinder::app::getElapsedSeconds() );
-	mTileShader->uniform( "uTouch", mTileExplosionCenter );
-	mTileShader->uniform( "uTouchSize", mTileExplosionSize );
-	mTileContentShader->uniform( "uTime", (float) cinder::app::getElapsedSeconds() );
-	mTileContentShader->uniform( "uTouch", mTilePopulationExplosionCenter );
-	mTileContentShader->uniform( "uTouchSize", mTilePopulationExplosionSize );
+	mTileUniforms.mTime.set( (float) cinder::app::getElapsedSeconds() );
+	mTileUniforms.mTouch.set( mTileExplosionCenter );
+	mTileUniforms.mTouchSize.set( mTileExplosionSize );
+	mTileContentUniforms.mTime.set( (float) cinder::app::getElapsedSeconds() );
+	mTileContentUniforms.mTouch.set( mTilePopulationExplosionCenter );
+	mTileContentUniforms.mTouchSize.set( mTilePopulationExplosionSize );
 #endif
 
 	// enable backface culling, disable blending and enable depth testing
 	gl::ScopedFaceCulling cullBackFaces( true, GL_BACK );
 	gl::ScopedBlend disableBlending( false );
 	gl::ScopedDepth scopedDepth( true );
+	gl::color( ColorA::black() );
+	
+	// the passes below only queue their draws, the queue sorts them by state before drawing.
+	// the terrain, the populations and the impostors take at most five items per tile
+	RenderQueue queue( &mFrameAllocator, tiles.size() * 5 + 2 );
 	
 	// MARK: Render terrain tiles
 	// render tiles
 	if( mTileShader && mHeightMap[0] && mFloraDensityMap ){
-		gl::ScopedGlslProg scopedShader( mTileShader );
-		gl::ScopedModelMatrix scopedModelMatrix;
-		gl::ScopedTextureBind scopedTexture0( mHeightMap[0], 0 );
-		gl::ScopedTextureBind scopedTexture1( mHeightMap[1] ? mHeightMap[1] : mHeightMap[0], 1 );
-		gl::ScopedTextureBind scopedTexture2( mFloraDensityMap, 2 );
-#ifdef HIGH_QUALITY_ANIMATIONS
-		gl::ScopedTextureBind scopedTexture3( mNoiseLookupTable, 3 );
-		mTileShader->uniform( "uNoiseLookupTable", 3 );
-#endif
-		mTileShader->uniform( "uHeightMap", 0 );
-		mTileShader->uniform( "uHeightMapTemp", 1 );
-		mTileShader->uniform( "uFlora", 2 );
-		mTileShader->uniform( "uElevation", getElevation() );
-		mTileShader->uniform( "uHeightMapProgression", mHeightMapProgression );
+		RenderQueue::Item tilesState = RenderQueue::Item().texture( 0, mHeightMap[0].get() ).texture( 1, mHeightMap[1] ? mHeightMap[1].get() : mHeightMap[0].get() ).texture( 2, mFloraDensityMap.get() );
+		mTileUniforms.mHeightMap.set( 0 );
+		mTileUniforms.mHeightMapTemp.set( 1 );
+		mTileUniforms.mFlora.set( 2 );
+		mTileUniforms.mElevation.set( getElevation() );
+		mTileUniforms.mHeightMapProgression.set( mHeightMapProgression );
+		
+#ifndef HIGH_QUALITY_ANIMATIONS
+		// the visible tiles are drawn from the arena in as many calls as
+		// there are runs of adjacent meshes, the per tile data is fetched
+		// by the shader from the params texture
+		updateTileParams();
+		mTileUniforms.mTileParams.set( 3 );
+		
+		uint32_t* tileIds	= mFrameAllocator.allocate<uint32_t>( tiles.size() );
+		size_t numTileIds	= 0;
+		for( auto tile : tiles ){
+			if( ! ( occluded[tile->getTileId()] & sTerrainOccluded ) ){
+				tileIds[numTileIds++] = tile->getTileId();
+			}
+		}
 		
-		gl::color( ColorA::black() );
+		auto drawTiles = []( void *context, const RenderQueue::Item &item ){
+			static_cast<Terrain*>( context )->mTileMeshArena->draw( static_cast<const uint32_t*>( item.mObject ), item.mIndex );
+		};
+		queue.push( sTerrainLayer, 0.0f, RenderQueue::Item( tilesState ).program( mTileShader.get(), drawTiles, this ).texture( 3, mTileParamsTexture.get() ).vao( mTileMeshArena.get() ).object( tileIds, numTileIds ) );
+#else
+		mTileUniforms.mNoiseLookupTable.set( 3 );
+		
+		auto drawTile = []( void *context, const RenderQueue::Item &item ){
+			auto terrain	= static_cast<Terrain*>( context );
+			auto tile		= static_cast<const Tile*>( item.mObject );
+			
+			// update tile animation and position decoding uniforms
+			terrain->mTileUniforms.mProgress.set( tile->mTerrainCompletion );
+			terrain->mTileUniforms.mPositionScale.set( tile->mMesh->getPositionScale() );
+			terrain->mTileUniforms.mPositionOffset.set( tile->mMesh->getPositionOffset() );
+			tile->mMesh->draw();
+		};
+		tilesState.program( mTileShader.get(), drawTile, this ).texture( 3, mNoiseLookupTable.get() );
 		for( auto tile : tiles ){
-			if( !mOcclusionCullingEnabled || !tile->isOccluded() ){
-				if( tile->mBatch ){
-					
-					// update tile animation uniforms
-					mTileShader->uniform( "uProgress", tile->mTerrainCompletion );
-
-					// as we have created this batch with a dummy shader
-					// makes sure we have the right one
-					if( tile->mBatch->getGlslProg() != mTileShader ) {
-						tile->mBatch->replaceGlslProg( mTileShader );
-					}
-
-					// render the batch
-					tile->mBatch->draw();
-				}
+			if( ! ( occluded[tile->getTileId()] & sTerrainOccluded ) && tile->mMesh ){
+				float distance = glm::distance( eye, mTileQuadtree.getBounds( tile->getTileId() ).getCenter() );
+				queue.push( sTerrainLayer, distance, RenderQueue::Item( tilesState ).vao( tile->mMesh.get() ).object( tile ) );
 			}
 		}
+#endif
 	}
 
 	// MARK: Render trees tiles
 	// render tile content
+	mNumRenderedInstanced = 0;
 	if( mTileContentShader && mTrianglesHeightMap[0] ){
-		gl::ScopedGlslProg scopedShader( mTileContentShader );
-		gl::ScopedTextureBind scopedTexture0( mTrianglesHeightMap[0], 0 );
-		gl::ScopedTextureBind scopedTexture1( mTrianglesHeightMap[1] ? mTrianglesHeightMap[1] : mTrianglesHeightMap[0], 1 );
+		RenderQueue::Item treesState = RenderQueue::Item().texture( 0, mTrianglesHeightMap[0].get() ).texture( 1, mTrianglesHeightMap[1] ? mTrianglesHeightMap[1].get() : mTrianglesHeightMap[0].get() );
 #ifdef HIGH_QUALITY_ANIMATIONS
-		gl::ScopedTextureBind scopedTexture2( mNoiseLookupTable, 2 );
-		mTileContentShader->uniform( "uNoiseLookupTable", 2 );
+		treesState.texture( 2, mNoiseLookupTable.get() );
+		mTileContentUniforms.mNoiseLookupTable.set( 2 );
 #endif
 		
-		mTileContentShader->uniform( "uHeightMap", 0 );
-		mTileContentShader->uniform( "uHeightMapTemp", 1 );
-		mTileContentShader->uniform( "uHeightMapSize", mSize );
-		mTileContentShader->uniform( "uHeightMapProgression", mHeightMapProgression );
-		mTileContentShader->uniform( "uElevation", getElevation() );
-		
-		mNumRenderedInstanced = 0;
-		gl::color( ColorA::black() );
+		// the trees fade to their impostors between those distances, push
+		// them beyond the terrain when there are no impostors to fade to
+		vec2 impostorDistances = mImpostorAtlas ? mImpostorDistances : vec2( 100000.0f, 100001.0f );
+		
+		// the baked and instanced populations share the same uniforms
+		mTileContentUniforms.mHeightMap.set( 0 );
+		mTileContentUniforms.mHeightMapTemp.set( 1 );
+		mTileContentUniforms.mHeightMapSize.set( mSize );
+		mTileContentUniforms.mHeightMapProgression.set( mHeightMapProgression );
+		mTileContentUniforms.mElevation.set( getElevation() );
+#ifndef HIGH_QUALITY_ANIMATIONS
+		mTileContentUniforms.mImpostorDistances.set( impostorDistances );
+#endif
+		mTileInstancedContentUniforms.mHeightMap.set( 0 );
+		mTileInstancedContentUniforms.mHeightMapTemp.set( 1 );
+		mTileInstancedContentUniforms.mHeightMapSize.set( mSize );
+		mTileInstancedContentUniforms.mHeightMapProgression.set( mHeightMapProgression );
+		mTileInstancedContentUniforms.mElevation.set( getElevation() );
+		mTileInstancedContentUniforms.mImpostorDistances.set( impostorDistances );
+		
+		// returns the distances from the eye to the closest and farthest points of a tile
+		auto getTileDistances = [&eye,this]( const Tile *tile ){
+			auto bounds		= tile->getBounds( getElevation() );
+			vec3 closest	= glm::clamp( eye, bounds.getMin(), bounds.getMax() );
+			vec3 farthest	= glm::max( glm::abs( eye - bounds.getMin() ), glm::abs( eye - bounds.getMax() ) );
+			return vec2( glm::distance( eye, closest ), glm::length( farthest ) );
+		};
+		
+		// returns the fraction of the population drawn for a tile, thinned out when it covers a small part of the screen.
+		// a projected size of 0 disables the decimation
+		float tanHalfFov = tan( toRadians( camera.getFov() ) * 0.5f );
+		auto getTileDensity = [&eye,tanHalfFov,this]( const Tile *tile ){
+			if( mPopulationDecimation.x <= 0.0f )
+				return 1.0f;
+			
+			auto bounds			= tile->getBounds( getElevation() );
+			float projectedSize	= glm::length( bounds.getSize() ) / ( glm::max( glm::distance( eye, bounds.getCenter() ), 0.001f ) * 2.0f * tanHalfFov );
+			return glm::mix( mPopulationDecimation.y, 1.0f, glm::clamp( projectedSize / mPopulationDecimation.x, 0.0f, 1.0f ) );
+		};
+		
+		// the population slot is the item index and the density its value
+		auto drawPopulation = []( void *context, const RenderQueue::Item &item ){
+			auto terrain	= static_cast<Terrain*>( context );
+			auto tile		= static_cast<const Tile*>( item.mObject );
+			const auto &population = tile->mPopulation[item.mIndex];
+			
+			// update tile animation and position decoding uniforms
+			terrain->mTileContentUniforms.mProgress.set( tile->mPopulationCompletion[item.mIndex] );
+			terrain->mTileContentUniforms.mPositionScale.set( population->getPositionScale() );
+			terrain->mTileContentUniforms.mPositionOffset.set( population->getPositionOffset() );
+			population->draw( tile->getPopulationNumIndices( item.mIndex, item.mValue ) );
+		};
+		auto drawInstancedPopulation = []( void *context, const RenderQueue::Item &item ){
+			auto terrain	= static_cast<Terrain*>( context );
+			auto tile		= static_cast<const Tile*>( item.mObject );
+			
+			// update tile animation and render one instanced draw call per model
+			terrain->mTileInstancedContentUniforms.mProgress.set( tile->mPopulationCompletion[item.mIndex] );
+			tile->mInstancedPopulation[item.mIndex]->draw( item.mValue );
+		};
+		auto drawImpostors = []( void *context, const RenderQueue::Item &item ){
+			auto terrain	= static_cast<Terrain*>( context );
+			auto tile		= static_cast<const Tile*>( item.mObject );
+			
+			// one instanced draw call for every impostors of the tile
+			terrain->mTileImpostorUniforms.mProgress.set( tile->mPopulationCompletion[item.mIndex] );
+			tile->mImpostorPopulation[item.mIndex]->draw( item.mValue );
+		};
+		
+		// MARK: Render trees impostors
+		// and the impostors of the tiles far enough to need them
+		bool drawsImpostors = mTileImpostorShader && mImpostorAtlas;
+		RenderQueue::Item impostorsState = RenderQueue::Item( treesState ).program( mTileImpostorShader.get(), drawImpostors, this );
+		if( drawsImpostors ){
+			impostorsState.texture( 3, mImpostorAtlas->getTexture().get() );
+			mTileImpostorUniforms.mImpostorAtlas.set( 3 );
+			mTileImpostorUniforms.mImpostorGridSize.set( mImpostorAtlas->getGridSize() );
+			mTileImpostorUniforms.mImpostorExtents.set( mImpostorAtlas->getExtents().data(), (int) mImpostorAtlas->getExtents().size() );
+			mTileImpostorUniforms.mImpostorDistances.set( impostorDistances );
+			mTileImpostorUniforms.mEyePosition.set( eye );
+			mTileImpostorUniforms.mHeightMap.set( 0 );
+			mTileImpostorUniforms.mHeightMapTemp.set( 1 );
+			mTileImpostorUniforms.mHeightMapSize.set( mSize );
+			mTileImpostorUniforms.mHeightMapProgression.set( mHeightMapProgression );
+			mTileImpostorUniforms.mElevation.set( getElevation() );
+		}
 		
 		for( auto tile : tiles ){
-			if( !mOcclusionCullingEnabled || !tile->isOccluded() ){
-				for( size_t i = 0; i < 2; ++i ){
-					if( tile->mPopulation[i] ){
-						
-						// update tile animation uniforms
-						mTileContentShader->uniform( "uProgress", tile->mPopulationCompletion[i] );
-						
-						// as we have created this batch with a dummy shader
-						// we need to make sure we have the right shader
-						if( tile->mPopulation[i]->getGlslProg() != mTileContentShader )
-							tile->mPopulation[i]->replaceGlslProg( mTileContentShader );
-						
-						// render the batch
-						tile->mPopulation[i]->draw();
-						
+			if( occluded[tile->getTileId()] & sPopulationOccluded )
+				continue;
+			
+			vec2 distances	= getTileDistances( tile );
+			float density	= getTileDensity( tile );
+			for( size_t i = 0; i < 2; ++i ){
+				// skip the models of the tiles entirely replaced by their impostors
+				bool replaced = tile->mImpostorPopulation[i] && distances.x >= impostorDistances.y;
+				if( ! replaced && tile->mPopulation[i] ){
+					// the baked populations thinned out to nothing have nothing to draw
+					if( tile->getPopulationNumIndices( i, density ) > 0 ){
+						queue.push( sTreesLayer, distances.x, RenderQueue::Item( treesState ).program( mTileContentShader.get(), drawPopulation, this ).vao( tile->mPopulation[i].get() ).object( tile, i, density ) );
 						mNumRenderedInstanced++;
 					}
 				}
+				else if( ! replaced && tile->mInstancedPopulation[i] ){
+					queue.push( sTreesLayer, distances.x, RenderQueue::Item( treesState ).program( mTileInstancedContentShader.get(), drawInstancedPopulation, this ).vao( tile->mInstancedPopulation[i].get() ).object( tile, i, density ) );
+					mNumRenderedInstanced += tile->mInstancedPopulation[i]->getNumInstances();
+				}
+				
+				if( drawsImpostors && tile->mImpostorPopulation[i] && distances.y > impostorDistances.x ){
+					queue.push( sImpostorsLayer, distances.x, RenderQueue::Item( impostorsState ).vao( tile->mImpostorPopulation[i].get() ).object( tile, i, density ) );
+				}
 			}
 		}
 	}
@@ -454,39 +844,45 @@ void Terrain::render( const CameraPersp &camera )
 	
 	// render skybox
 	if( mSkyShader ) {
-		// we are inside the sphere so enable frontface culling instead
-		gl::ScopedFaceCulling cullFrontFaces( true, GL_FRONT );
-		gl::color( ColorA::black() );
-		
-		if( mSkyBatch->getGlslProg() != mSkyShader )
-			mSkyBatch->replaceGlslProg( mSkyShader );
-		
-		gl::ScopedTextureBind scopedTexture2( mNoiseLookupTable, 0 );
-		mSkyShader->uniform( "uNoiseLookupTable", 0 );
-		mSkyShader->uniform( "uTime", (float) cinder::app::getElapsedSeconds() );
-		mSkyBatch->draw();
+		auto drawSky = []( void *context, const RenderQueue::Item &item ){
+			// we are inside the sphere so enable frontface culling instead
+			gl::ScopedFaceCulling cullFrontFaces( true, GL_FRONT );
+			static_cast<Terrain*>( context )->mSkyBatch->draw();
+		};
+		mSkyNoiseLookupTable.set( 0 );
+		queue.push( sSkyLayer, 0.0f, RenderQueue::Item( mSkyShader.get(), drawSky, this ).texture( 0, mNoiseLookupTable.get() ).vao( mSkyBatch.get() ) );
 	}
+	
+	// draw everything sorted by state
+	mRenderQueueStats = queue.submit();
 
 	// MARK: Occlusion culling
-	if( mOcclusionCullingEnabled ){
+	if( mOcclusionCullingEnabled && mOcclusionMode == OcclusionMode::GPU_QUERIES && pvsSegment < 0 && mOcclusionVao ){
 		
 		// we don't actually need to render anything here, we just need
 		// to do if any fragment pass the different tests, so disable everything.
 		gl::ScopedFaceCulling disableFaceCulling( false );
 		gl::colorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
 		gl::depthMask( GL_FALSE );
+		
+		// the program and the unit cube are bound once, every query then only
+		// stretches the cube over the box of its tile before drawing it
+		gl::ScopedGlslProg scopedShader( mOcclusionShader );
+		gl::ScopedVao scopedVao( mOcclusionVao );
+		gl::context()->setDefaultShaderVars();
 		for( auto tile : tiles ){
-			gl::ScopedModelMatrix modelMatrix;
-			
-			auto bounds			= tile->getBounds();
-			auto scaledBounds	= tile->getBounds( getElevation() );
-			auto center			= vec3( bounds.getCenter().x, scaledBounds.getCenter().y, bounds.getCenter().z );
-			auto scale			= vec3( 1.0f, scaledBounds.getSize().y, 1.0f );
+			// skip the tiles still waiting for the results of all their queries
+			GLuint query = tile->acquireOcclusionQuery();
+			if( ! query )
+				continue;
 			
-			gl::translate( center + tile->mPosition );
-			gl::scale( scale );
+			auto bounds = tile->getBounds( getElevation() );
+			mOcclusionBoxMin.set( bounds.getMin() + tile->mPosition );
+			mOcclusionBoxSize.set( bounds.getSize() );
 			
-			tile->checkOcclusion();
+			glBeginQuery( GL_ANY_SAMPLES_PASSED_CONSERVATIVE, query );
+			gl::drawElements( GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, (const GLvoid*) 0 );
+			glEndQuery( GL_ANY_SAMPLES_PASSED_CONSERVATIVE );
 		}
 		gl::colorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
 		gl::depthMask( GL_TRUE );
@@ -519,13 +915,17 @@ void Terrain::removeTilesPopulation()
 		
 		// start animation
 		size_t currentBatch = tile->mPopulationCurrent;
+		size_t version		= tile->mPopulationVersion[currentBatch];
 #ifdef HIGH_QUALITY_ANIMATIONS
 		mTimeline->applyPtr( &tile->mPopulationCompletion[tile->mPopulationCurrent], 0.0f, 8.0f, EaseOutQuad() )
 #else
 		mTimeline->applyPtr( &tile->mPopulationCompletion[tile->mPopulationCurrent], 0.0f, 3.5f, EaseOutQuad() )
 #endif
-		.finishFn( [currentBatch,tile](){
-			tile->mPopulation[currentBatch].reset();
+		.finishFn( [currentBatch,version,tile](){
+			// the batch might already hold a newer population if the tile was repopulated during the fade
+			if( tile->mPopulationVersion[currentBatch] == version ){
+				tile->resetPopulation( currentBatch );
+			}
 		} );
 	}
 }
@@ -538,33 +938,31 @@ void Terrain::regenerateTilesPopulation()
 
 // MARK: Tile
 
-std::shared_ptr<Terrain::Tile> Terrain::Tile::create( size_t tileId, const Area &tileArea, const Area &fullArea, float contentScale, float randomSeed, const Channel32fRef &heightMap, const Channel32fRef &densityMap, const BSpline2f &spline, size_t tilesPerRow, float elevation )
+std::shared_ptr<Terrain::Tile> Terrain::Tile::create( size_t tileId, const Area &tileArea, const Area &fullArea, float contentScale, float randomSeed, const Channel32fRef &heightMap, const Channel32fRef &densityMap, const BSpline2f &spline, size_t tilesPerRow, float elevation, const vector<vec2> &borderSamples )
 {
-	return make_shared<Terrain::Tile>( tileId, tileArea, fullArea, contentScale, randomSeed, heightMap, densityMap, spline, tilesPerRow, elevation );
+	return make_shared<Terrain::Tile>( tileId, tileArea, fullArea, contentScale, randomSeed, heightMap, densityMap, spline, tilesPerRow, elevation, borderSamples );
 }
 
-Terrain::Tile::Tile( size_t tileId, const Area &tileArea, const Area &fullArea, float contentScale, float randomSeed, const Channel32fRef &heightMap, const Channel32fRef &densityMap, const BSpline2f &spline, size_t tilesPerRow, float elevation ) :
+Terrain::Tile::Tile( size_t tileId, const Area &tileArea, const Area &fullArea, float contentScale, float randomSeed, const Channel32fRef &heightMap, const Channel32fRef &densityMap, const BSpline2f &spline, size_t tilesPerRow, float elevation, const vector<vec2> &borderSamples ) :
 mTileId( tileId ),
+mArenaSize( 0 ),
 mArea( tileArea ),
 mSize( tileArea.getSize() ),
-#ifdef HIGH_QUALITY_ANIMATIONS
-mTriMesh( TriMesh::Format().positions(3).texCoords().texCoords1(4) ),
-#else
-mTriMesh( TriMesh( TriMesh::Format().positions(3).texCoords() ) ),
-#endif
 mNumFramesOccluded( 0 ),
 mPosition( 0.0f ),
 mPopulationCurrent( 0 ),
 mPopulationTemp( 1 )
 {
+	mPopulationVersion[0] = mPopulationVersion[1] = 0;
+	
 	// prepare data
 	// add some margins so our poisson disk distribution doesn't get wrong at the edges
 	vec2 margins				= vec2( 20.0f );
 	Rectf areaWithMargins		= Rectf( mArea.getUL() - ivec2( margins ), mArea.getLR() + ivec2( margins ) );
 	Rectf localArea				= Rectf( vec2(0), tileArea.getSize() );
 	
-	float minDist				= 0.75f;
-	float maxDist				= 45.0f;
+	float minDist				= sMeshMinDistance;
+	float maxDist				= sMeshMaxDistance;
 	
 	std::vector<ci::vec2> meshSamples;
 	std::vector<ci::vec3> meshVertices;
@@ -586,7 +984,8 @@ mPopulationTemp( 1 )
 	}
 	
 	// sample sobel map and create the mesh distribution using poisson disk sampling
-	meshSamples = poissonDiskDistribution( [&]( const vec2& p ){
+	CounterRng samplesRng( randomSeed, tileId, CounterRng::MESH_SAMPLES );
+	meshSamples = PoissonDisk::distribution( &samplesRng, [&]( const vec2& p ){
 		float s = densityMap->getValue( p + vec2( mArea.getUL() ) );
 		return glm::clamp( maxDist - s * maxDist, minDist, maxDist );
 	}, localArea, initialPoints, 80 );
@@ -597,20 +996,11 @@ mPopulationTemp( 1 )
 	});
 	meshSamples.erase( outOfBoundRange, meshSamples.end() );
 	
-	// add points on the tile borders
-	float numVerticesPerEdge = 75.0f;
-	for( float i = 0.0f; i <= numVerticesPerEdge; ++i ){
-		float j = i / numVerticesPerEdge;
-		// top border
-		meshSamples.push_back( vec2( glm::mix( 0.0f, mSize.x, j ), 0 ) );
-		// left border
-		meshSamples.push_back( vec2( 0, glm::mix( 0.0f, mSize.y, j ) ) );
-		// right border
-		meshSamples.push_back( vec2( mSize.x, glm::mix( 0.0f, mSize.y, j ) ) );
-		// bottom border
-		meshSamples.push_back( vec2( glm::mix( 0.0f, mSize.x, j ), mSize.y ) );
-	}
-	meshSamples.push_back( mSize );
+	// add the border points. they have been chosen once per shared edge
+	// so the neighbouring tiles get the exact same vertices on their seams
+	for( const auto &sample : borderSamples ){
+		meshSamples.push_back( sample - vec2( mArea.getUL() ) );
+	}
 	
 	// triangulate samples
 	meshIndices = Delaunay::getTriangleIndices( Rectf( vec2(0), mSize + vec2(1) ), meshSamples );
@@ -648,29 +1038,22 @@ mPopulationTemp( 1 )
 	}
 	
 	
+	mTriMesh = TriMesh::create( TriMesh::Format().positions(3).texCoords() );
+	mTriMesh->appendPositions( &meshVertices[0], meshVertices.size() );
+	mTriMesh->appendIndices( &meshIndices[0], meshIndices.size() );
+	mTriMesh->appendTexCoords0( &texcoords[0], texcoords.size() );
+	
+	// the delaunay triangles come out in no particular order, reorder them
+	// and the vertices for the gpu post-transform cache and vertex fetches
+	mMeshStats = MeshOptimizer::optimize( mTriMesh.get() );
+	
+	// quantize the mesh relative to the tile bounds while we're still on the worker thread
 #ifdef HIGH_QUALITY_ANIMATIONS
-	// we have data per triangles so we need to rebuild the whole mesh
-	// we do lose the dense packing of the triangulation with triangles
-	// sharing vertices but I don't think there's so much choises here
-	mTriMesh = TriMesh( TriMesh::Format().positions(3).texCoords().texCoords1(4) );
-	for( size_t i = 0; i < meshIndices.size(); i+=3 ){
-		float indice				= (float) i / (float) meshIndices.size();
-		vec3 center					= ( meshVertices[meshIndices[i]] + meshVertices[meshIndices[i+1]] + meshVertices[meshIndices[i+2]] ) / 3.0f;
-		mTriMesh.appendTexCoord1( vec4( center, indice ) );
-		mTriMesh.appendTexCoord1( vec4( center, indice ) );
-		mTriMesh.appendTexCoord1( vec4( center, indice ) );
-		mTriMesh.appendTexCoord0( texcoords[ meshIndices[i] ] );
-		mTriMesh.appendTexCoord0( texcoords[ meshIndices[i+1] ] );
-		mTriMesh.appendTexCoord0( texcoords[ meshIndices[i+2] ] );
-		mTriMesh.appendVertex( meshVertices[meshIndices[i]] );
-		mTriMesh.appendVertex( meshVertices[meshIndices[i+1]] );
-		mTriMesh.appendVertex( meshVertices[meshIndices[i+2]] );
-	}
+	// the animation needs data per triangles, the mesh stays indexed and
+	// the triangles centers and ids are fetched separately by the shader
+	mMeshData = PackedMesh::packTerrainMesh( *mTriMesh, mBounds[0], PackedMesh::getTrianglesCenters( *mTriMesh ) );
 #else
-	mTriMesh = TriMesh( TriMesh::Format().positions(3).texCoords() );
-	mTriMesh.appendPositions( &meshVertices[0], meshVertices.size() );
-	mTriMesh.appendIndices( &meshIndices[0], meshIndices.size() );
-	mTriMesh.appendTexCoords0( &texcoords[0], texcoords.size() );
+	mMeshData = PackedMesh::packTerrainMesh( *mTriMesh, mBounds[0] );
 #endif
 }
 
@@ -690,16 +1073,85 @@ ci::AxisAlignedBox Terrain::Tile::getBounds( float elevation, float interpolatio
 	max.y = max.y + elevation * glm::mix( mHeightRange[1].y, mHeightRange[0].y, interpolation );
 	return AxisAlignedBox( min, max );
 }
+ci::AxisAlignedBox Terrain::Tile::getTerrainBounds( float elevation ) const
+{
+	return AxisAlignedBox( vec3( mArea.getUL().x, elevation * mHeightRange[0].x, mArea.getUL().y ), vec3( mArea.getLR().x, elevation * mHeightRange[0].y, mArea.getLR().y ) );
+}
+ci::AxisAlignedBox Terrain::Tile::getPopulationBounds( size_t batch, float elevation ) const
+{
+	// the trees stand on the terrain, their heights are relative to the ground
+	vec3 min = mPopulationBounds[batch].getMin();
+	vec3 max = mPopulationBounds[batch].getMax();
+	min.y += elevation * mHeightRange[0].x;
+	max.y += elevation * mHeightRange[0].y;
+	return AxisAlignedBox( min, max );
+}
+ci::AxisAlignedBox Terrain::Tile::getPopulationBounds( float elevation ) const
+{
+	AxisAlignedBox bounds	= getTerrainBounds( elevation );
+	size_t numPopulations	= 0;
+	for( size_t i = 0; i < 2; ++i ){
+		if( mPopulation[i] || mInstancedPopulation[i] || mImpostorPopulation[i] ){
+			if( numPopulations++ == 0 ) bounds = getPopulationBounds( i, elevation );
+			else bounds.include( getPopulationBounds( i, elevation ) );
+		}
+	}
+	return bounds;
+}
+
+size_t Terrain::Tile::getCpuMemoryUsage() const
+{
+	size_t size = mMeshData.getSize();
+	for( size_t i = 0; i < 2; ++i ){
+		size += mPopulationIndexCounts[i].size() * sizeof( uint32_t );
+		size += mTreeIndex[i].getSize();
+	}
+	if( mTriMesh ){
+		size += ( mTriMesh->getBufferPositions().size() + mTriMesh->getBufferTexCoords0().size() ) * sizeof( float );
+		size += mTriMesh->getNumIndices() * sizeof( uint32_t );
+	}
+	return size;
+}
+
+size_t Terrain::Tile::getGpuMemoryUsage() const
+{
+	size_t size = mMesh ? mMesh->getSize() : 0;
+	for( size_t i = 0; i < 2; ++i ){
+		if( mPopulation[i] ) size += mPopulation[i]->getSize();
+		if( mInstancedPopulation[i] ) size += mInstancedPopulation[i]->getSize();
+		if( mImpostorPopulation[i] ) size += mImpostorPopulation[i]->getSize();
+	}
+	return size;
+}
+
+size_t Terrain::Tile::getPopulationNumIndices( size_t batch, float density ) const
+{
+	// the trees are sorted by importance so the first ones are enough for distant tiles
+	const auto &indexCounts = mPopulationIndexCounts[batch];
+	size_t numTrees = glm::min( (size_t) ceil( density * indexCounts.size() ), indexCounts.size() );
+	return numTrees ? indexCounts[numTrees - 1] : 0;
+}
 
 // MARK: Tile Meshes
 
-void Terrain::Tile::buildMeshes( const ci::gl::GlslProgRef &shader )
+void Terrain::Tile::buildMeshes( const ci::gl::GlslProgRef &shader, const MeshArenaRef &arena, TileMemoryPolicy memoryPolicy )
 {
-	// create the terrain mesh
-	mBatch = gl::Batch::create( mTriMesh, shader );
+#ifdef HIGH_QUALITY_ANIMATIONS
+	// upload the packed terrain mesh, the per-triangle data needs its own textures
+	mMesh = PackedMesh::create( mMeshData, shader );
+#else
+	// append the packed terrain mesh to the buffers shared by every tile
+	mArenaSize = arena->add( (uint32_t) mTileId, mMeshData );
+#endif
 	
-	// and the occluder mesh
-	buildOcclusionMesh();
+	// and only keep the cpu copies the policy asks for, the triangle
+	// height map pass renders the gpu mesh so it doesn't need them
+	if( memoryPolicy != TileMemoryPolicy::COMPACT ){
+		mMeshData = PackedMesh::Data();
+	}
+	if( memoryPolicy != TileMemoryPolicy::RETAIN ){
+		mTriMesh.reset();
+	}
 	
 	// create a few occlusion queries
 	for( size_t i = 0; i < 5; i++ ){
@@ -709,31 +1161,40 @@ void Terrain::Tile::buildMeshes( const ci::gl::GlslProgRef &shader )
 	}
 }
 
-void Terrain::Tile::buildOcclusionMesh()
+void Terrain::Tile::buildPopulationMeshes( const PackedMesh::Data &meshData, const InstancedPopulation::Data &instancesData, const std::vector<uint32_t> &indexCounts, const TreeIndex &treeIndex, const ci::AxisAlignedBox &bounds, const ci::gl::GlslProgRef &shader, const ci::gl::GlslProgRef &instancedShader, const std::vector<InstancedPopulation::ModelRef> &models, const ImpostorAtlasRef &impostorAtlas, const ci::gl::GlslProgRef &impostorShader, const BufferPoolRef &bufferPool )
 {
-	// create the occluder box mesh
-	auto stockShader = gl::getStockShader( gl::ShaderDef().color() );
-	mat4 occluderTransform = glm::scale( mat4(1), vec3( getBounds().getSize().x, 1.0f, getBounds().getSize().z ) );
-	mOccluderBatch = gl::Batch::create( geom::Cube() >> geom::Transform( occluderTransform ), stockShader, { { geom::Attrib::POSITION, "ciPosition" } } );
-}
-void Terrain::Tile::buildPopulationMeshes( const TriMeshRef &triMesh, const ci::AxisAlignedBox &bounds, const ci::gl::GlslProgRef &shader )
-{
-	// swap the population batch flags
+	// swap the population batch flags and drop what is left of the population the batch held
 	swap( mPopulationCurrent, mPopulationTemp );
+	resetPopulation( mPopulationCurrent );
+	mPopulationVersion[mPopulationCurrent]++;
 	
-	if( triMesh->getNumTriangles() > 0 ){
+	if( meshData.mNumIndices > 0 || instancesData.getNumInstances() > 0 ){
 		
-		// create the main population batch
-		mPopulation[mPopulationCurrent] = gl::Batch::create( *triMesh.get(), shader );
+		// create the main population mesh or instances
+		if( meshData.mNumIndices > 0 ){
+			mPopulation[mPopulationCurrent] = PackedMesh::create( meshData, shader, bufferPool );
+			mPopulationIndexCounts[mPopulationCurrent] = indexCounts;
+		}
+		else {
+			mInstancedPopulation[mPopulationCurrent] = InstancedPopulation::create( instancesData, models, instancedShader, bufferPool );
+		}
 		
-		// update the old bounds
-		mBounds[0].include( bounds );
+		// and the impostors, sharing the instances buffer when there is one
+		if( impostorAtlas && instancesData.getNumInstances() > 0 ){
+			if( mInstancedPopulation[mPopulationCurrent] ){
+				mImpostorPopulation[mPopulationCurrent] = ImpostorPopulation::create( mInstancedPopulation[mPopulationCurrent], impostorAtlas, impostorShader, bufferPool );
+			}
+			else {
+				mImpostorPopulation[mPopulationCurrent] = ImpostorPopulation::create( instancesData, impostorAtlas, impostorShader, bufferPool );
+			}
+		}
 		
-		// update the old occluder mesh
-		buildOcclusionMesh();
+		// keep the trees queryable once baked
+		mTreeIndex[mPopulationCurrent] = treeIndex;
 		
-		// make sure we clear the temp TriMesh
-		triMesh->clear();
+		// update the old bounds
+		mBounds[0].include( bounds );
+		mPopulationBounds[mPopulationCurrent] = bounds;
 	}
 }
 void Terrain::Tile::updateBounds( const std::vector<ci::vec2> &samples, const ci::Channel32fRef &heightMap, const ci::Area &fullArea )
@@ -770,6 +1231,14 @@ void Terrain::Tile::clearPopulation()
 {
 	//mTrees.reset();
 }
+void Terrain::Tile::resetPopulation( size_t batch )
+{
+	mPopulation[batch].reset();
+	mInstancedPopulation[batch].reset();
+	mImpostorPopulation[batch].reset();
+	mPopulationIndexCounts[batch].clear();
+	mTreeIndex[batch] = TreeIndex();
+}
 
 // MARK: Tile Occlusion Culling
 
@@ -781,28 +1250,17 @@ void Terrain::Tile::resetOccludedFrameCount()
 {
 	mNumFramesOccluded = 0;
 }
-void Terrain::Tile::checkOcclusion()
+GLuint Terrain::Tile::acquireOcclusionQuery()
 {
-	// no need to do anything if the occlusion mesh is not ready
-	if( mOccluderBatch ){
-		// check if we have query object ready to be used
-		int current = -1;
-		for( size_t i = 0; i < mOcclusionQueries.size(); ++i ){
-			if( !mOcclusionQueries[i].mUsed ){
-				current = i;
-				break;
-			}
-		}
-		
-		// if we're still waiting for the result of all queries
-		// no need to add more, we'll just wait.
-		if( current != -1 ){
-			glBeginQuery( GL_ANY_SAMPLES_PASSED_CONSERVATIVE, mOcclusionQueries[current].mId );
-			mOccluderBatch->draw();
-			glEndQuery( GL_ANY_SAMPLES_PASSED_CONSERVATIVE );
-			mOcclusionQueries[current].mUsed = true;
+	// if we're still waiting for the result of all queries
+	// no need to add more, we'll just wait.
+	for( auto &query : mOcclusionQueries ){
+		if( ! query.mUsed ){
+			query.mUsed = true;
+			return query.mId;
 		}
 	}
+	return 0;
 }
 void Terrain::Tile::queryOcclusionResults()
 {
@@ -848,6 +1306,10 @@ void Terrain::createTiles()
 	}
 	mWorkThreads.clear();
 	mTiles.clear();
+	mTilesById.clear();
+	if( mTileMeshArena ){
+		mTileMeshArena->clear();
+	}
 	
 	if( mTilesBuffer )
 		mTilesBuffer->cancel();
@@ -860,22 +1322,28 @@ void Terrain::createTiles()
 	int numTiles			= getNumTilesPerRow() * getNumTilesPerRow();
 	vec2 size				= vec2( mSize );
 	vec2 tileSize			= vec2( ( size / (float) getNumTilesPerRow() ) );
-	int numTilesPerThread	= ceil( (float) numTiles / (float) getNumWorkingThreads() );
 	Area area				= Area( ivec2(0), ivec2(size) );
 	float scale				= 1.0f / size.x * 512.0f;
+	mNextTileToBuild		= 0;
 	mTilesBuffer			= CircularTileBufferRef( new CircularTileBuffer( numTiles ) );
 	mBuildingTiles			= true;
 	
+	// the culling quadtree is filled as the tiles come back
+	mTilesById.resize( numTiles );
+	mTileQuadtree.build( getNumTilesPerRow() );
+	
 	
 	// download the map to the cpu
 	auto heightMap = getHeightChannel();
 	auto densityMap = getMeshDensityChannel();
 	
-	// setup worker threads to build the different tiles
+	// sample the tiles edges once so neighbours share their border vertices
+	auto tilesBorders = sampleTilesBorders( getNumTilesPerRow(), tileSize, area, densityMap );
+	
+	// setup worker threads to build the different tiles, they pull the tiles one at
+	// a time so a worker with expensive tiles doesn't keep the others waiting
 	for( int i = 0; i < getNumWorkingThreads(); i++ ){
-		int start = i * numTilesPerThread;
-		int end = min( ( i + 1 ) * numTilesPerThread, numTiles ) - 1;
-		mWorkThreads.emplace_back( new thread( bind( &Terrain::buildTilesThreaded, this, start, end, getNumTilesPerRow(), tileSize, area, scale, heightMap, densityMap ) ) );
+		mWorkThreads.emplace_back( new thread( bind( &Terrain::buildTilesThreaded, this, i, numTiles, getNumTilesPerRow(), tileSize, area, scale, heightMap, densityMap, tilesBorders ) ) );
 	}
 	
 	// start watching for tile updates
@@ -905,7 +1373,9 @@ void Terrain::updateTiles()
 		
 		// push back new tile and build opengl objects
 		mTiles.push_back( tile );
-		tile->buildMeshes( mTileShader );
+		mTilesById[tileId]	= tile;
+		mTilesBoundsDirty	= true;
+		tile->buildMeshes( mTileShader, mTileMeshArena, mTileMemoryPolicy );
 		
 		// and start animation
 #ifdef HIGH_QUALITY_ANIMATIONS
@@ -926,6 +1396,34 @@ void Terrain::updateTiles()
 		}
 		mWorkThreads.clear();
 		
+		// report the tiles vertex cache optimization results
+		MeshOptimizer::Stats stats;
+		for( const auto &tile : mTiles ){
+			stats.mNumTriangles	+= tile->mMeshStats.mNumTriangles;
+			stats.mAcmrBefore	+= tile->mMeshStats.mAcmrBefore * tile->mMeshStats.mNumTriangles;
+			stats.mAcmrAfter	+= tile->mMeshStats.mAcmrAfter * tile->mMeshStats.mNumTriangles;
+		}
+		if( stats.mNumTriangles ){
+			CI_LOG_V( "Tiles " << stats.mNumTriangles << " triangles, ACMR " << stats.mAcmrBefore / stats.mNumTriangles << " -> " << stats.mAcmrAfter / stats.mNumTriangles );
+		}
+		
+		// and their memory usage
+		size_t cpuMemory = 0, gpuMemory = 0;
+		for( const auto &tile : mTiles ){
+			CI_LOG_V( "Tile " << tile->getTileId() << " cpu " << tile->getCpuMemoryUsage() / 1024 << "kb, gpu " << tile->getGpuMemoryUsage() / 1024 << "kb, arena " << tile->getArenaMemoryUsage() / 1024 << "kb" );
+			cpuMemory += tile->getCpuMemoryUsage();
+			gpuMemory += tile->getGpuMemoryUsage();
+		}
+		if( mTileMeshArena ){
+			gpuMemory += mTileMeshArena->getSize();
+		}
+		CI_LOG_V( "Tiles cpu " << cpuMemory / 1024 << "kb, gpu " << gpuMemory / 1024 << "kb" );
+		
+		// lay the tiles out in z-order so the tiles culled together are drawn together
+		if( mTileMeshArena ){
+			mTileMeshArena->reorder( getTilesMortonOrder( getNumTilesPerRow() ) );
+		}
+		
 		// generate the triangle height map from the actual displaced triangles
 		generateTriangleHeightMap();
 		
@@ -938,6 +1436,7 @@ void Terrain::updateTiles()
 		}
 		
 		mRoadSpline3dLength = mRoadSpline3d[mHeightMapCurrent].getLength( 0.0f, 1.0f );
+		mPvsDirty			= true;
 		
 		// flag the tile process as complete
 		mBuildingTiles = false;
@@ -947,27 +1446,81 @@ void Terrain::updateTiles()
 	}
 }
 
-void Terrain::buildTilesThreaded( size_t start, size_t end, size_t numTilesPerRow, const vec2 &tileSize, const Area &area, float scale, const Channel32fRef &heightMap, const Channel32fRef &densityMap )
+void Terrain::buildTilesThreaded( size_t workerId, size_t numTiles, size_t numTilesPerRow, const vec2 &tileSize, const Area &area, float scale, const Channel32fRef &heightMap, const Channel32fRef &densityMap, const vector<vector<vec2>> &tilesBorders )
 {
 	ThreadSetup threadSetup;
 	
-	for( size_t i = start; i <= end; i++ ){
+	for( size_t i = mNextTileToBuild++; i < numTiles; i = mNextTileToBuild++ ){
 		vec2 pos		= vec2( i % numTilesPerRow, i / numTilesPerRow );
 		vec2 ul			= pos * ceil( tileSize );
 		vec2 lr			= pos * ceil( tileSize ) + ceil( tileSize );
 		Area tileArea	= Area( ul, lr );
 		tileArea.clipBy( area );
 		
-		auto tile = Tile::create( i, tileArea, Area( ivec2(0), mSize ), scale, mNoiseSeed, heightMap, densityMap, getRoadSpline2d(), numTilesPerRow, getElevation() );
+		auto tile = Tile::create( i, tileArea, Area( ivec2(0), mSize ), scale, mNoiseSeed, heightMap, densityMap, getRoadSpline2d(), numTilesPerRow, getElevation(), tilesBorders[i] );
 		
 		// add a small delay to make sure all threads don't return at the same time
-		this_thread::sleep_for( chrono::milliseconds( 2 * ( start + 20 ) ) );
+		this_thread::sleep_for( chrono::milliseconds( 2 * ( workerId + 20 ) ) );
 		
 		mTilesBuffer->pushFront( tile );
 	}
 };
 
 
+namespace {
+	// tiles expected to grow more trees than this are sampled in quadrants by different workers
+	const float sPopulationSplitThreshold = 1500.0f;
+	// the largest poisson disk radius, the margin sampled around the quadrants
+	const float sPopulationMaxRadius = 12.5f;
+	
+	//! returns the poisson disk radius of the population at \a mapPos
+	float getPopulationRadius( const Channel32fRef &floraMap, const vec2 &mapPos )
+	{
+		return 2.5f + floraMap->getValue( mapPos ) * 10.0f;
+	}
+	
+	//! roughly estimates the number of trees of a tile, a disk of radius r holds about one sample per r² units
+	float estimatePopulation( const Area &tileArea, const Channel32fRef &floraMap )
+	{
+		const int step = 4;
+		float numTrees = 0.0f;
+		for( int y = tileArea.y1; y < tileArea.y2; y += step ){
+			for( int x = tileArea.x1; x < tileArea.x2; x += step ){
+				vec2 mapPos = vec2( x, y );
+				if( floraMap->getValue( mapPos ) < 0.5f ){
+					float radius = getPopulationRadius( floraMap, mapPos );
+					numTrees += ( step * step ) / ( radius * radius );
+				}
+			}
+		}
+		return numTrees;
+	}
+	
+	//! merges the samples of the quadrants of a tile. the quadrants don't know about each other
+	//! so the samples on both sides of a \a seam can be too close, the first part keeps them
+	vector<vec2> stitchSamples( const vector<vector<vec2>> &parts, const vec2 &seam, const Channel32fRef &floraMap, const vec2 &tileOffset )
+	{
+		vector<vec2> samples, seamSamples;
+		for( const auto &part : parts ){
+			size_t numSeamSamples = seamSamples.size();
+			for( const auto &p : part ){
+				if( glm::abs( p.x - seam.x ) < sPopulationMaxRadius || glm::abs( p.y - seam.y ) < sPopulationMaxRadius ){
+					float radius	= getPopulationRadius( floraMap, p + tileOffset );
+					bool tooClose	= false;
+					for( size_t i = 0; i < numSeamSamples && ! tooClose; ++i ){
+						tooClose = glm::distance( p, seamSamples[i] ) < radius;
+					}
+					if( tooClose )
+						continue;
+					seamSamples.push_back( p );
+				}
+				samples.push_back( p );
+			}
+		}
+		return samples;
+	}
+} // anonymous namespace
+
 void Terrain::populateTiles()
 {
 	// skip if we're already populating
@@ -980,13 +1533,17 @@ void Terrain::populateTiles()
 		
 		// start animation
 		size_t currentBatch = tile->mPopulationCurrent;
+		size_t version		= tile->mPopulationVersion[currentBatch];
 #ifdef HIGH_QUALITY_ANIMATIONS
 		mTimeline->applyPtr( &tile->mPopulationCompletion[tile->mPopulationCurrent], 0.0f, 8.0f, EaseOutQuad() )
 #else
 		mTimeline->applyPtr( &tile->mPopulationCompletion[tile->mPopulationCurrent], 0.0f, 3.5f, EaseOutQuad() )
 #endif
-		.finishFn( [currentBatch,tile](){
-			tile->mPopulation[currentBatch].reset();
+		.finishFn( [currentBatch,version,tile](){
+			// the batch might already hold a newer population if the tile was repopulated during the fade
+			if( tile->mPopulationVersion[currentBatch] == version ){
+				tile->resetPopulation( currentBatch );
+			}
 		} );
 	}
 	
@@ -996,7 +1553,6 @@ void Terrain::populateTiles()
 	vec2 size				= vec2( mSize );
 	vec2 tileSize			= vec2( ( size / (float) getNumTilesPerRow() ) );
 	Area area				= Area( ivec2(0), ivec2(size) );
-	int numTilesPerThread	= ceil( (float) numTiles / (float) getNumWorkingThreads() );
 	mTilesPopulationBuffer	= CircularPopulationBufferRef( new CircularPopulationBuffer( numTiles ) );
 	mNumTilePopulated		= 0;
 	mTileExplosionSize		= 0.001f;
@@ -1006,11 +1562,67 @@ void Terrain::populateTiles()
 	auto flora	= getFloraDensityChannel();
 	auto height = getTrianglesHeightChannel();
 	
-	// setup worker threads to build the different tiles
+	// the per-triangle animations need the baked meshes
+#ifdef HIGH_QUALITY_ANIMATIONS
+	auto populationMode = PopulationMode::BAKED;
+#else
+	auto populationMode = mPopulationMode;
+#endif
+	
+	// the species noise only depends on the seed, make sure it is ready before the workers sample it
+	updateSpeciesField();
+	
+	// make sure each worker has its arena, they are kept between regenerations
+	mPopulationArenas.resize( getNumWorkingThreads() );
+	for( auto &arena : mPopulationArenas ){
+		arena.mNumGrowths		= 0;
+		arena.mNumTiles			= 0;
+		arena.mNumGrowingTiles	= 0;
+		arena.mTime				= 0.0;
+		arena.mGrowingTime		= 0.0;
+	}
+	mPopulationBufferPool->resetStats();
+	
+	// prepare the jobs, the tiles expected to be much denser than the others
+	// are split in quadrants so they don't end up alone on the critical path
+	mPopulationJobs = unique_ptr<PopulationJobs>( new PopulationJobs() );
+	mPopulationJobs->mSplitTiles.resize( numTiles );
+	for( int i = 0; i < numTiles; i++ ){
+		vec2 pos		= vec2( i % getNumTilesPerRow(), i / getNumTilesPerRow() );
+		vec2 ul			= pos * ceil( tileSize );
+		vec2 lr			= pos * ceil( tileSize ) + ceil( tileSize );
+		Area tileArea	= Area( ul, lr );
+		tileArea.clipBy( area );
+		Rectf localArea = Rectf( vec2(0), tileArea.getSize() );
+		
+		float cost = estimatePopulation( tileArea, flora );
+		if( cost > sPopulationSplitThreshold ){
+			vec2 center			= localArea.getCenter();
+			Rectf quadrants[4]	= {
+				Rectf( localArea.getUpperLeft(), center ),
+				Rectf( center.x, localArea.y1, localArea.x2, center.y ),
+				Rectf( localArea.x1, center.y, center.x, localArea.y2 ),
+				Rectf( center, localArea.getLowerRight() )
+			};
+			mPopulationJobs->mSplitTiles[i] = unique_ptr<PopulationJobs::SplitTile>( new PopulationJobs::SplitTile() );
+			mPopulationJobs->mSplitTiles[i]->mParts.resize( 4 );
+			for( size_t q = 0; q < 4; ++q ){
+				mPopulationJobs->mJobs.push_back( { (size_t) i, tileArea, quadrants[q], q, 4, cost / 4.0f } );
+			}
+		}
+		else {
+			mPopulationJobs->mJobs.push_back( { (size_t) i, tileArea, localArea, 0, 1, cost } );
+		}
+	}
+	
+	// the biggest jobs go first and the small ones fill the gaps at the end
+	std::stable_sort( mPopulationJobs->mJobs.begin(), mPopulationJobs->mJobs.end(), []( const PopulationJob &lhs, const PopulationJob &rhs ){
+		return lhs.mCost > rhs.mCost;
+	} );
+	
+	// setup worker threads, they pull the jobs one at a time
 	for( int i = 0; i < getNumWorkingThreads(); i++ ){
-		int start = i * numTilesPerThread;
-		int end = min( ( i + 1 ) * numTilesPerThread, numTiles ) - 1;
-		mWorkThreads.emplace_back( new thread( bind( &Terrain::populateTilesThreaded, this, start, end, getNumTilesPerRow(), tileSize, area, flora ) ) );
+		mWorkThreads.emplace_back( new thread( bind( &Terrain::populateTilesThreaded, this, i, mPopulationJobs.get(), flora, height, populationMode, &mPopulationArenas[i] ) ) );
 	}
 	
 	// start watching for tile updates
@@ -1030,7 +1642,8 @@ void Terrain::updateTilePopulating()
 		if( tileLookup != mTiles.end() ){
 
 			// build opengl meshes
-			(*tileLookup)->buildPopulationMeshes( data->mTriMesh, data->mBounds, mTileContentShader );
+			(*tileLookup)->buildPopulationMeshes( data->mMeshData, data->mInstancesData, data->mIndexCounts, data->mTreeIndex, data->mBounds, mTileContentShader, mTileInstancedContentShader, mPopulationModels, mImpostorAtlas, mTileImpostorShader, mPopulationBufferPool );
+			mTilesBoundsDirty = true;
 			
 			// start animation
 #ifdef HIGH_QUALITY_ANIMATIONS
@@ -1054,230 +1667,543 @@ void Terrain::updateTilePopulating()
 		}
 		mWorkThreads.clear();
 		
+		// report how many times the workers arenas had to allocate, this
+		// should drop to zero once they have seen the biggest tiles
+		size_t numGrowths = 0, numTiles = 0, numGrowingTiles = 0;
+		double time = 0.0, growingTime = 0.0;
+		for( const auto &arena : mPopulationArenas ){
+			numGrowths		+= arena.mNumGrowths;
+			numTiles		+= arena.mNumTiles;
+			numGrowingTiles	+= arena.mNumGrowingTiles;
+			time			+= arena.mTime;
+			growingTime		+= arena.mGrowingTime;
+		}
+		CI_LOG_V( "Population arenas allocations: " << numGrowths );
+		CI_LOG_V( "Population tiles: " << numGrowingTiles << " growing the arenas in " << ( numGrowingTiles ? growingTime / numGrowingTiles : 0.0 ) << "ms avg, " << numTiles << " reusing them in " << ( numTiles ? time / numTiles : 0.0 ) << "ms avg" );
+		
+		// same for the gpu buffers, new ones are only created until the previous populations are released
+		const auto &poolStats = mPopulationBufferPool->getStats();
+		CI_LOG_V( "Population buffers: " << poolStats.mNumCreated << " created, " << poolStats.mNumReused << " reused, " << poolStats.mNumOrphaned << " orphaned, " << poolStats.mNumVaosCreated << " vaos created, " << poolStats.mNumTrimmed << " trimmed" );
+		
 		// flag the tile populating process as complete
 		mPopulatingTiles = false;
 	}
 }
 
-void Terrain::populateTilesThreaded( size_t start, size_t end, size_t numTilesPerRow, const ci::vec2 &tileSize, const ci::Area &area, const ci::Channel32fRef &floraMap )
+namespace {
+	// the species noise is very low frequency, one sample every few units is enough
+	const float sSpeciesFieldSpacing = 4.0f;
+}
+
+void Terrain::updateSpeciesField()
 {
-	ThreadSetup threadSetup;
+	if( mSpeciesField && mSpeciesFieldSeed == mNoiseSeed && mSpeciesFieldSize == mSize )
+		return;
 	
-	for( size_t i = start; i <= end; i++ ){
-		vec2 pos		= vec2( i % numTilesPerRow, i / numTilesPerRow );
-		vec2 ul			= pos * ceil( tileSize );
-		vec2 lr			= pos * ceil( tileSize ) + ceil( tileSize );
-		Area tileArea	= Area( ul, lr );
-		tileArea.clipBy( area );
-		Rectf localArea = Rectf( vec2(0), tileArea.getSize() );
-		
-		// create a new population data for this tile
-		PopulationDataRef data = PopulationDataRef( new PopulationData() );
-		data->mTileId = i;
-		
-		// find a good initial point for the samples
-		int limit = 0;
-		vector<vec2> initialSamples;
-		for( int i = 0; i < 5; i++ ){
-			vec2 initialSample = vec2( randFloat( localArea.getX1(), localArea.getX2() ), randFloat( localArea.getY1(), localArea.getY2() ) );
-			while ( floraMap->getValue( initialSample + vec2( tileArea.getUL() ) ) > 0.3f && limit < 100 ) {
-				initialSample = vec2( randFloat( localArea.getX1(), localArea.getX2() ), randFloat( localArea.getY1(), localArea.getY2() ) );
-				limit++;
+	Timer timer( true );
+	int width			= ceil( mSize.x / sSpeciesFieldSpacing ) + 1;
+	int height			= ceil( mSize.y / sSpeciesFieldSpacing ) + 1;
+	mSpeciesField		= Channel32f::create( width, height );
+	mSpeciesFieldSeed	= mNoiseSeed;
+	mSpeciesFieldSize	= mSize;
+	
+	// split the rows between the working threads, each with its own perlin
+	auto field			= mSpeciesField;
+	float seed			= mNoiseSeed;
+	int numThreads		= getNumWorkingThreads();
+	int rowsPerThread	= ceil( (float) height / (float) numThreads );
+	vector<thread> threads;
+	for( int i = 0; i < numThreads; ++i ){
+		int start	= i * rowsPerThread;
+		int end		= glm::min( start + rowsPerThread, height );
+		threads.emplace_back( [field,seed,start,end,width]() {
+			Perlin perlin( 3, seed );
+			for( int y = start; y < end; ++y ){
+				float* row = field->getData( ivec2( 0, y ) );
+				for( int x = 0; x < width; ++x ){
+					vec3 p	= vec3( x * sSpeciesFieldSpacing, 0.0f, y * sSpeciesFieldSpacing );
+					row[x]	= perlin.fBm( ( vec3( seed ) + p ) * 0.001f );
+				}
 			}
-			initialSamples.push_back( initialSample );
-		}
-	
-		// use the flora map to generate poisson disk samples
-		vector<vec2> samples = poissonDiskDistribution( [&]( const vec2& p ){
-			float s = floraMap->getValue( p + vec2( tileArea.getUL() ) );
-			//if( s > 0.95 ) s *= 30.0f;
-			//return 1.0f + s * 10.0f;
-			return 2.5f + s * 10.0f;
-		}, [&]( const vec2& p ){
-			vec2 sample = p + vec2( tileArea.getUL() );
-			float s = floraMap->getValue( sample );
-			return s < 0.5f;// && !insideClearing;
-		}, localArea, initialSamples );
-		
-		// removes samples that are not in this tile
-		auto outOfBoundRange = std::remove_if( samples.begin(), samples.end(), [localArea]( const vec2& p ){
-			return !localArea.contains( p );
-		});
-		samples.erase( outOfBoundRange, samples.end() );
-		
-		// convert 2d samples to 3d points. skip initial sample that might be wrong
-		vector<vec3> positions;
-		for( size_t i = 1; i < samples.size(); ++i ) {
-			 vec2 mapPos = samples[i] + vec2( tileArea.getUL() );
-			 if( floraMap->getValue( mapPos ) < 0.5f ) {
-				positions.push_back( vec3( samples[i].x, 0.0f, samples[i].y ) );
-			 }
-		 }
+		} );
+	}
+	for( auto &t : threads ){
+		t.join();
+	}
+	CI_LOG_V( "Species field " << width << "x" << height << " in " << timer.getSeconds() * 1000.0 << "ms" );
+}
+
+float Terrain::sampleSpeciesField( const ci::vec2 &mapPos ) const
+{
+	vec2 p		= glm::clamp( mapPos / sSpeciesFieldSpacing, vec2( 0.0f ), vec2( mSpeciesField->getSize() - ivec2( 1 ) ) );
+	ivec2 p0	= glm::min( ivec2( p ), mSpeciesField->getSize() - ivec2( 2 ) );
+	vec2 t		= p - vec2( p0 );
+	const float* row0 = mSpeciesField->getData( p0 );
+	const float* row1 = mSpeciesField->getData( p0 + ivec2( 0, 1 ) );
+	return glm::mix( glm::mix( row0[0], row0[1], t.x ), glm::mix( row1[0], row1[1], t.x ), t.y );
+}
+
+void Terrain::populateTilesThreaded( size_t workerId, PopulationJobs *jobs, const ci::Channel32fRef &floraMap, const ci::Channel32fRef &heightMap, PopulationMode populationMode, PopulationArena *arena )
+{
+	ThreadSetup threadSetup;
+	
+	// take the next job until there are none left, the biggest ones come first
+	for( size_t j = jobs->mNext++; j < jobs->mJobs.size(); j = jobs->mNext++ ){
+		const PopulationJob &job	= jobs->mJobs[j];
+		vector<vec2> samples		= samplePopulation( job, floraMap );
+		
+		// keep the samples of a quadrant, the worker finishing the last one populates the whole tile
+		if( job.mNumParts > 1 ){
+			auto &splitTile = *jobs->mSplitTiles[job.mTileId];
+			splitTile.mParts[job.mPart] = std::move( samples );
+			if( ++splitTile.mNumDone < job.mNumParts )
+				continue;
+			samples = stitchSamples( splitTile.mParts, vec2( job.mTileArea.getSize() ) * 0.5f, floraMap, vec2( job.mTileArea.getUL() ) );
+		}
 		
-		Rand rnd;
-		rnd.seed( mNoiseSeed );
-		Perlin perlin( 3, mNoiseSeed );
-		vec3 offset( tileArea.getUL().x, 0, tileArea.getUL().y );
+		// time the tiles that grew the arena apart from the others to see what the allocations cost
+		size_t numGrowths = arena->mNumGrowths;
+		Timer timer( true );
+		PopulationDataRef data = populateTile( job.mTileId, job.mTileArea, samples, floraMap, heightMap, populationMode, arena );
+		double time = timer.getSeconds() * 1000.0;
+		if( arena->mNumGrowths > numGrowths ){
+			arena->mNumGrowingTiles++;
+			arena->mGrowingTime += time;
+		}
+		else {
+			arena->mNumTiles++;
+			arena->mTime += time;
+		}
 		
-		// make the trees global scale random
-		float scale0 = rnd.nextFloat( 0.9f, 1.25f );
-		float scale1 = rnd.nextFloat( 0.7f, 0.8f );
+		// add a small delay to make sure all threads don't come back at the same time
+		this_thread::sleep_for( chrono::milliseconds( 10 * ( workerId + 20 ) ) );
 		
-		// sometimes make them really big
-		if( rnd.nextFloat( 0.0f, 100.0f ) < 7.0f ){
-			scale0 = rnd.nextFloat( 2.8f, 3.3f );
+		// send back to the main thread
+		mTilesPopulationBuffer->pushFront( data );
+	}
+}
+
+vector<vec2> Terrain::samplePopulation( const PopulationJob &job, const ci::Channel32fRef &floraMap ) const
+{
+	const Area &tileArea	= job.mTileArea;
+	const Rectf &region		= job.mRegion;
+	Rectf localArea			= Rectf( vec2(0), tileArea.getSize() );
+	
+	// quadrants are sampled with margins so their seams get the same distribution as the rest
+	Rectf sampleArea		= job.mNumParts > 1 ? region.inflated( vec2( sPopulationMaxRadius ) ).getClipBy( localArea ) : localArea;
+	
+	// every random value comes from streams keyed by the seed and the tile
+	// so the result doesn't depend on the number of threads or their order
+	CounterRng samplesRng( mNoiseSeed, job.mTileId, CounterRng::INITIAL_SAMPLES, job.mPart );
+	
+	// find a good initial point for the samples
+	int limit = 0;
+	vector<vec2> initialSamples;
+	for( int i = 0; i < 5; i++ ){
+		vec2 initialSample = vec2( samplesRng.nextFloat( region.getX1(), region.getX2() ), samplesRng.nextFloat( region.getY1(), region.getY2() ) );
+		while ( floraMap->getValue( initialSample + vec2( tileArea.getUL() ) ) > 0.3f && limit < 100 ) {
+			initialSample = vec2( samplesRng.nextFloat( region.getX1(), region.getX2() ), samplesRng.nextFloat( region.getY1(), region.getY2() ) );
+			limit++;
 		}
+		initialSamples.push_back( initialSample );
+	}
 	
+	// use the flora map to generate poisson disk samples
+	CounterRng poissonRng( mNoiseSeed, job.mTileId, CounterRng::POPULATION_SAMPLES, job.mPart );
+	vector<vec2> samples = PoissonDisk::distribution( &poissonRng, [&]( const vec2& p ){
+		//float s = floraMap->getValue( p + vec2( tileArea.getUL() ) );
+		//if( s > 0.95 ) s *= 30.0f;
+		//return 1.0f + s * 10.0f;
+		return getPopulationRadius( floraMap, p + vec2( tileArea.getUL() ) );
+	}, [&]( const vec2& p ){
+		vec2 sample = p + vec2( tileArea.getUL() );
+		float s = floraMap->getValue( sample );
+		return s < 0.5f;// && !insideClearing;
+	}, sampleArea, initialSamples );
+	
+	// removes samples that are not in this tile or quadrant
+	auto outOfBoundRange = std::remove_if( samples.begin(), samples.end(), [region]( const vec2& p ){
+		return !region.contains( p );
+	});
+	samples.erase( outOfBoundRange, samples.end() );
+	
+	// skip initial sample that might be wrong
+	if( ! samples.empty() ){
+		samples.erase( samples.begin() );
+	}
+	return samples;
+}
+
+Terrain::PopulationDataRef Terrain::populateTile( size_t tileId, const ci::Area &tileArea, const std::vector<ci::vec2> &samples, const ci::Channel32fRef &floraMap, const ci::Channel32fRef &heightMap, PopulationMode populationMode, PopulationArena *arena )
+{
+	// create a new population data for this tile
+	PopulationDataRef data = PopulationDataRef( new PopulationData() );
+	data->mTileId = tileId;
+	
+	// convert 2d samples to 3d points
+	auto &positions = arena->mTreePositions;
+	arena->resize( &positions, samples.size() );
+	size_t numTrees = 0;
+	for( size_t i = 0; i < samples.size(); ++i ) {
+		 vec2 mapPos = samples[i] + vec2( tileArea.getUL() );
+		 if( floraMap->getValue( mapPos ) < 0.5f ) {
+			positions[numTrees++] = vec3( samples[i].x, 0.0f, samples[i].y );
+		 }
+	 }
+	positions.resize( numTrees );
+	arena->mMaxTrees = glm::max( arena->mMaxTrees, numTrees );
+	
+	CounterRng rnd( mNoiseSeed, tileId, CounterRng::TREES );
+	CounterRng importanceRng( mNoiseSeed, tileId, CounterRng::IMPORTANCE );
+	vec3 offset( tileArea.getUL().x, 0, tileArea.getUL().y );
+	
+	// make the trees global scale random, the same for every tile
+	CounterRng globalRng( mNoiseSeed, 0, CounterRng::GLOBAL );
+	float scale0 = globalRng.nextFloat( 0.9f, 1.25f );
+	float scale1 = globalRng.nextFloat( 0.7f, 0.8f );
+	
+	// sometimes make them really big
+	if( globalRng.nextFloat( 0.0f, 100.0f ) < 7.0f ){
+		scale0 = globalRng.nextFloat( 2.8f, 3.3f );
+	}
+
+	
+	// prepare min&max to calculate the new bounds
+	vec3 min = vec3( 10000000.0f ), max = vec3( -10000000.0f );
+	
+	// either combine all the instances into one model or only keep the
+	// instances. opengl instancing is not always a win, baking costs memory
+	// and cpu time per vertex but has less data and instructions per vertex
+	
+	// first pass: pick the model, orientation and scale of every tree
+	// and count what the baked mesh will need
+	arena->resize( &arena->mTrees, numTrees );
+	size_t numVertices = 0, numIndices = 0, numTriangles = 0;
+	int j = 0;
+	for( auto p : positions ){
+		// extra density to influence the scale of objects
+		vec2 mapPos			= vec2( p.x, p.z ) + vec2( tileArea.getUL() );
+		float floraDensity	= 1.0 - glm::clamp( floraMap->getValue( mapPos ), 0.0f, 1.0f );
+		floraDensity		= glm::clamp( floraDensity + 0.5f, 0.0f, 1.0f );
 		
-		// prepare min&max to calculate the new bounds
-		vec3 min = vec3( 10000000.0f ), max = vec3( -10000000.0f );
-		
-		// Combine all the instances into one model
-		// opengl instancing is not always a win, in this case it's not because
-		// of the high amount of data and instructions per vertex
-		
+		// get translation
 #ifdef HIGH_QUALITY_ANIMATIONS
-		data->mTriMesh = TriMesh::create( TriMesh::Format().positions().texCoords0(2).texCoords1(4) );
+		mat4 translation	= glm::translate( mat4(1.0f), p + offset );
 #else
-		data->mTriMesh = TriMesh::create( TriMesh::Format().positions().texCoords0(3) );
+		mat4 translation	= glm::translate( mat4(1.0f), vec3(0) );
 #endif
-		int j = 0;
-		for( auto p : positions ){
-			// extra density to influence the scale of objects
-			vec2 mapPos			= vec2( p.x, p.z ) + vec2( tileArea.getUL() );
-			float floraDensity	= 1.0 - glm::clamp( floraMap->getValue( mapPos ), 0.0f, 1.0f );
-			floraDensity		= glm::clamp( floraDensity + 0.5f, 0.0f, 1.0f );
+		
+		// pick the model, its orientation and its scale
+		size_t model;
+		quat rotation;
+		float scale;
+		float species = sampleSpeciesField( mapPos );
+		if( species > mTilePopulationBalance ){
+			model		= rnd.nextInt( 0, 2 );
+			float yaw	= rnd.nextFloat( 0.1f, 4.0f );
+			float pitch	= rnd.nextFloat( 0.01f, 0.1f );
+			float roll	= rnd.nextFloat( 0.01f, 0.1f );
+			rotation	= normalize( quat( glm::eulerAngleYXZ( yaw, pitch, roll ) ) );
+			scale		= floraDensity * scale0 * rnd.nextFloat( 5, 20 );//  15, 60 ) ) );
 			
-			// get translation
-#ifdef HIGH_QUALITY_ANIMATIONS
-			mat4 translation	= glm::translate( mat4(1.0f), p + offset );
-#else
-			mat4 translation	= glm::translate( mat4(1.0f), vec3(0) );
-#endif
+			if( rnd.nextFloat( 0.0f, 100.0f ) < 0.5f ){
+				model	= 2;
+			}
+		}
+		else {
+			model		= rnd.nextInt( 3, 5 );
+			float yaw	= rnd.nextFloat( 0.1f, 4.0f );
+			float pitch	= rnd.nextFloat( 0.01f, 0.075f );
+			float roll	= rnd.nextFloat( 0.01f, 0.075f );
+			rotation	= normalize( quat( glm::eulerAngleYXZ( yaw, pitch, roll ) ) );
+			scale		= floraDensity * scale1 * rnd.nextFloat( 8, 15 );
 			
-			float k = perlin.fBm( ( vec3( mNoiseSeed ) + p + offset ) * 0.001f );
-			if( k > mTilePopulationBalance ){
-				size_t k			= rnd.nextInt( 0, 2 );
-				mat4 rotation		= glm::toMat4( normalize( quat( glm::eulerAngleYXZ( rnd.nextFloat(0.1,4.0), rnd.nextFloat(0.01,0.1), rnd.nextFloat(0.01,0.1) ) ) ) );
-				mat4 scale			= glm::scale( mat4(1.0f), floraDensity * scale0 * vec3( rnd.randFloat( 5, 20 ) ) );//  15, 60 ) ) );
-				mat4 transform		= translation * rotation * scale;
-				
-				if( rnd.nextFloat( 0.0f, 100.0f ) < 0.5f ){
-					k		= 2;
-					scale	= glm::scale( mat4(1.0f), vec3(0.5f) );
-				}
-				
-				// transform vertices
-				vec3* vertices = mPopulationMeshes[k].getPositions<3>();
-#ifdef HIGH_QUALITY_ANIMATIONS
-				vec4* centers = mPopulationMeshes[k].getTexCoords1<4>();
-#endif
-				vector<vec3> texcoords;
-				vector<vec3> transformedVertices;
-				vector<vec4> transformedTrianglesCenters;
-				size_t indiceOffset = data->mTriMesh->getNumVertices();
-				for( size_t i = 0; i < mPopulationMeshes[k].getNumVertices(); ++i ){
-					vec2 uv = ( vec2( p.x, p.z ) + vec2( offset.x, offset.z ) ) / vec2( mSize );
-					texcoords.push_back( vec3( uv.x, uv.y, (float) j / (float) positions.size() ) );
-					vec3 pos = vec3( transform * vec4( vertices[i], 1.0f ) );
-					transformedVertices.push_back( pos );
-					if( p.x + pos.x < min.x ) min.x = p.x + pos.x;
-					if( p.y + pos.y < min.y ) min.y = p.y + pos.y;
-					if( p.z + pos.z < min.z ) min.z = p.z + pos.z;
-					if( p.x + pos.x > max.x ) max.x = p.x + pos.x;
-					if( p.y + pos.y > max.y ) max.y = p.y + pos.y;
-					if( p.z + pos.z > max.z ) max.z = p.z + pos.z;
-					
+			if( rnd.nextFloat( 0.0f, 100.0f ) < 2.5f ){
+				model	= 5;
+			}
+		}
+		
+		TreeInstance &tree	= arena->mTrees[j];
+		tree.mPosition		= p;
+		tree.mImportance	= scale * importanceRng.nextFloat( 0.5f, 1.0f );
+		tree.mModel			= model;
+		tree.mRotation		= rotation;
+		tree.mScale			= scale;
+		tree.mTransform		= translation * glm::toMat4( rotation ) * glm::scale( mat4(1.0f), vec3( scale ) );
+		tree.mUv			= ( vec2( p.x, p.z ) + vec2( offset.x, offset.z ) ) / vec2( mSize );
+		tree.mDelay			= (float) j / (float) numTrees;
+		
+		numVertices			+= mPopulationMeshes[model].getNumVertices();
+		numIndices			+= mPopulationMeshes[model].getNumIndices();
 #ifdef HIGH_QUALITY_ANIMATIONS
-					transformedTrianglesCenters.push_back( vec4( vec3( transform * vec4( vec3( centers[i] ), 1.0f ) ), ( centers[i].w + indiceOffset / (float) mPopulationMeshes[k].getNumVertices() ) / (float) positions.size() ) );
+		numTriangles		+= mPopulationTriangles[model].size();
 #endif
-				}
-				// offset indices
-				const vector<uint32_t> indices = mPopulationMeshes[k].getIndices();
-				vector<uint32_t> transformedIndices;
-				for( size_t i = 0; i < mPopulationMeshes[k].getNumIndices(); ++i ){
-					transformedIndices.push_back( indiceOffset + indices[i] );
-				}
-				// combine mesh with the main one
-				data->mTriMesh->appendIndices( &transformedIndices[0], transformedIndices.size() );
-				data->mTriMesh->appendPositions( &transformedVertices[0], transformedVertices.size() );
-				data->mTriMesh->appendTexCoords0( &texcoords[0], texcoords.size() );
+		j++;
+	}
+	
+	// emit the trees by importance, mostly the big ones first with some randomness so
+	// the distant tiles can draw only the beginning of their batch and keep an even cover
+	std::stable_sort( arena->mTrees.begin(), arena->mTrees.end(), []( const TreeInstance &lhs, const TreeInstance &rhs ){
+		return lhs.mImportance > rhs.mImportance;
+	} );
+	
+	// the trees are kept in a spatial index for the queries and picking
+	auto &indexTrees = arena->mIndexTrees;
+	arena->resize( &indexTrees, numTrees );
+	auto indexTree = [&]( size_t t, const vec3 &treeMin, const vec3 &treeMax, size_t firstVertex, size_t numVertices ){
+		const TreeInstance &tree	= arena->mTrees[t];
+		vec2 position				= vec2( tree.mPosition.x + offset.x, tree.mPosition.z + offset.z );
+		TreeIndex::Tree &indexTree	= indexTrees[t];
+		indexTree.mPosition			= position;
+		indexTree.mGroundHeight		= heightMap->getValue( position );
+		indexTree.mRadius			= 0.5f * glm::max( treeMax.x - treeMin.x, treeMax.z - treeMin.z );
+		indexTree.mTop				= treeMax.y;
+		indexTree.mModel			= tree.mModel;
+		indexTree.mFirstVertex		= firstVertex;
+		indexTree.mNumVertices		= numVertices;
+	};
+	
+	if( populationMode == PopulationMode::INSTANCED ){
+		// only store the instances and grow the bounds with the transformed models bounds
+		data->mInstancesData.mInstances.reserve( numTrees );
+		for( size_t t = 0; t < numTrees; ++t ){
+			const TreeInstance &tree = arena->mTrees[t];
+			data->mInstancesData.addInstance( tree.mModel, tree.mUv, tree.mDelay, tree.mRotation, tree.mScale );
+			AxisAlignedBox bounds = mPopulationModels[tree.mModel]->getBounds().transformed( tree.mTransform );
+			indexTree( t, bounds.getMin(), bounds.getMax(), 0, 0 );
+			min = glm::min( min, tree.mPosition + bounds.getMin() );
+			max = glm::max( max, tree.mPosition + bounds.getMax() );
+		}
+		data->mInstancesData.sort();
+	}
+	else {
+		// second pass: transform every tree straight into the
+		// arena buffers, they only grow when a tile needs more
+		arena->resize( &arena->mPositions, numVertices );
+		arena->resize( &arena->mTexCoords, numVertices );
+		arena->resize( &arena->mIndices, numIndices );
+		arena->resize( &arena->mTriangles, numTriangles );
+		size_t vertexOffset = 0, indexOffset = 0;
 #ifdef HIGH_QUALITY_ANIMATIONS
-				data->mTriMesh->appendTexCoords1( &transformedTrianglesCenters[0], transformedTrianglesCenters.size() );
+		size_t triangleOffset = 0;
 #endif
-				//data->numTrees++;
-			}
-			else {
-			 size_t k			= rnd.nextInt( 3, 5 );
-			 mat4 rotation		= glm::toMat4( normalize( quat( glm::eulerAngleYXZ( rnd.nextFloat(0.1,4.0), rnd.nextFloat(0.01,0.075), rnd.nextFloat(0.01,0.075) ) ) ) );
-			 mat4 scale			= glm::scale( mat4(1.0f),floraDensity * scale1 * vec3( rnd.randFloat( 8, 15 ) ) );
-			 mat4 transform		= translation * rotation * scale;
-			 
-			 
-			 if( rnd.nextFloat( 0.0f, 100.0f ) < 2.5f ){
-				k		= 5;
-				scale	= glm::scale( mat4(1.0f), vec3(1.0f) );
+		data->mIndexCounts.reserve( arena->mMaxTrees );
+		data->mIndexCounts.resize( numTrees );
+		for( size_t t = 0; t < numTrees; ++t ){
+			const TreeInstance &tree	= arena->mTrees[t];
+			const vec3 &p				= tree.mPosition;
+			auto &mesh					= mPopulationMeshes[tree.mModel];
+			const uint32_t* indices		= mesh.getIndices().data();
+			size_t meshNumVertices		= mesh.getNumVertices();
+			size_t meshNumIndices		= mesh.getNumIndices();
+			vec3 texCoord				= vec3( tree.mUv, tree.mDelay );
+			
+			// transform vertices in batches and fill the per-tree constant attributes
+			vec3 treeMin = vec3( 10000000.0f ), treeMax = vec3( -10000000.0f );
+			VertexTransform::transformAffine( mPopulationPositions[tree.mModel], tree.mTransform, &arena->mPositions[vertexOffset], &treeMin, &treeMax );
+			VertexTransform::fill( &arena->mTexCoords[vertexOffset], meshNumVertices, texCoord );
+			min = glm::min( min, p + treeMin );
+			max = glm::max( max, p + treeMax );
+			indexTree( t, treeMin, treeMax, vertexOffset, meshNumVertices );
+			// offset indices
+			for( size_t i = 0; i < meshNumIndices; ++i ){
+				arena->mIndices[indexOffset + i] = vertexOffset + indices[i];
 			}
-			 
-			 // transform vertices
-			 vec3* vertices = mPopulationMeshes[k].getPositions<3>();
 #ifdef HIGH_QUALITY_ANIMATIONS
-			 vec4* centers = mPopulationMeshes[k].getTexCoords1<4>();
+			// and the triangles centers and ids
+			for( const auto &center : mPopulationTriangles[tree.mModel] ){
+				arena->mTriangles[triangleOffset++] = vec4( vec3( tree.mTransform * vec4( vec3( center ), 1.0f ) ), ( center.w + vertexOffset / (float) meshNumVertices ) / (float) numTrees );
+			}
 #endif
-			 vector<vec3> texcoords;
-			 vector<vec3> transformedVertices;
-			 vector<vec4> transformedTrianglesCenters;
-			 size_t indiceOffset = data->mTriMesh->getNumVertices();
-			 for( size_t i = 0; i < mPopulationMeshes[k].getNumVertices(); ++i ){
-					vec2 uv = ( vec2( p.x, p.z ) + vec2( offset.x, offset.z ) ) / vec2( mSize );
-					texcoords.push_back( vec3( uv.x, uv.y, (float) j / (float) positions.size() ) );
-					vec3 pos = vec3( transform * vec4( vertices[i], 1.0f ) );
-					transformedVertices.push_back( pos );
-					if( p.x + pos.x < min.x ) min.x = p.x + pos.x;
-					if( p.y + pos.y < min.y ) min.y = p.y + pos.y;
-					if( p.z + pos.z < min.z ) min.z = p.z + pos.z;
-					if( p.x + pos.x > max.x ) max.x = p.x + pos.x;
-					if( p.y + pos.y > max.y ) max.y = p.y + pos.y;
-					if( p.z + pos.z > max.z ) max.z = p.z + pos.z;
-				 
-#ifdef HIGH_QUALITY_ANIMATIONS
-					transformedTrianglesCenters.push_back( vec4( vec3( transform * vec4( vec3( centers[i] ), 1.0f ) ), ( centers[i].w + indiceOffset / (float) mPopulationMeshes[k].getNumVertices() ) / (float) positions.size() ) );
+			vertexOffset	+= meshNumVertices;
+			indexOffset		+= meshNumIndices;
+			data->mIndexCounts[t] = indexOffset;
+		}
+		
+#ifndef HIGH_QUALITY_ANIMATIONS
+		// the impostors read the same compact instances as the instanced mode
+		data->mInstancesData.mInstances.reserve( numTrees );
+		for( size_t t = 0; t < numTrees; ++t ){
+			const TreeInstance &tree = arena->mTrees[t];
+			data->mInstancesData.addInstance( tree.mModel, tree.mUv, tree.mDelay, tree.mRotation, tree.mScale );
+		}
 #endif
-			 }
-			 // offset indices
-			 const vector<uint32_t> indices = mPopulationMeshes[k].getIndices();
-			 vector<uint32_t> transformedIndices;
-			 for( size_t i = 0; i < mPopulationMeshes[k].getNumIndices(); ++i ){
-				 transformedIndices.push_back( indiceOffset + indices[i] );
-			 }
-			 // combine mesh with the main one
-			 data->mTriMesh->appendIndices( &transformedIndices[0], transformedIndices.size() );
-			 data->mTriMesh->appendPositions( &transformedVertices[0], transformedVertices.size() );
-			 data->mTriMesh->appendTexCoords0( &texcoords[0], texcoords.size() );
+	}
+	
+	data->mBounds	= AxisAlignedBox( min + offset, max + offset );
+	// the index keeps its own copy, the arena keeps its capacity for the next tile
+	data->mTreeIndex.build( indexTrees );
+	if( populationMode == PopulationMode::BAKED ){
 #ifdef HIGH_QUALITY_ANIMATIONS
-			 data->mTriMesh->appendTexCoords1( &transformedTrianglesCenters[0], transformedTrianglesCenters.size() );
+		data->mMeshData	= PackedMesh::packPopulationMesh( arena->mPositions.data(), arena->mTexCoords.data(), numVertices, arena->mIndices.data(), numIndices, arena->mTriangles );
+#else
+		data->mMeshData	= PackedMesh::packPopulationMesh( arena->mPositions.data(), arena->mTexCoords.data(), numVertices, arena->mIndices.data(), numIndices );
 #endif
-		 }
-			j++;
-		}
-		
-		data->mBounds = AxisAlignedBox( min + offset, max + offset );
-		
-		// add a small delay to make sure all threads don't come back at the same time
-		this_thread::sleep_for( chrono::milliseconds( 10 * ( start + 20 ) ) );
-		
-		// send back to the main thread
-		mTilesPopulationBuffer->pushFront( data );
 	}
+	
+	return data;
 }
+
 void Terrain::updateTilesBounds()
 {
 	auto heightMap			= getHeightChannel();
 	Area tileArea			= Area( ivec2(0), ivec2( vec2( mSize ) / (float) getNumTilesPerRow() ) );
-	vector<vec2> samples	= poissonDiskDistribution( 8.0f / 1024.0f * mSize.x, tileArea );
+	CounterRng samplesRng( mNoiseSeed, 0, CounterRng::BOUNDS_SAMPLES );
+	vector<vec2> samples	= PoissonDisk::distribution( &samplesRng, 8.0f / 1024.0f * mSize.x, tileArea );
 	for( auto tile : mTiles ){
 		tile->updateBounds( samples, heightMap, mArea );
 	}
+	mTilesBoundsDirty = true;
+}
+
+void Terrain::updateTileParams()
+{
+	// two texels per tile: the position scale and the progress, then the position offset
+	size_t numTiles = getNumTilesPerRow() * getNumTilesPerRow();
+	size_t firstRow = numTiles, lastRow = 0;
+	if( ! mTileParamsTexture || mTileParamsTexture->getHeight() != (int) numTiles ){
+		auto format = gl::Texture2d::Format().internalFormat( GL_RGBA32F ).dataType( GL_FLOAT ).minFilter( GL_NEAREST ).magFilter( GL_NEAREST ).mipmap( false );
+		mTileParamsTexture = gl::Texture2d::create( 2, (int) numTiles, format );
+		mTileParams.assign( numTiles * 2, vec4( 0.0f ) );
+		firstRow = 0;
+		lastRow = numTiles - 1;
+	}
+	
+	// only the rows of the tiles that moved or animated since the last upload are sent
+	for( const auto &tile : mTiles ){
+		uint32_t tileId = (uint32_t) tile->getTileId();
+		if( mTileMeshArena->contains( tileId ) ){
+			vec4 scale	= vec4( mTileMeshArena->getPositionScale( tileId ), tile->mTerrainCompletion );
+			vec4 offset	= vec4( mTileMeshArena->getPositionOffset( tileId ), 0.0f );
+			if( scale != mTileParams[tileId * 2] || offset != mTileParams[tileId * 2 + 1] ){
+				mTileParams[tileId * 2]		= scale;
+				mTileParams[tileId * 2 + 1]	= offset;
+				firstRow	= glm::min( firstRow, (size_t) tileId );
+				lastRow		= glm::max( lastRow, (size_t) tileId );
+			}
+		}
+	}
+	if( firstRow <= lastRow ){
+		mTileParamsTexture->update( &mTileParams[firstRow * 2], GL_RGBA, GL_FLOAT, 0, 2, (int) ( lastRow - firstRow + 1 ), ivec2( 0, (int) firstRow ) );
+	}
+}
+
+void Terrain::setOcclusionMode( OcclusionMode mode )
+{
+	mOcclusionMode = mode;
+	
+	// the queries of the frames before the switch are stale
+	if( mOcclusionMode == OcclusionMode::GPU_QUERIES ){
+		for( auto tile : mTiles ){
+			tile->resetOccludedFrameCount();
+		}
+	}
+	// and the rasterizer threads are only started the first time they are needed
+	else if( mOcclusionMode == OcclusionMode::SOFTWARE ){
+		if( ! mSoftwareOcclusion ){
+			mSoftwareOcclusion = SoftwareOcclusion::create();
+		}
+		updateOccluders();
+	}
+}
+
+void Terrain::updateOccluders()
+{
+	if( mSoftwareOcclusion && mTrianglesHeightMap[mHeightMapCurrent] ){
+		vector<vec3> positions;
+		vector<uint32_t> indices;
+		buildOccluderGrid( getTrianglesHeightChannel(), sOccluderGridSize, &positions, &indices );
+		mSoftwareOcclusion->setOccluders( std::move( positions ), std::move( indices ) );
+	}
+}
+
+void Terrain::updatePvs( bool tilesSettled, bool boundsChanged )
+{
+	// adopt the sets once built, unless the tiles changed in the meantime
+	if( mPvsJob.valid() && mPvsJob.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready ){
+		RoadPvs pvs = mPvsJob.get();
+		if( ! mPvsDirty ){
+			mRoadPvs = std::move( pvs );
+			CI_LOG_V( "Road PVS " << mRoadPvs.getNumSegments() << " segments, " << mRoadPvs.getSize() / 1024 << "kb, " << mRoadPvs.getBuildTime() << "ms" );
+		}
+	}
+	
+	// and only start a new build once the tiles stopped changing for a frame
+	BSpline3f spline = getRoadSpline3d();
+	if( mPvsDirty && tilesSettled && ! boundsChanged && ! mPvsJob.valid() && spline.getNumControlPoints() > 3 ){
+		vector<RoadPvs::Tile> tiles;
+		tiles.reserve( mTiles.size() );
+		for( const auto &tile : mTiles ){
+			tiles.push_back( { tile->getTileId(), tile->getTerrainBounds( getElevation() ), tile->getPopulationBounds( getElevation() ) } );
+		}
+		mPvsJob		= std::async( std::launch::async, &RoadPvs::build, spline, getElevation(), sPvsEyeHeight, std::move( tiles ), mTileQuadtree.getNumTiles(), sPvsInterval );
+		mPvsDirty	= false;
+	}
+}
+
+void Terrain::buildOcclusionGeometry()
+{
+	// the pass is skipped when the program or its box uniforms are missing
+	mOcclusionBoxMin	= UniformHandle<vec3>( mOcclusionShader, "uBoxMin" );
+	mOcclusionBoxSize	= UniformHandle<vec3>( mOcclusionShader, "uBoxSize" );
+	if( ! mOcclusionBoxMin.isValid() || ! mOcclusionBoxSize.isValid() ){
+		CI_LOG_E( "The occlusion queries need the uBoxMin and uBoxSize uniforms" );
+		return;
+	}
+	
+	// the corners of the unit cube, stretched over each box by the shader
+	const vec3 corners[8] = { vec3( 0, 0, 0 ), vec3( 1, 0, 0 ), vec3( 1, 1, 0 ), vec3( 0, 1, 0 ), vec3( 0, 0, 1 ), vec3( 1, 0, 1 ), vec3( 1, 1, 1 ), vec3( 0, 1, 1 ) };
+	const uint8_t indices[36] = {
+		0, 2, 1, 0, 3, 2,	4, 5, 6, 4, 6, 7,
+		0, 1, 5, 0, 5, 4,	3, 7, 6, 3, 6, 2,
+		0, 4, 7, 0, 7, 3,	1, 2, 6, 1, 6, 5
+	};
+	mOcclusionCubeVbo	= gl::Vbo::create( GL_ARRAY_BUFFER, sizeof( corners ), corners, GL_STATIC_DRAW );
+	mOcclusionCubeIbo	= gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, sizeof( indices ), indices, GL_STATIC_DRAW );
+	
+	mOcclusionVao = gl::Vao::create();
+	gl::ScopedVao scopedVao( mOcclusionVao );
+	int positionLocation = mOcclusionShader->getAttribSemanticLocation( geom::Attrib::POSITION );
+	if( positionLocation >= 0 ){
+		gl::ScopedBuffer scopedCube( mOcclusionCubeVbo );
+		gl::enableVertexAttribArray( positionLocation );
+		gl::vertexAttribPointer( positionLocation, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid*) 0 );
+	}
+	mOcclusionCubeIbo->bind();
+}
+
+void Terrain::updateAtmosphere( const CameraPersp &camera )
+{
+	// the atmosphere parameters only change through the setters
+	if( mAtmosphereDirty ){
+		mAtmosphere.mFogColor			= vec3( mFogColor );
+		mAtmosphere.mFogDensity			= mFogDensity;
+		mAtmosphere.mSunColor			= vec3( mSunColor );
+		mAtmosphere.mSunDispertion		= mSunDispertion;
+		mAtmosphere.mInscatteringCoeffs	= mSunScatteringCoeffs;
+		mAtmosphere.mSunIntensity		= mSunIntensity;
+		mAtmosphereUbo->bufferSubData( 0, offsetof( AtmosphereBlock, mSunDirection ), &mAtmosphere );
+		mAtmosphereDirty = false;
+	}
+	
+	// the rest follows the camera and the time
+	mAtmosphere.mSunDirection	= normalize( vec3( camera.getViewMatrix() * vec4( mSunDirection, 0 ) ) );
+	mAtmosphere.mElapsedTime	= (float) app::getElapsedSeconds();
+	mAtmosphere.mCameraPosition	= camera.getEyePoint();
+	mAtmosphere.mPadding		= 0.0f;
+	mAtmosphereUbo->bufferSubData( offsetof( AtmosphereBlock, mSunDirection ), sizeof( AtmosphereBlock ) - offsetof( AtmosphereBlock, mSunDirection ), &mAtmosphere.mSunDirection );
+	mAtmosphereUbo->bindBufferBase( sAtmosphereBinding );
+}
+
+Terrain::TileUniforms::TileUniforms( const gl::GlslProgRef &shader )
+: mHeightMap( shader, "uHeightMap" ), mHeightMapTemp( shader, "uHeightMapTemp" ), mFlora( shader, "uFlora" ),
+mNoiseLookupTable( shader, "uNoiseLookupTable" ), mImpostorAtlas( shader, "uImpostorAtlas" ), mTileParams( shader, "uTileParams" ),
+mElevation( shader, "uElevation" ), mHeightMapProgression( shader, "uHeightMapProgression" ), mProgress( shader, "uProgress" ),
+mTime( shader, "uTime" ), mTouchSize( shader, "uTouchSize" ),
+mHeightMapSize( shader, "uHeightMapSize" ), mImpostorDistances( shader, "uImpostorDistances" ), mImpostorGridSize( shader, "uImpostorGridSize" ),
+mPositionScale( shader, "uPositionScale" ), mPositionOffset( shader, "uPositionOffset" ), mEyePosition( shader, "uEyePosition" ), mTouch( shader, "uTouch" ),
+mImpostorExtents( shader, "uImpostorExtents" )
+{
 }
 
 // MARK: Heightmap / terrain generation
@@ -1285,6 +2211,7 @@ void Terrain::generateHeightMap()
 {
 	// swap the things we need to interpolate between ( textures, bounds and splines )
 	for( auto tile : mTiles ) tile->swapBounds();
+	mTilesBoundsDirty = true;
 	swap( mHeightMap[mHeightMapCurrent], mHeightMap[mHeightMapTemp] );
 	swap( mRoadSpline3d[mHeightMapCurrent], mRoadSpline3d[mHeightMapTemp] );
 	
@@ -1304,6 +2231,13 @@ void Terrain::generateHeightMap()
 	auto meshDensityShader		= loadShader( "Passtrough", "DensityMap" );
 	auto floraDensityShader		= loadShader( "Passtrough", "FloraDensity" );
 	
+	// the sobel and blur passes are repeated for every map and blur iteration
+	UniformHandle<vec2> sobelInvSize( sobelShader, "uInvSize" );
+	UniformHandle<int> sobelReadTexture( sobelShader, "uReadTexture" );
+	UniformHandle<vec2> kawaseBlurInvSize( kawaseBlurShader, "uInvSize" );
+	UniformHandle<int> kawaseBlurReadTexture( kawaseBlurShader, "uReadTexture" );
+	UniformHandle<float> kawaseBlurIteration( kawaseBlurShader, "uIteration" );
+	
 	// MARK: Fbo setup
 	//-----------------------------------------------------
 	// setup ping pong fbo. we use two fbo instead of one to make it ES3 compatible
@@ -1369,8 +2303,8 @@ void Terrain::generateHeightMap()
 		gl::ScopedMatrices matrices;
 		gl::setMatricesWindow( currentFbo->getSize() );
 		
-		sobelShader->uniform( "uInvSize", vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
-		sobelShader->uniform( "uReadTexture", 0 );
+		sobelInvSize.set( vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
+		sobelReadTexture.set( 0 );
 		
 		gl::drawSolidRect( currentFbo->getBounds() );
 		
@@ -1387,9 +2321,9 @@ void Terrain::generateHeightMap()
 			gl::ScopedMatrices matrices;
 			gl::setMatricesWindow( currentFbo->getSize() );
 			
-			kawaseBlurShader->uniform( "uInvSize", vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
-			kawaseBlurShader->uniform( "uReadTexture", 0 );
-			kawaseBlurShader->uniform( "uIteration", static_cast<float>( i ) );
+			kawaseBlurInvSize.set( vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
+			kawaseBlurReadTexture.set( 0 );
+			kawaseBlurIteration.set( static_cast<float>( i ) );
 			
 			gl::drawSolidRect( currentFbo->getBounds() );
 		}
@@ -1478,9 +2412,9 @@ void Terrain::generateHeightMap()
 			gl::ScopedMatrices matrices;
 			gl::setMatricesWindow( currentFbo->getSize() );
 			
-			kawaseBlurShader->uniform( "uInvSize", vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
-			kawaseBlurShader->uniform( "uReadTexture", 0 );
-			kawaseBlurShader->uniform( "uIteration", static_cast<float>( i ) );
+			kawaseBlurInvSize.set( vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
+			kawaseBlurReadTexture.set( 0 );
+			kawaseBlurIteration.set( static_cast<float>( i ) );
 			
 			gl::drawSolidRect( currentFbo->getBounds() );
 		}
@@ -1509,9 +2443,9 @@ void Terrain::generateHeightMap()
 			gl::ScopedMatrices matrices;
 			gl::setMatricesWindow( currentFbo->getSize() );
 			
-			kawaseBlurShader->uniform( "uInvSize", vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
-			kawaseBlurShader->uniform( "uReadTexture", 0 );
-			kawaseBlurShader->uniform( "uIteration", static_cast<float>( i ) );
+			kawaseBlurInvSize.set( vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
+			kawaseBlurReadTexture.set( 0 );
+			kawaseBlurIteration.set( static_cast<float>( i ) );
 			
 			gl::drawSolidRect( currentFbo->getBounds() );
 		}
@@ -1574,8 +2508,8 @@ void Terrain::generateHeightMap()
 		gl::ScopedMatrices matrices;
 		gl::setMatricesWindow( currentFbo->getSize() );
 		
-		sobelShader->uniform( "uInvSize", vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
-		sobelShader->uniform( "uReadTexture", 0 );
+		sobelInvSize.set( vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
+		sobelReadTexture.set( 0 );
 		
 		gl::drawSolidRect( currentFbo->getBounds() );
 		
@@ -1592,9 +2526,9 @@ void Terrain::generateHeightMap()
 			gl::ScopedMatrices matrices;
 			gl::setMatricesWindow( currentFbo->getSize() );
 			
-			kawaseBlurShader->uniform( "uInvSize", vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
-			kawaseBlurShader->uniform( "uReadTexture", 0 );
-			kawaseBlurShader->uniform( "uIteration", static_cast<float>( i ) );
+			kawaseBlurInvSize.set( vec2( 1.0f ) / vec2( currentFbo->getSize() ) );
+			kawaseBlurReadTexture.set( 0 );
+			kawaseBlurIteration.set( static_cast<float>( i ) );
 			
 			gl::drawSolidRect( currentFbo->getBounds() );
 		}
@@ -1672,9 +2606,22 @@ void Terrain::generateTriangleHeightMap()
 	swap( mTrianglesHeightMap[mHeightMapCurrent], mTrianglesHeightMap[mHeightMapTemp] );
 	
 	// create a shader that will output the actual height at each pixel
+#ifdef HIGH_QUALITY_ANIMATIONS
+	auto shader = loadShader( "TriangleHeightMapHigh", "TriangleHeightMap" );
+#else
 	auto shader = loadShader( "TriangleHeightMap" );
+#endif
 	
 	if( shader ){
+		// resolve the uniforms once for this regeneration
+		UniformHandle<int> heightMapSampler( shader, "uHeightMap" );
+#ifndef HIGH_QUALITY_ANIMATIONS
+		UniformHandle<int> tileParamsSampler( shader, "uTileParams" );
+#else
+		UniformHandle<vec3> positionScale( shader, "uPositionScale" );
+		UniformHandle<vec3> positionOffset( shader, "uPositionOffset" );
+#endif
+		
 		// create texture to render our triangles. Make sure we have good precision.
 		mTrianglesHeightMap[mHeightMapCurrent] = gl::Texture2d::create( mSize.x, mSize.y, gl::Texture2d::Format().internalFormat( GL_RGBA ) );
 		
@@ -1692,7 +2639,7 @@ void Terrain::generateTriangleHeightMap()
 		// bind shader and heightmap texture
 		gl::ScopedGlslProg scopedShader( shader );
 		gl::ScopedTextureBind scopedTexture0( getHeightMap(), 0 );
-		shader->uniform( "uHeightMap", 0 );
+		heightMapSampler.set( 0 );
 		
 		// save the current matrices and setup a new one with orthographic projection
 		gl::ScopedMatrices scopedMatrices;
@@ -1704,12 +2651,34 @@ void Terrain::generateTriangleHeightMap()
 		
 		gl::rotate( M_PI_2, vec3( 1, 0, 0 ) );
 		
+		// render the gpu meshes directly. the arena keeps a vao for this shader next to the terrain one,
+		// the separate meshes are switched back to the terrain shader so the render loop doesn't have to check it
+#ifndef HIGH_QUALITY_ANIMATIONS
+		updateTileParams();
+		gl::ScopedTextureBind scopedTexture1( mTileParamsTexture, 1 );
+		tileParamsSampler.set( 1 );
+		
+		vector<uint32_t> tileIds;
 		for( auto tile : mTiles ){
-			if( tile->mTriMesh.getNumTriangles() ){
-				auto batch = gl::Batch::create( tile->mTriMesh, shader );
-				batch->draw();
+			tileIds.push_back( (uint32_t) tile->getTileId() );
+		}
+		mTileMeshArena->draw( tileIds.data(), tileIds.size(), shader );
+#else
+		for( auto tile : mTiles ){
+			if( tile->mMesh ){
+				positionScale.set( tile->mMesh->getPositionScale() );
+				positionOffset.set( tile->mMesh->getPositionOffset() );
+				tile->mMesh->replaceGlslProg( shader );
+				tile->mMesh->draw();
+				tile->mMesh->replaceGlslProg( mTileShader );
 			}
 		}
+#endif
+	}
+	
+	// the software occluders follow the triangles
+	if( mOcclusionMode == OcclusionMode::SOFTWARE ){
+		updateOccluders();
 	}
 }
 
@@ -1732,31 +2701,74 @@ Channel32fRef Terrain::getTrianglesHeightChannel()
 	return getTextureAsChannel( mTrianglesHeightMap[mHeightMapCurrent] );
 }
 
+// MARK: Trees queries
+
+const TreeIndex::Tree* Terrain::pickTree( const Ray &ray, float *distance ) const
+{
+	const TreeIndex::Tree* hit	= nullptr;
+	float closest				= 1000000.0f;
+	for( const auto &tile : mTiles ){
+		// skip the tiles the ray can't reach before the current hit
+		float tileMin, tileMax;
+		if( tile->getBounds( getElevation() ).intersect( ray, &tileMin, &tileMax ) == 0 || glm::max( tileMin, 0.0f ) > closest )
+			continue;
+		
+		float tileDistance;
+		if( auto tree = tile->getTreeIndex().intersect( ray, getElevation(), &tileDistance, closest ) ){
+			hit		= tree;
+			closest	= tileDistance;
+		}
+	}
+	if( hit && distance ){
+		*distance = closest;
+	}
+	return hit;
+}
+
+vector<const TreeIndex::Tree*> Terrain::findTreesInRadius( const vec2 &position, float radius ) const
+{
+	vector<const TreeIndex::Tree*> trees;
+	for( const auto &tile : mTiles ){
+		// the trees are always inside their tile area
+		Rectf area = Rectf( tile->getArea() ).inflated( vec2( radius ) );
+		if( area.contains( position ) ){
+			tile->getTreeIndex().findInRadius( position, radius, &trees );
+		}
+	}
+	return trees;
+}
+
 // MARK: getters/setters
 
 void Terrain::setElevation( float elevation )
 {
 	mElevation = elevation;
+	mTilesBoundsDirty = true;
 }
 void Terrain::setFogDensity( float density )
 {
 	mFogDensity = density;
+	mAtmosphereDirty = true;
 }
 void Terrain::setFogColor( const ci::Color &color )
 {
 	mFogColor = color;
+	mAtmosphereDirty = true;
 }
 void Terrain::setSunDispertion( float dispertion )
 {
 	mSunDispertion = dispertion;
+	mAtmosphereDirty = true;
 }
 void Terrain::setSunIntensity( float intensity )
 {
 	mSunIntensity = intensity;
+	mAtmosphereDirty = true;
 }
 void Terrain::setSunColor( const ci::Color &color )
 {
 	mSunColor = color;
+	mAtmosphereDirty = true;
 }
 void Terrain::setSunDirection( const ci::vec3 &direction )
 {
@@ -1765,6 +2777,7 @@ void Terrain::setSunDirection( const ci::vec3 &direction )
 void Terrain::setSunScatteringCoeffs( const ci::vec3 &coeffs )
 {
 	mSunScatteringCoeffs = coeffs;
+	mAtmosphereDirty = true;
 }
 
 float Terrain::getFogDensity() const
@@ -25,6 +25,7 @@
 #include "cinder/gl/Shader.h"
 #include "cinder/gl/GlslProg.h"
 #include "cinder/gl/Batch.h"
+#include "cinder/gl/Ubo.h"
 #include "cinder/BSpline.h"
 #include "cinder/Channel.h"
 #include "cinder/ConcurrentCircularBuffer.h"
@@ -32,6 +33,24 @@
 #include "cinder/TriMesh.h"
 #include "cinder/Timeline.h"
 
+#include <atomic>
+#include <future>
+
+#include "HorizonCuller.h"
+#include "ImpostorPopulation.h"
+#include "InstancedPopulation.h"
+#include "MeshArena.h"
+#include "MeshOptimizer.h"
+#include "VertexTransform.h"
+#include "PackedMesh.h"
+#include "RenderList.h"
+#include "RenderQueue.h"
+#include "RoadPvs.h"
+#include "SoftwareOcclusion.h"
+#include "TileQuadtree.h"
+#include "TreeIndex.h"
+#include "UniformHandle.h"
+
 //#define HIGH_QUALITY_ANIMATIONS
 //#define WIP
 
@@ -40,8 +59,28 @@ typedef std::shared_ptr<class Terrain> TerrainRef;
 class Terrain : public std::enable_shared_from_this<Terrain>{
 public:
 
+	//! specifies what the tiles keep of their cpu mesh once uploaded to the gpu
+	enum class TileMemoryPolicy {
+		RELEASE,	//!< releases the cpu mesh, the gpu mesh is the only copy left
+		COMPACT,	//!< keeps the quantized PackedMesh::Data for cpu side queries
+		RETAIN		//!< keeps the full precision TriMesh
+	};
+	
+	//! specifies how the tiles population is stored and rendered
+	enum class PopulationMode {
+		BAKED,		//!< every tree is transformed and merged into a single mesh per tile
+		INSTANCED	//!< the tree models are shared and each tile only stores its instances
+	};
+	
+	//! specifies how the occlusion culling pass finds the hidden tiles
+	enum class OcclusionMode {
+		GPU_QUERIES,	//!< occlusion queries against the depth buffer, a tile is culled after a few occluded frames
+		SOFTWARE,		//!< the terrain is rasterized on the cpu and the tiles and their trees are culled in the same frame
+		HORIZON			//!< the tiles and their trees below the horizon of the closer tiles are culled, the cheapest
+	};
+	
 	struct Format {
-		Format() : mSize( 850 ), mElevation( 120.0f ), mNoiseOctaves( 8 ), mNoiseScale( 5.0f ), mNoiseSeed( 1 ), mRoadBlurIterations( 4 ), mBlurIterations( 15 ), mSobelBlurIterations( 5 ), mNumTilesPerRow( 5 ), mNumWorkingThreads( 8 ) {}
+		Format() : mSize( 850 ), mElevation( 120.0f ), mNoiseOctaves( 8 ), mNoiseScale( 5.0f ), mNoiseSeed( 1 ), mRoadBlurIterations( 4 ), mBlurIterations( 15 ), mSobelBlurIterations( 5 ), mNumTilesPerRow( 5 ), mNumWorkingThreads( 8 ), mTileMemoryPolicy( TileMemoryPolicy::RELEASE ), mPopulationMode( PopulationMode::BAKED ) {}
 		
 		//! specifies the size and resolution of the terrain
 		Format&	size( const ci::vec2 &size ) { mSize = size; return *this; }
@@ -59,6 +98,10 @@ public:
 		Format&	workingThreads( size_t threads ) { mNumWorkingThreads = threads; return *this; }
 		//! specifies the number of tiles per row, impacts both the performances and the threading efficiency
 		Format&	tilesPerRow( size_t tiles ) { mNumTilesPerRow = tiles; return *this; }
+		//! specifies what the tiles keep of their cpu mesh once uploaded to the gpu, defaults to TileMemoryPolicy::RELEASE
+		Format&	tileMemoryPolicy( TileMemoryPolicy policy ) { mTileMemoryPolicy = policy; return *this; }
+		//! specifies how the tiles population is stored and rendered, defaults to PopulationMode::BAKED
+		Format&	populationMode( PopulationMode mode ) { mPopulationMode = mode; return *this; }
 		
 		//! specifies the number of times the road has to be blurred before being integrated in the heightmap
 		Format&	roadBlurIterations( int iterations ) { mRoadBlurIterations = iterations; return *this; }
@@ -83,6 +126,10 @@ public:
 		size_t		getNumWorkingThreads() const { return mNumWorkingThreads; }
 		//! returns the number of tiles per row, impacts both the performances and the threading efficiency
 		size_t		getNumTilesPerRow() const { return mNumTilesPerRow; }
+		//! returns what the tiles keep of their cpu mesh once uploaded to the gpu
+		TileMemoryPolicy	getTileMemoryPolicy() const { return mTileMemoryPolicy; }
+		//! returns how the tiles population is stored and rendered
+		PopulationMode		getPopulationMode() const { return mPopulationMode; }
 		
 		//! returns the random seed to be used in the noise sum generation
 		int			getRoadBlurIterations() const { return mRoadBlurIterations; }
@@ -101,6 +148,8 @@ public:
 		int			mRoadBlurIterations;
 		int			mBlurIterations;
 		int			mSobelBlurIterations;
+		TileMemoryPolicy	mTileMemoryPolicy;
+		PopulationMode		mPopulationMode;
 	};
 	
 	//! constructs and returns a new terrain
@@ -189,50 +238,87 @@ public:
 	size_t	getNumWorkingThreads() const { return mNumWorkingThreads; }
 	//! returns the number of tiles per row, impacts both the performances and the threading efficiency
 	size_t	getNumTilesPerRow() const { return mNumTilesPerRow; }
+	//! returns what the tiles keep of their cpu mesh once uploaded to the gpu
+	TileMemoryPolicy	getTileMemoryPolicy() const { return mTileMemoryPolicy; }
+	//! sets how the tiles population is stored and rendered, takes effect on the next population. HIGH_QUALITY_ANIMATIONS always bakes the population
+	void				setPopulationMode( PopulationMode mode ) { mPopulationMode = mode; }
+	//! returns how the tiles population is stored and rendered
+	PopulationMode		getPopulationMode() const { return mPopulationMode; }
 	
 	//! represents a single tile of the terrain
 	class Tile {
 	public:
-		static std::shared_ptr<Terrain::Tile> create( size_t tileId, const ci::Area &tileArea, const ci::Area &fullArea, float contentScale, float randomSeed, const ci::Channel32fRef &heightMap, const ci::Channel32fRef &densityMap, const ci::BSpline2f &spline, size_t tilesPerRow, float elevation );
+		static std::shared_ptr<Terrain::Tile> create( size_t tileId, const ci::Area &tileArea, const ci::Area &fullArea, float contentScale, float randomSeed, const ci::Channel32fRef &heightMap, const ci::Channel32fRef &densityMap, const ci::BSpline2f &spline, size_t tilesPerRow, float elevation, const std::vector<ci::vec2> &borderSamples );
 		
 		size_t					getTileId() const { return mTileId; }
 		
-		ci::gl::BatchRef		getBatch() const { return mBatch; }
-		ci::gl::BatchRef		getPopulationBatch() const { return mPopulation[mPopulationCurrent]; }
+		PackedMeshRef			getMesh() const { return mMesh; }
+		PackedMeshRef			getPopulationMesh() const { return mPopulation[mPopulationCurrent]; }
+		//! returns the full precision cpu mesh, only kept with TileMemoryPolicy::RETAIN
+		const ci::TriMeshRef&	getTriMesh() const { return mTriMesh; }
+		//! returns the quantized cpu mesh, only kept with TileMemoryPolicy::COMPACT
+		const PackedMesh::Data&	getMeshData() const { return mMeshData; }
+		
+		//! returns the spatial index of the trees of the current population
+		const TreeIndex&		getTreeIndex() const { return mTreeIndex[mPopulationCurrent]; }
+		
+		//! returns the number of bytes used by the cpu copies of the tile mesh
+		size_t					getCpuMemoryUsage() const;
+		//! returns the number of bytes used by the gpu terrain and population meshes, the terrain meshes merged in the tiles arena aren't counted
+		size_t					getGpuMemoryUsage() const;
+		//! returns the number of bytes the terrain mesh uses in the tiles arena
+		size_t					getArenaMemoryUsage() const { return mArenaSize; }
+		//! returns the number of indices drawing the first \a density fraction of the baked population \a batch, 0 when none are
+		size_t					getPopulationNumIndices( size_t batch, float density ) const;
 		
 		ci::Area				getArea() const { return mArea; }
 		ci::vec2				getSize() const { return mSize; }
 		ci::AxisAlignedBox	getBounds( float elevation = 1.0f, float interpolation = 1.0f ) const;
+		//! returns the bounds of the terrain mesh alone, without the trees
+		ci::AxisAlignedBox	getTerrainBounds( float elevation = 1.0f ) const;
+		//! returns the bounds of the trees of the population \a batch
+		ci::AxisAlignedBox	getPopulationBounds( size_t batch, float elevation = 1.0f ) const;
+		//! returns the bounds of the trees of both populations, the ones of the terrain when there are none
+		ci::AxisAlignedBox	getPopulationBounds( float elevation = 1.0f ) const;
 		
 		//! returns whether this tile has been occluded for a certain amount of frames
 		bool isOccluded( size_t numFrames = 5 );
 		
-		Tile( size_t tileId, const ci::Area &tileArea, const ci::Area &fullArea, float contentScale, float randomSeed, const ci::Channel32fRef &heightMap, const ci::Channel32fRef &densityMap, const ci::BSpline2f &spline, size_t tilesPerRow, float elevation );
+		Tile( size_t tileId, const ci::Area &tileArea, const ci::Area &fullArea, float contentScale, float randomSeed, const ci::Channel32fRef &heightMap, const ci::Channel32fRef &densityMap, const ci::BSpline2f &spline, size_t tilesPerRow, float elevation, const std::vector<ci::vec2> &borderSamples );
 		
 		~Tile();
 		
 		void clear();
 		void clearPopulation();
+		//! removes the meshes, instances, impostors and trees of the population \a batch
+		void resetPopulation( size_t batch );
 		
 		void updateBounds( const std::vector<ci::vec2> &samples, const ci::Channel32fRef &heightMap, const ci::Area &fullArea );
 		void swapBounds();
 		
 	protected:
-		void buildMeshes( const ci::gl::GlslProgRef &shader );
-		void buildOcclusionMesh();
-		void buildPopulationMeshes( const ci::TriMeshRef &triMesh, const ci::AxisAlignedBox &bounds, const ci::gl::GlslProgRef &shader );
+		void buildMeshes( const ci::gl::GlslProgRef &shader, const MeshArenaRef &arena, TileMemoryPolicy memoryPolicy );
+		void buildPopulationMeshes( const PackedMesh::Data &meshData, const InstancedPopulation::Data &instancesData, const std::vector<uint32_t> &indexCounts, const TreeIndex &treeIndex, const ci::AxisAlignedBox &bounds, const ci::gl::GlslProgRef &shader, const ci::gl::GlslProgRef &instancedShader, const std::vector<InstancedPopulation::ModelRef> &models, const ImpostorAtlasRef &impostorAtlas, const ci::gl::GlslProgRef &impostorShader, const BufferPoolRef &bufferPool );
 		void resetOccludedFrameCount();
-		void checkOcclusion();
+		//! returns a query free to be issued and flags it as used, 0 when all of them wait for their results
+		GLuint acquireOcclusionQuery();
 		void queryOcclusionResults();
 		
 		size_t							mTileId;
 		ci::AxisAlignedBox			mBounds[2];
 		ci::vec2						mHeightRange[2];
+		ci::AxisAlignedBox			mPopulationBounds[2];
 		
-		ci::gl::BatchRef				mBatch;
-		ci::gl::BatchRef				mPopulation[2];
+		PackedMeshRef					mMesh;
+		size_t							mArenaSize;
+		PackedMeshRef					mPopulation[2];
+		InstancedPopulationRef			mInstancedPopulation[2];
+		ImpostorPopulationRef			mImpostorPopulation[2];
+		std::vector<uint32_t>			mPopulationIndexCounts[2];
+		TreeIndex						mTreeIndex[2];
 		size_t							mPopulationCurrent, mPopulationTemp;
-		ci::gl::BatchRef				mOccluderBatch;
+		//! bumped each time a batch is rebuilt so a late fade doesn't remove the new population
+		size_t							mPopulationVersion[2];
 		ci::vec3						mPosition;
 		
 		struct OcclusionQuery {
@@ -247,7 +333,9 @@ public:
 		size_t							mNumFramesOccluded;
 		ci::Area						mArea;
 		ci::vec2						mSize;
-		ci::TriMesh						mTriMesh;
+		ci::TriMeshRef					mTriMesh;
+		PackedMesh::Data				mMeshData;
+		MeshOptimizer::Stats			mMeshStats;
 		
 		int numTrees = 0;
 		
@@ -296,9 +384,44 @@ public:
 	bool isOcclusionCullingEnabled() const { return mOcclusionCullingEnabled; }
 	//! sets whether the occlusion culling pass is enabled or not
 	void setOcclusionCullingEnabled( bool enabled = true ) { mOcclusionCullingEnabled = enabled; }
+	//! returns how the occlusion culling pass finds the hidden tiles
+	OcclusionMode getOcclusionMode() const { return mOcclusionMode; }
+	//! sets how the occlusion culling pass finds the hidden tiles, defaults to OcclusionMode::GPU_QUERIES
+	void setOcclusionMode( OcclusionMode mode );
+	//! returns whether the tiles hidden from the road are looked up in the precomputed visible sets
+	bool isPvsEnabled() const { return mPvsEnabled; }
+	//! sets whether the tiles hidden from the road are looked up in the precomputed visible sets, the
+	//! other occlusion tests only run when the eye is away from the road
+	void setPvsEnabled( bool enabled = true ) { mPvsEnabled = enabled; }
+	
+	//! sets the distances at which the trees start to fade to their impostors and are fully replaced
+	void setImpostorDistances( float start, float end ) { mImpostorDistances = ci::vec2( start, end ); }
+	//! returns the distances at which the trees start to fade to their impostors and are fully replaced
+	ci::vec2 getImpostorDistances() const { return mImpostorDistances; }
+	
+	//! sets how the population thins out with distance. tiles smaller than \a projectedSize of the
+	//! screen height draw fewer trees, down to \a minDensity of them
+	void setPopulationDecimation( float projectedSize, float minDensity ) { mPopulationDecimation = ci::vec2( projectedSize, minDensity ); }
+	//! returns the projected tile size below which the population thins out and its minimum density
+	ci::vec2 getPopulationDecimation() const { return mPopulationDecimation; }
+	
+	//! returns the first tree hit by \a ray and its \a distance along the ray, nullptr if none
+	const TreeIndex::Tree*				pickTree( const ci::Ray &ray, float *distance = nullptr ) const;
+	//! returns the trees of the current population within \a radius of \a position on the xz plane
+	std::vector<const TreeIndex::Tree*>	findTreesInRadius( const ci::vec2 &position, float radius ) const;
 	
 	//! returns the total number of instances rendered in the last frame for debug
 	size_t getNumRenderedInstances() const { return mNumRenderedInstanced; }
+	//! returns the state changes of the last frame for debug
+	const RenderQueue::Stats& getRenderQueueStats() const { return mRenderQueueStats; }
+	//! returns the number of draw calls used by the terrain tiles in the last frame for debug
+	size_t getNumTileDrawCalls() const { return mTileMeshArena ? mTileMeshArena->getNumDrawCalls() : mTiles.size(); }
+	//! returns the work and the timings of the last software occlusion pass for debug
+	SoftwareOcclusion::Stats getSoftwareOcclusionStats() const { return mSoftwareOcclusion ? mSoftwareOcclusion->getStats() : SoftwareOcclusion::Stats(); }
+	//! returns the work and the timing of the last horizon culling pass for debug
+	const HorizonCuller::Stats& getHorizonCullingStats() const { return mHorizonCuller.getStats(); }
+	//! returns the visible sets along the road for debug, empty until they're built
+	const RoadPvs& getRoadPvs() const { return mRoadPvs; }
 	
 	// keep the constructor public but make it unacessible
 	// solves the private constructor std::make_shared issue
@@ -310,22 +433,142 @@ public:
 //protected:
 	
 	void updateTiles();
-	void buildTilesThreaded( size_t start, size_t end, size_t numTilesPerRow, const ci::vec2 &tileSize, const ci::Area &area, float scale, const ci::Channel32fRef &heightMap, const ci::Channel32fRef &densityMap );
+	void buildTilesThreaded( size_t workerId, size_t numTiles, size_t numTilesPerRow, const ci::vec2 &tileSize, const ci::Area &area, float scale, const ci::Channel32fRef &heightMap, const ci::Channel32fRef &densityMap, const std::vector<std::vector<ci::vec2>> &tilesBorders );
 	
 	void populateTiles();
 	void updateTilePopulating();
-	void populateTilesThreaded( size_t start, size_t end, size_t numTilesPerRow, const ci::vec2 &tileSize, const ci::Area &area, const ci::Channel32fRef &floraMap );
+	
+	//! computes the low resolution species noise field if the seed or the size changed
+	void updateSpeciesField();
+	//! returns the bilinearly interpolated species noise at \a mapPos
+	float sampleSpeciesField( const ci::vec2 &mapPos ) const;
 	
 	void updateTilesBounds();
+	//! uploads the position decoding and the animation of the tiles drawn from the arena
+	void updateTileParams();
+	//! rebuilds the software occlusion occluders from the triangles height map
+	void updateOccluders();
+	//! creates the cube drawn by the occlusion queries and resolves its box uniforms
+	void buildOcclusionGeometry();
+	//! adopts the road visible sets once built and starts a new build when the settled tiles invalidated them
+	void updatePvs( bool tilesSettled, bool boundsChanged );
+	
+	//! uploads the atmosphere uniform block, the parameters only when a setter changed them
+	void updateAtmosphere( const ci::CameraPersp &camera );
+	
+	//! std140 mirror of the Atmosphere uniform block of Fog.glsl
+	struct AtmosphereBlock {
+		ci::vec3	mFogColor;
+		float		mFogDensity;
+		ci::vec3	mSunColor;
+		float		mSunDispertion;
+		ci::vec3	mInscatteringCoeffs;
+		float		mSunIntensity;
+		// updated every frame
+		ci::vec3	mSunDirection;
+		float		mElapsedTime;
+		ci::vec3	mCameraPosition;
+		float		mPadding;
+	};
+	
+	//! handles to the uniforms set while rendering the tiles, a shader only resolves the ones it declares
+	struct TileUniforms {
+		TileUniforms() {}
+		TileUniforms( const ci::gl::GlslProgRef &shader );
+		
+		UniformHandle<int>		mHeightMap, mHeightMapTemp, mFlora, mNoiseLookupTable, mImpostorAtlas, mTileParams;
+		UniformHandle<float>	mElevation, mHeightMapProgression, mProgress, mTime, mTouchSize;
+		UniformHandle<ci::vec2>	mHeightMapSize, mImpostorDistances, mImpostorGridSize;
+		UniformHandle<ci::vec3>	mPositionScale, mPositionOffset, mEyePosition, mTouch;
+		UniformHandle<ci::vec4>	mImpostorExtents;
+	};
 	
 	struct PopulationData {
 		size_t					mTileId;
-		ci::TriMeshRef			mTriMesh;
+		PackedMesh::Data		mMeshData;
+		InstancedPopulation::Data	mInstancesData;
+		//! number of indices drawing the first n + 1 trees of the baked mesh
+		std::vector<uint32_t>	mIndexCounts;
+		TreeIndex				mTreeIndex;
 		ci::AxisAlignedBox	mBounds;
 	};
 	
 	typedef std::shared_ptr<PopulationData> PopulationDataRef;
 	
+	//! a tree chosen by the first population pass
+	struct TreeInstance {
+		ci::vec3	mPosition;
+		float		mImportance;
+		size_t		mModel;
+		ci::mat4	mTransform;
+		ci::quat	mRotation;
+		float		mScale;
+		ci::vec2	mUv;
+		float		mDelay;
+	};
+	
+	//! per worker scratch buffers reused across tiles and regenerations
+	struct PopulationArena {
+		PopulationArena() : mMaxTrees( 0 ), mNumGrowths( 0 ), mNumTiles( 0 ), mNumGrowingTiles( 0 ), mTime( 0.0 ), mGrowingTime( 0.0 ) {}
+		
+		//! resizes \a buffer to \a size and counts the times it had to allocate
+		template<typename T>
+		void resize( std::vector<T> *buffer, size_t size )
+		{
+			if( buffer->capacity() < size ) mNumGrowths++;
+			buffer->resize( size );
+		}
+		
+		std::vector<ci::vec3>		mTreePositions;
+		std::vector<TreeInstance>	mTrees;
+		std::vector<TreeIndex::Tree>	mIndexTrees;
+		std::vector<ci::vec3>		mPositions;
+		std::vector<ci::vec3>		mTexCoords;
+		std::vector<uint32_t>		mIndices;
+		std::vector<ci::vec4>		mTriangles;
+		//! the most trees seen in a tile, used to reserve the per tile outputs
+		size_t						mMaxTrees;
+		size_t						mNumGrowths;
+		//! the tiles populated and the time in milliseconds they took, split
+		//! between the ones that had to grow the arena and the ones that didn't
+		size_t						mNumTiles, mNumGrowingTiles;
+		double						mTime, mGrowingTime;
+	};
+	
+	//! a tile or a quadrant of a tile to sample, dense tiles are split so they don't hold the last worker alone
+	struct PopulationJob {
+		size_t		mTileId;
+		ci::Area	mTileArea;
+		//! the sampled region in tile space
+		ci::Rectf	mRegion;
+		size_t		mPart;
+		size_t		mNumParts;
+		//! the estimated number of trees
+		float		mCost;
+	};
+	
+	//! the jobs of a population pass, shared by all the workers
+	struct PopulationJobs {
+		//! the samples of the quadrants of a split tile
+		struct SplitTile {
+			SplitTile() : mNumDone( 0 ) {}
+			std::vector<std::vector<ci::vec2>>	mParts;
+			std::atomic<size_t>					mNumDone;
+		};
+		
+		PopulationJobs() : mNext( 0 ) {}
+		
+		std::vector<PopulationJob>					mJobs;
+		std::atomic<size_t>							mNext;
+		std::vector<std::unique_ptr<SplitTile>>		mSplitTiles;
+	};
+	
+	void populateTilesThreaded( size_t workerId, PopulationJobs *jobs, const ci::Channel32fRef &floraMap, const ci::Channel32fRef &heightMap, PopulationMode populationMode, PopulationArena *arena );
+	//! returns the poisson disk samples of a job in tile space, without the first one
+	std::vector<ci::vec2> samplePopulation( const PopulationJob &job, const ci::Channel32fRef &floraMap ) const;
+	//! picks, bakes and indexes the trees of a tile from its final \a samples
+	PopulationDataRef populateTile( size_t tileId, const ci::Area &tileArea, const std::vector<ci::vec2> &samples, const ci::Channel32fRef &floraMap, const ci::Channel32fRef &heightMap, PopulationMode populationMode, PopulationArena *arena );
+	
 	// a few useful type aliases
 	using CircularTileBuffer			= ci::ConcurrentCircularBuffer<TileRef>;
 	using CircularTileBufferRef			= std::unique_ptr<CircularTileBuffer>;
@@ -355,12 +598,22 @@ public:
 	size_t						mNumTilesPerRow;
 	size_t						mNumTilePopulated;
 	size_t						mNumWorkingThreads;
+	TileMemoryPolicy			mTileMemoryPolicy;
+	PopulationMode				mPopulationMode;
 	
 	CircularTileBufferRef		mTilesBuffer;
 	CircularPopulationBufferRef	mTilesPopulationBuffer;
 	TileWorkThreads				mWorkThreads;
+	std::atomic<size_t>			mNextTileToBuild;
+	std::vector<PopulationArena>	mPopulationArenas;
+	std::unique_ptr<PopulationJobs>	mPopulationJobs;
 	ci::signals::Connection		mUpdateTilesConnection;
 	std::vector<TileRef>		mTiles;
+	//! the same tiles indexed by their id, null until built
+	std::vector<TileRef>		mTilesById;
+	TileQuadtree				mTileQuadtree;
+	FrameAllocator				mFrameAllocator;
+	bool						mTilesBoundsDirty;
 	
 	ci::BSpline2f				mRoadSpline2d;
 	ci::BSpline3f				mRoadSpline3d[2];
@@ -376,12 +629,42 @@ public:
 	ci::gl::Texture2dRef		mFloraDensityMap;
 	ci::gl::Texture2dRef		mNoiseLookupTable;
 	
+	MeshArenaRef				mTileMeshArena;
+	std::vector<ci::vec4>		mTileParams;
+	ci::gl::Texture2dRef		mTileParamsTexture;
+	
 	ci::gl::GlslProgRef			mTileShader;
 	ci::gl::GlslProgRef			mTileContentShader;
+	ci::gl::GlslProgRef			mTileInstancedContentShader;
+	ci::gl::GlslProgRef			mTileImpostorShader;
 	ci::gl::GlslProgRef			mSkyShader;
+	TileUniforms				mTileUniforms;
+	TileUniforms				mTileContentUniforms;
+	TileUniforms				mTileInstancedContentUniforms;
+	TileUniforms				mTileImpostorUniforms;
+	UniformHandle<int>			mSkyNoiseLookupTable;
 	//ci::gl::GlslProgRef			mClearingObjectsShader;
+	ci::gl::UboRef				mAtmosphereUbo;
+	AtmosphereBlock				mAtmosphere;
+	bool						mAtmosphereDirty;
 	ci::gl::BatchRef			mSkyBatch;
+	//! the unit cube stretched over the box of each tile tested by the occlusion queries
+	ci::gl::GlslProgRef			mOcclusionShader;
+	ci::gl::VaoRef				mOcclusionVao;
+	ci::gl::VboRef				mOcclusionCubeVbo;
+	ci::gl::VboRef				mOcclusionCubeIbo;
+	UniformHandle<ci::vec3>		mOcclusionBoxMin;
+	UniformHandle<ci::vec3>		mOcclusionBoxSize;
 	std::vector<ci::TriMesh>	mPopulationMeshes;
+	std::vector<VertexTransform::Positions>	mPopulationPositions;
+	std::vector<InstancedPopulation::ModelRef>	mPopulationModels;
+	ImpostorAtlasRef			mImpostorAtlas;
+	BufferPoolRef				mPopulationBufferPool;
+	ci::vec2					mImpostorDistances;
+	ci::vec2					mPopulationDecimation;
+#ifdef HIGH_QUALITY_ANIMATIONS
+	std::vector<std::vector<ci::vec4>>	mPopulationTriangles;
+#endif
 	
 #ifdef WIP
 	//std::vector<ci::vec3>			mClearings;
@@ -399,6 +682,18 @@ public:
 	float						mTilePopulationExplosionSize;
 	float						mTilePopulationBalance;
 	
+	ci::Channel32fRef			mSpeciesField;
+	float						mSpeciesFieldSeed;
+	ci::vec2					mSpeciesFieldSize;
+	
 	bool						mOcclusionCullingEnabled;
+	OcclusionMode				mOcclusionMode;
+	SoftwareOcclusionRef		mSoftwareOcclusion;
+	HorizonCuller				mHorizonCuller;
+	RoadPvs						mRoadPvs;
+	std::future<RoadPvs>		mPvsJob;
+	bool						mPvsDirty;
+	bool						mPvsEnabled;
 	size_t						mNumRenderedInstanced;
+	RenderQueue::Stats			mRenderQueueStats;
 };
\ No newline at end of file
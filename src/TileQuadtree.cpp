@@ -0,0 +1,261 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "TileQuadtree.h"
+
+#include <algorithm>
+
+#if defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+	#include <arm_neon.h>
+	#define TILE_QUADTREE_NEON
+#elif defined( __SSE__ ) || defined( _M_X64 )
+	#include <xmmintrin.h>
+	#define TILE_QUADTREE_SSE
+#endif
+
+using namespace std;
+using namespace ci;
+
+namespace {
+	
+	//! bounds of the empty lanes, they are outside of any plane
+	const float sEmptyMin = 1e30f;
+	const float sEmptyMax = -1e30f;
+	
+	//! tests the four boxes of a node against \a plane. sets the bits of the boxes completely
+	//! behind the plane in \a outside and the ones completely in front of it in \a inside
+	template<typename Children>
+	void testPlane( const Children &c, const vec4 &plane, uint32_t *outside, uint32_t *inside )
+	{
+#if defined( TILE_QUADTREE_SSE )
+		__m128 half = _mm_set1_ps( 0.5f );
+		__m128 signMask = _mm_set1_ps( -0.0f );
+		__m128 nx = _mm_set1_ps( plane.x ), ny = _mm_set1_ps( plane.y ), nz = _mm_set1_ps( plane.z );
+		__m128 ax = _mm_andnot_ps( signMask, nx ), ay = _mm_andnot_ps( signMask, ny ), az = _mm_andnot_ps( signMask, nz );
+		__m128 minX = _mm_load_ps( c.mMinX ), minY = _mm_load_ps( c.mMinY ), minZ = _mm_load_ps( c.mMinZ );
+		__m128 maxX = _mm_load_ps( c.mMaxX ), maxY = _mm_load_ps( c.mMaxY ), maxZ = _mm_load_ps( c.mMaxZ );
+		// distance of the centers and projected radius of the extents
+		__m128 d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, _mm_mul_ps( _mm_add_ps( minX, maxX ), half ) ), _mm_mul_ps( ny, _mm_mul_ps( _mm_add_ps( minY, maxY ), half ) ) ),
+							   _mm_add_ps( _mm_mul_ps( nz, _mm_mul_ps( _mm_add_ps( minZ, maxZ ), half ) ), _mm_set1_ps( plane.w ) ) );
+		__m128 r = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, _mm_mul_ps( _mm_sub_ps( maxX, minX ), half ) ), _mm_mul_ps( ay, _mm_mul_ps( _mm_sub_ps( maxY, minY ), half ) ) ),
+							   _mm_mul_ps( az, _mm_mul_ps( _mm_sub_ps( maxZ, minZ ), half ) ) );
+		*outside	= _mm_movemask_ps( _mm_cmplt_ps( _mm_add_ps( d, r ), _mm_setzero_ps() ) );
+		*inside		= _mm_movemask_ps( _mm_cmpge_ps( _mm_sub_ps( d, r ), _mm_setzero_ps() ) );
+#elif defined( TILE_QUADTREE_NEON )
+		float32x4_t half = vdupq_n_f32( 0.5f );
+		float32x4_t nx = vdupq_n_f32( plane.x ), ny = vdupq_n_f32( plane.y ), nz = vdupq_n_f32( plane.z );
+		float32x4_t ax = vabsq_f32( nx ), ay = vabsq_f32( ny ), az = vabsq_f32( nz );
+		float32x4_t minX = vld1q_f32( c.mMinX ), minY = vld1q_f32( c.mMinY ), minZ = vld1q_f32( c.mMinZ );
+		float32x4_t maxX = vld1q_f32( c.mMaxX ), maxY = vld1q_f32( c.mMaxY ), maxZ = vld1q_f32( c.mMaxZ );
+		// distance of the centers and projected radius of the extents
+		float32x4_t d = vdupq_n_f32( plane.w );
+		d = vmlaq_f32( d, nx, vmulq_f32( vaddq_f32( minX, maxX ), half ) );
+		d = vmlaq_f32( d, ny, vmulq_f32( vaddq_f32( minY, maxY ), half ) );
+		d = vmlaq_f32( d, nz, vmulq_f32( vaddq_f32( minZ, maxZ ), half ) );
+		float32x4_t r = vmulq_f32( ax, vmulq_f32( vsubq_f32( maxX, minX ), half ) );
+		r = vmlaq_f32( r, ay, vmulq_f32( vsubq_f32( maxY, minY ), half ) );
+		r = vmlaq_f32( r, az, vmulq_f32( vsubq_f32( maxZ, minZ ), half ) );
+		// turn the comparison lanes into bits
+		static const uint32_t bits[4] = { 1, 2, 4, 8 };
+		uint32x4_t laneBits = vld1q_u32( bits );
+		uint32x4_t out = vandq_u32( vcltq_f32( vaddq_f32( d, r ), vdupq_n_f32( 0.0f ) ), laneBits );
+		uint32x4_t in = vandq_u32( vcgeq_f32( vsubq_f32( d, r ), vdupq_n_f32( 0.0f ) ), laneBits );
+		uint32x2_t outPairs = vpadd_u32( vget_low_u32( out ), vget_high_u32( out ) );
+		uint32x2_t inPairs = vpadd_u32( vget_low_u32( in ), vget_high_u32( in ) );
+		*outside	= vget_lane_u32( vpadd_u32( outPairs, outPairs ), 0 );
+		*inside		= vget_lane_u32( vpadd_u32( inPairs, inPairs ), 0 );
+#else
+		*outside = *inside = 0;
+		for( int i = 0; i < 4; ++i ){
+			float d = plane.w + plane.x * ( c.mMinX[i] + c.mMaxX[i] ) * 0.5f + plane.y * ( c.mMinY[i] + c.mMaxY[i] ) * 0.5f + plane.z * ( c.mMinZ[i] + c.mMaxZ[i] ) * 0.5f;
+			float r = glm::abs( plane.x ) * ( c.mMaxX[i] - c.mMinX[i] ) * 0.5f + glm::abs( plane.y ) * ( c.mMaxY[i] - c.mMinY[i] ) * 0.5f + glm::abs( plane.z ) * ( c.mMaxZ[i] - c.mMinZ[i] ) * 0.5f;
+			if( d + r < 0.0f ) *outside |= 1 << i;
+			if( d - r >= 0.0f ) *inside |= 1 << i;
+		}
+#endif
+	}
+	
+} // anonymous namespace
+
+TileQuadtree::TileQuadtree()
+: mNumTilesPerRow( 0 ), mDepth( 0 ), mNumNodesTested( 0 ), mDirty( false )
+{
+}
+
+void TileQuadtree::build( size_t numTilesPerRow )
+{
+	// the last level has to hold the whole grid, it is padded with empty cells
+	mNumTilesPerRow	= numTilesPerRow;
+	mDepth			= 1;
+	while( ( (size_t) 1 << mDepth ) < numTilesPerRow ) mDepth++;
+	
+	// only the inner levels have nodes, the bounds of the tiles are in the lanes of the last one
+	mLevelOffsets.clear();
+	size_t numNodes = 0;
+	for( size_t l = 0; l < mDepth; ++l ){
+		mLevelOffsets.push_back( numNodes );
+		numNodes += (size_t) 1 << ( 2 * l );
+	}
+	
+	Children empty;
+	std::fill_n( &empty.mMinX[0], 12, sEmptyMin );
+	std::fill_n( &empty.mMaxX[0], 12, sEmptyMax );
+	mNodes.assign( numNodes, empty );
+	mDirty = true;
+}
+
+void TileQuadtree::setBounds( size_t tileId, const AxisAlignedBox &bounds )
+{
+	size_t x		= tileId % mNumTilesPerRow;
+	size_t y		= tileId / mNumTilesPerRow;
+	size_t lane		= ( y & 1 ) * 2 + ( x & 1 );
+	Children &c		= getChildren( mDepth - 1, x >> 1, y >> 1 );
+	c.mMinX[lane]	= bounds.getMin().x;
+	c.mMinY[lane]	= bounds.getMin().y;
+	c.mMinZ[lane]	= bounds.getMin().z;
+	c.mMaxX[lane]	= bounds.getMax().x;
+	c.mMaxY[lane]	= bounds.getMax().y;
+	c.mMaxZ[lane]	= bounds.getMax().z;
+	mDirty			= true;
+}
+
+void TileQuadtree::refit()
+{
+	// each lane gets the union of the four lanes of its child, bottom up
+	for( size_t l = mDepth - 1; l-- > 0; ){
+		size_t size = (size_t) 1 << l;
+		for( size_t y = 0; y < size; ++y ){
+			for( size_t x = 0; x < size; ++x ){
+				Children &c = getChildren( l, x, y );
+				for( size_t lane = 0; lane < 4; ++lane ){
+					const Children &child = getChildren( l + 1, 2 * x + ( lane & 1 ), 2 * y + ( lane >> 1 ) );
+					c.mMinX[lane] = *std::min_element( child.mMinX, child.mMinX + 4 );
+					c.mMinY[lane] = *std::min_element( child.mMinY, child.mMinY + 4 );
+					c.mMinZ[lane] = *std::min_element( child.mMinZ, child.mMinZ + 4 );
+					c.mMaxX[lane] = *std::max_element( child.mMaxX, child.mMaxX + 4 );
+					c.mMaxY[lane] = *std::max_element( child.mMaxY, child.mMaxY + 4 );
+					c.mMaxZ[lane] = *std::max_element( child.mMaxZ, child.mMaxZ + 4 );
+				}
+			}
+		}
+	}
+	
+	const Children &c = getChildren( 0, 0, 0 );
+	vec3 min = vec3( *std::min_element( c.mMinX, c.mMinX + 4 ), *std::min_element( c.mMinY, c.mMinY + 4 ), *std::min_element( c.mMinZ, c.mMinZ + 4 ) );
+	vec3 max = vec3( *std::max_element( c.mMaxX, c.mMaxX + 4 ), *std::max_element( c.mMaxY, c.mMaxY + 4 ), *std::max_element( c.mMaxZ, c.mMaxZ + 4 ) );
+	mRoot = AxisAlignedBox( min, max );
+	mDirty = false;
+}
+
+AxisAlignedBox TileQuadtree::getBounds( size_t tileId ) const
+{
+	size_t x			= tileId % mNumTilesPerRow;
+	size_t y			= tileId / mNumTilesPerRow;
+	size_t lane			= ( y & 1 ) * 2 + ( x & 1 );
+	const Children &c	= getChildren( mDepth - 1, x >> 1, y >> 1 );
+	return AxisAlignedBox( vec3( c.mMinX[lane], c.mMinY[lane], c.mMinZ[lane] ), vec3( c.mMaxX[lane], c.mMaxY[lane], c.mMaxZ[lane] ) );
+}
+
+size_t TileQuadtree::cull( const mat4 &viewProjection, size_t *visible )
+{
+	mNumNodesTested = 0;
+	if( mNodes.empty() )
+		return 0;
+	if( mDirty )
+		refit();
+	
+	// extract the frustum planes from the matrix rows, the normals point inside
+	mat4 m = glm::transpose( viewProjection );
+	vec4 planes[6] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+	
+	// the root is a single box, test it like the lanes and keep the planes it crosses
+	Children root;
+	std::fill_n( &root.mMinX[0], 12, sEmptyMin );
+	std::fill_n( &root.mMaxX[0], 12, sEmptyMax );
+	root.mMinX[0] = mRoot.getMin().x; root.mMinY[0] = mRoot.getMin().y; root.mMinZ[0] = mRoot.getMin().z;
+	root.mMaxX[0] = mRoot.getMax().x; root.mMaxY[0] = mRoot.getMax().y; root.mMaxZ[0] = mRoot.getMax().z;
+	vec4 rootPlanes[6];
+	size_t numRootPlanes = 0;
+	for( const auto &plane : planes ){
+		uint32_t outside, inside;
+		testPlane( root, plane, &outside, &inside );
+		if( outside & 1 )
+			return 0;
+		if( ! ( inside & 1 ) )
+			rootPlanes[numRootPlanes++] = plane;
+	}
+	
+	size_t numVisible = 0;
+	if( numRootPlanes == 0 ){
+		accept( 0, 0, 0, visible, &numVisible );
+	}
+	else {
+		cull( 0, 0, 0, rootPlanes, numRootPlanes, visible, &numVisible );
+	}
+	return numVisible;
+}
+
+void TileQuadtree::cull( size_t level, size_t x, size_t y, const vec4 *planes, size_t numPlanes, size_t *visible, size_t *numVisible )
+{
+	// test the four children against the planes the node crosses
+	const Children &c = getChildren( level, x, y );
+	uint32_t outside = 0, inside[6];
+	for( size_t p = 0; p < numPlanes; ++p ){
+		uint32_t planeOutside;
+		testPlane( c, planes[p], &planeOutside, &inside[p] );
+		outside |= planeOutside;
+	}
+	mNumNodesTested++;
+	
+	for( size_t lane = 0; lane < 4; ++lane ){
+		if( outside & ( 1 << lane ) )
+			continue;
+		
+		size_t childX = 2 * x + ( lane & 1 );
+		size_t childY = 2 * y + ( lane >> 1 );
+		
+		// a child only has to be tested against the planes it crosses
+		vec4 childPlanes[6];
+		size_t numChildPlanes = 0;
+		for( size_t p = 0; p < numPlanes; ++p ){
+			if( ! ( inside[p] & ( 1 << lane ) ) )
+				childPlanes[numChildPlanes++] = planes[p];
+		}
+		
+		if( numChildPlanes == 0 || level + 1 == mDepth ){
+			accept( level + 1, childX, childY, visible, numVisible );
+		}
+		else {
+			cull( level + 1, childX, childY, childPlanes, numChildPlanes, visible, numVisible );
+		}
+	}
+}
+
+void TileQuadtree::accept( size_t level, size_t x, size_t y, size_t *visible, size_t *numVisible ) const
+{
+	size_t size = (size_t) 1 << ( mDepth - level );
+	for( size_t ty = y * size; ty < glm::min( ( y + 1 ) * size, mNumTilesPerRow ); ++ty ){
+		for( size_t tx = x * size; tx < glm::min( ( x + 1 ) * size, mNumTilesPerRow ); ++tx ){
+			visible[(*numVisible)++] = ty * mNumTilesPerRow + tx;
+		}
+	}
+}
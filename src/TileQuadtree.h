@@ -0,0 +1,77 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/AxisAlignedBox.h"
+#include "cinder/Matrix.h"
+
+#include <vector>
+
+//! Quadtree over the terrain tiles grid used for frustum culling. The bounds of the four children
+//! of each node are stored as a structure of arrays so the plane tests run on the four of them at
+//! once, and the nodes fully inside the frustum accept their tiles without further tests. The tree
+//! is implicit: level l is a 2^l x 2^l grid and the tiles are the cells of the last level.
+class TileQuadtree {
+public:
+	TileQuadtree();
+	
+	//! builds an empty tree over a grid of \a numTilesPerRow x \a numTilesPerRow tiles
+	void	build( size_t numTilesPerRow );
+	//! sets the bounds of tile \a tileId, the nodes are refitted on the next cull
+	void	setBounds( size_t tileId, const ci::AxisAlignedBox &bounds );
+	//! writes to \a visible the ids of the tiles intersecting the frustum of \a viewProjection and
+	//! returns their number. \a visible has to hold getNumTiles() ids
+	size_t	cull( const ci::mat4 &viewProjection, size_t *visible );
+	//! returns the bounds of tile \a tileId as last set
+	ci::AxisAlignedBox getBounds( size_t tileId ) const;
+	
+	//! returns the number of tiles per row of the grid
+	size_t	getNumTilesPerRow() const { return mNumTilesPerRow; }
+	//! returns the number of tiles of the grid
+	size_t	getNumTiles() const { return mNumTilesPerRow * mNumTilesPerRow; }
+	//! returns the number of nodes tested by the last cull, four boxes per node
+	size_t	getNumNodesTested() const { return mNumNodesTested; }
+	
+protected:
+	//! the bounds of the four children of a node, one lane per child
+	struct alignas( 16 ) Children {
+		float mMinX[4], mMinY[4], mMinZ[4];
+		float mMaxX[4], mMaxY[4], mMaxZ[4];
+	};
+	
+	//! returns the children block of the node \a x, \a y of \a level
+	Children&	getChildren( size_t level, size_t x, size_t y ) { return mNodes[mLevelOffsets[level] + y * ( (size_t) 1 << level ) + x]; }
+	const Children&	getChildren( size_t level, size_t x, size_t y ) const { return mNodes[mLevelOffsets[level] + y * ( (size_t) 1 << level ) + x]; }
+	//! recomputes the bounds of every node from the tiles
+	void		refit();
+	void		cull( size_t level, size_t x, size_t y, const ci::vec4 *planes, size_t numPlanes, size_t *visible, size_t *numVisible );
+	//! appends every tile under the node \a x, \a y of \a level
+	void		accept( size_t level, size_t x, size_t y, size_t *visible, size_t *numVisible ) const;
+	
+	std::vector<Children>	mNodes;
+	std::vector<size_t>		mLevelOffsets;
+	ci::AxisAlignedBox		mRoot;
+	size_t					mNumTilesPerRow;
+	size_t					mDepth;
+	size_t					mNumNodesTested;
+	bool					mDirty;
+};
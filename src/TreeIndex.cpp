@@ -0,0 +1,204 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "TreeIndex.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+using namespace ci;
+
+namespace {
+	
+	//! returns the distance along \a ray to the solid vertical cylinder of \a tree, 0 when the ray starts inside it, or -1 if missed
+	float intersectTree( const TreeIndex::Tree &tree, const Ray &ray, float elevation )
+	{
+		// clip the ray to the slab between the ground and the top of the tree, the caps are part of it
+		float ground	= tree.mGroundHeight * elevation - 0.5f;
+		float tMin		= 0.0f;
+		float tMax		= numeric_limits<float>::max();
+		float originY		= ray.getOrigin().y;
+		float directionY	= ray.getDirection().y;
+		if( directionY == 0.0f ){
+			if( originY < ground || originY > ground + tree.mTop )
+				return -1.0f;
+		}
+		else {
+			float t0	= ( ground - originY ) / directionY;
+			float t1	= ( ground + tree.mTop - originY ) / directionY;
+			tMin		= glm::max( tMin, glm::min( t0, t1 ) );
+			tMax		= glm::min( tMax, glm::max( t0, t1 ) );
+		}
+		
+		// then to the inside of the circle on the xz plane, a vertical ray is inside or outside all along
+		vec2 origin		= vec2( ray.getOrigin().x, ray.getOrigin().z ) - tree.mPosition;
+		vec2 direction	= vec2( ray.getDirection().x, ray.getDirection().z );
+		float a			= glm::dot( direction, direction );
+		float b			= glm::dot( origin, direction );
+		float c			= glm::dot( origin, origin ) - tree.mRadius * tree.mRadius;
+		if( a <= 0.0f ){
+			if( c > 0.0f )
+				return -1.0f;
+		}
+		else {
+			float delta	= b * b - a * c;
+			if( delta < 0.0f )
+				return -1.0f;
+			tMin		= glm::max( tMin, ( -b - sqrt( delta ) ) / a );
+			tMax		= glm::min( tMax, ( -b + sqrt( delta ) ) / a );
+		}
+		
+		return tMin <= tMax ? tMin : -1.0f;
+	}
+	
+} // anonymous namespace
+
+void TreeIndex::build( vector<Tree> trees )
+{
+	mTrees		= std::move( trees );
+	mMaxRadius	= 0.0f;
+	for( const auto &tree : mTrees ){
+		mMaxRadius = glm::max( mMaxRadius, tree.mRadius );
+	}
+	buildRange( 0, mTrees.size(), 0 );
+}
+
+void TreeIndex::buildRange( size_t begin, size_t end, size_t axis )
+{
+	if( end - begin < 2 )
+		return;
+	
+	// put the median at the middle of the range, smaller ones on the left and bigger on the right
+	size_t middle = begin + ( end - begin ) / 2;
+	std::nth_element( mTrees.begin() + begin, mTrees.begin() + middle, mTrees.begin() + end, [axis]( const Tree &lhs, const Tree &rhs ){
+		return lhs.mPosition[axis] < rhs.mPosition[axis];
+	} );
+	buildRange( begin, middle, axis ^ 1 );
+	buildRange( middle + 1, end, axis ^ 1 );
+}
+
+// MARK: Nearest
+
+const TreeIndex::Tree* TreeIndex::findNearest( const vec2 &position, float maxDistance ) const
+{
+	const Tree* nearest	= nullptr;
+	float distance2		= maxDistance * maxDistance;
+	findNearest( 0, mTrees.size(), 0, position, &nearest, &distance2 );
+	return nearest;
+}
+
+void TreeIndex::findNearest( size_t begin, size_t end, size_t axis, const vec2 &position, const Tree** nearest, float *distance2 ) const
+{
+	if( begin >= end )
+		return;
+	
+	size_t middle		= begin + ( end - begin ) / 2;
+	const Tree &tree	= mTrees[middle];
+	vec2 diff			= position - tree.mPosition;
+	float d2			= glm::dot( diff, diff );
+	if( d2 < *distance2 ){
+		*distance2	= d2;
+		*nearest	= &tree;
+	}
+	
+	// visit the side of the position first and the other one only if it can be closer
+	float split = position[axis] - tree.mPosition[axis];
+	if( split < 0.0f ){
+		findNearest( begin, middle, axis ^ 1, position, nearest, distance2 );
+		if( split * split < *distance2 ) findNearest( middle + 1, end, axis ^ 1, position, nearest, distance2 );
+	}
+	else {
+		findNearest( middle + 1, end, axis ^ 1, position, nearest, distance2 );
+		if( split * split < *distance2 ) findNearest( begin, middle, axis ^ 1, position, nearest, distance2 );
+	}
+}
+
+// MARK: Radius
+
+void TreeIndex::findInRadius( const vec2 &position, float radius, vector<const Tree*> *results ) const
+{
+	findInRadius( 0, mTrees.size(), 0, position, radius, results );
+}
+
+void TreeIndex::findInRadius( size_t begin, size_t end, size_t axis, const vec2 &position, float radius, vector<const Tree*> *results ) const
+{
+	if( begin >= end )
+		return;
+	
+	size_t middle		= begin + ( end - begin ) / 2;
+	const Tree &tree	= mTrees[middle];
+	vec2 diff			= position - tree.mPosition;
+	if( glm::dot( diff, diff ) <= radius * radius ){
+		results->push_back( &tree );
+	}
+	
+	float split = position[axis] - tree.mPosition[axis];
+	if( split - radius <= 0.0f ) findInRadius( begin, middle, axis ^ 1, position, radius, results );
+	if( split + radius >= 0.0f ) findInRadius( middle + 1, end, axis ^ 1, position, radius, results );
+}
+
+// MARK: Ray
+
+const TreeIndex::Tree* TreeIndex::intersect( const Ray &ray, float elevation, float *distance, float maxDistance ) const
+{
+	const Tree* hit = nullptr;
+	float closest	= maxDistance;
+	intersect( 0, mTrees.size(), 0, ray, elevation, &hit, &closest );
+	if( hit && distance ){
+		*distance = closest;
+	}
+	return hit;
+}
+
+void TreeIndex::intersect( size_t begin, size_t end, size_t axis, const Ray &ray, float elevation, const Tree** hit, float *distance ) const
+{
+	if( begin >= end )
+		return;
+	
+	size_t middle		= begin + ( end - begin ) / 2;
+	const Tree &tree	= mTrees[middle];
+	float t				= intersectTree( tree, ray, elevation );
+	if( t >= 0.0f && t < *distance ){
+		*distance	= t;
+		*hit		= &tree;
+	}
+	
+	// the segment of the ray that can still give a closer hit, projected on the split axis.
+	// the trees overlap the split by up to their radius so the sides are padded with it
+	float start		= axis == 0 ? ray.getOrigin().x : ray.getOrigin().z;
+	float direction	= axis == 0 ? ray.getDirection().x : ray.getDirection().z;
+	float finish	= start + direction * *distance;
+	float split		= tree.mPosition[axis];
+	bool left		= glm::min( start, finish ) <= split + mMaxRadius;
+	bool right		= glm::max( start, finish ) >= split - mMaxRadius;
+	
+	// visit the side of the origin first so the far side can be skipped more often
+	if( start < split ){
+		if( left ) intersect( begin, middle, axis ^ 1, ray, elevation, hit, distance );
+		if( right && glm::max( start, start + direction * *distance ) >= split - mMaxRadius ) intersect( middle + 1, end, axis ^ 1, ray, elevation, hit, distance );
+	}
+	else {
+		if( right ) intersect( middle + 1, end, axis ^ 1, ray, elevation, hit, distance );
+		if( left && glm::min( start, start + direction * *distance ) <= split + mMaxRadius ) intersect( begin, middle, axis ^ 1, ray, elevation, hit, distance );
+	}
+}
@@ -0,0 +1,74 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/Vector.h"
+#include "cinder/Ray.h"
+
+#include <cstdint>
+#include <vector>
+
+//! Compact 2d k-d tree of the trees of a tile, built by the population workers so the trees
+//! can still be queried once they are baked into the tile mesh. The nodes are stored as an
+//! implicit balanced tree: each range is split at its median, alternating the x and z axes.
+class TreeIndex {
+public:
+	//! a single tree, 32 bytes
+	struct Tree {
+		ci::vec2	mPosition;		//!< world space position on the xz plane
+		float		mGroundHeight;	//!< normalized height map value under the tree
+		float		mRadius;		//!< horizontal radius of the scaled model
+		float		mTop;			//!< height of the scaled model above the ground
+		uint32_t	mModel;			//!< population model, the species
+		uint32_t	mFirstVertex;	//!< first vertex of the tree in the baked batch
+		uint32_t	mNumVertices;	//!< number of vertices of the tree in the baked batch, 0 when instanced
+	};
+	
+	TreeIndex() : mMaxRadius( 0.0f ) {}
+	
+	//! builds the index from \a trees
+	void build( std::vector<Tree> trees );
+	
+	//! returns the closest tree to \a position or nullptr if none is within \a maxDistance
+	const Tree*	findNearest( const ci::vec2 &position, float maxDistance = 1000000.0f ) const;
+	//! appends the trees within \a radius of \a position to \a results
+	void		findInRadius( const ci::vec2 &position, float radius, std::vector<const Tree*> *results ) const;
+	//! returns the first tree hit by \a ray before \a maxDistance and its \a distance. the trees are vertical
+	//! cylinders standing on the ground height scaled by \a elevation, like the trees vertex shaders
+	const Tree*	intersect( const ci::Ray &ray, float elevation, float *distance, float maxDistance = 1000000.0f ) const;
+	
+	//! returns the number of trees
+	size_t	size() const { return mTrees.size(); }
+	//! returns whether the index is empty
+	bool	empty() const { return mTrees.empty(); }
+	//! returns the number of bytes used by the index
+	size_t	getSize() const { return mTrees.size() * sizeof( Tree ); }
+	
+protected:
+	void buildRange( size_t begin, size_t end, size_t axis );
+	void findNearest( size_t begin, size_t end, size_t axis, const ci::vec2 &position, const Tree** nearest, float *distance2 ) const;
+	void findInRadius( size_t begin, size_t end, size_t axis, const ci::vec2 &position, float radius, std::vector<const Tree*> *results ) const;
+	void intersect( size_t begin, size_t end, size_t axis, const ci::Ray &ray, float elevation, const Tree** hit, float *distance ) const;
+	
+	std::vector<Tree>	mTrees;
+	float				mMaxRadius;
+};
@@ -0,0 +1,73 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+
+#include "cinder/gl/GlslProg.h"
+
+//! Typed handle to a uniform of a linked program. The location is resolved once at construction
+//! and the last value is kept so that setting the same value again doesn't reach the driver.
+//! The cache only knows about the values set through the handle, mixing it with the string-keyed
+//! GlslProg::uniform on the same uniform requires a call to invalidate(). Handles of uniforms that
+//! don't exist in the program, or were optimized out by the compiler, are silently ignored.
+template<typename T>
+class UniformHandle {
+public:
+	UniformHandle() : mLocation( -1 ), mHasValue( false ) {}
+	UniformHandle( const ci::gl::GlslProgRef &shader, const std::string &name )
+	: mShader( shader ), mLocation( shader ? shader->getUniformLocation( name ) : -1 ), mHasValue( false )
+	{
+	}
+	
+	//! sets the uniform, skipped if the value didn't change since the last call
+	void set( const T &value )
+	{
+		if( mLocation < 0 || ( mHasValue && mValue == value ) )
+			return;
+		mShader->uniform( mLocation, value );
+		mValue		= value;
+		mHasValue	= true;
+	}
+	//! sets \a count elements of a uniform array, never cached
+	void set( const T *data, int count )
+	{
+		if( mLocation < 0 )
+			return;
+		mShader->uniform( mLocation, data, count );
+		mHasValue	= false;
+	}
+	
+	//! forgets the cached value, the next set always reaches the program
+	void invalidate() { mHasValue = false; }
+	
+	//! returns whether the uniform exists in the program
+	bool isValid() const { return mLocation >= 0; }
+	//! returns the location of the uniform or -1
+	int getLocation() const { return mLocation; }
+	
+protected:
+	ci::gl::GlslProgRef	mShader;
+	int					mLocation;
+	T					mValue;
+	bool				mHasValue;
+};
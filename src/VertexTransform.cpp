@@ -0,0 +1,130 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ */
+
+#include "VertexTransform.h"
+
+#if defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+	#include <arm_neon.h>
+	#define VERTEX_TRANSFORM_NEON
+#elif defined( __SSE__ ) || defined( _M_X64 )
+	#include <xmmintrin.h>
+	#define VERTEX_TRANSFORM_SSE
+#endif
+
+using namespace std;
+using namespace ci;
+
+namespace VertexTransform {
+
+Positions::Positions( const vec3 *positions, size_t numPositions )
+: mX( numPositions ), mY( numPositions ), mZ( numPositions )
+{
+	for( size_t i = 0; i < numPositions; ++i ){
+		mX[i] = positions[i].x;
+		mY[i] = positions[i].y;
+		mZ[i] = positions[i].z;
+	}
+}
+
+void transformAffine( const Positions &positions, const mat4 &transform, vec3 *dst, vec3 *min, vec3 *max )
+{
+	const float* x	= positions.mX.data();
+	const float* y	= positions.mY.data();
+	const float* z	= positions.mZ.data();
+	size_t count	= positions.size();
+	size_t i		= 0;
+	
+	// the kernels process 4 positions at a time, the remaining ones are done by the scalar loop
+#if defined( VERTEX_TRANSFORM_NEON )
+	float32x4_t m[4][3];
+	for( int c = 0; c < 4; ++c ){
+		for( int r = 0; r < 3; ++r ){
+			m[c][r] = vdupq_n_f32( transform[c][r] );
+		}
+	}
+	float32x4_t minX = vdupq_n_f32( min->x ), minY = vdupq_n_f32( min->y ), minZ = vdupq_n_f32( min->z );
+	float32x4_t maxX = vdupq_n_f32( max->x ), maxY = vdupq_n_f32( max->y ), maxZ = vdupq_n_f32( max->z );
+	for( ; i + 4 <= count; i += 4 ){
+		float32x4_t px = vld1q_f32( x + i ), py = vld1q_f32( y + i ), pz = vld1q_f32( z + i );
+		float32x4x3_t out;
+		out.val[0] = vmlaq_f32( vmlaq_f32( vmlaq_f32( m[3][0], m[0][0], px ), m[1][0], py ), m[2][0], pz );
+		out.val[1] = vmlaq_f32( vmlaq_f32( vmlaq_f32( m[3][1], m[0][1], px ), m[1][1], py ), m[2][1], pz );
+		out.val[2] = vmlaq_f32( vmlaq_f32( vmlaq_f32( m[3][2], m[0][2], px ), m[1][2], py ), m[2][2], pz );
+		// vst3 interleaves the three registers back to xyz triplets
+		vst3q_f32( &dst[i].x, out );
+		minX = vminq_f32( minX, out.val[0] ); maxX = vmaxq_f32( maxX, out.val[0] );
+		minY = vminq_f32( minY, out.val[1] ); maxY = vmaxq_f32( maxY, out.val[1] );
+		minZ = vminq_f32( minZ, out.val[2] ); maxZ = vmaxq_f32( maxZ, out.val[2] );
+	}
+	float lanes[6][4];
+	vst1q_f32( lanes[0], minX ); vst1q_f32( lanes[1], minY ); vst1q_f32( lanes[2], minZ );
+	vst1q_f32( lanes[3], maxX ); vst1q_f32( lanes[4], maxY ); vst1q_f32( lanes[5], maxZ );
+	for( int l = 0; l < 4; ++l ){
+		*min = glm::min( *min, vec3( lanes[0][l], lanes[1][l], lanes[2][l] ) );
+		*max = glm::max( *max, vec3( lanes[3][l], lanes[4][l], lanes[5][l] ) );
+	}
+#elif defined( VERTEX_TRANSFORM_SSE )
+	__m128 m[4][3];
+	for( int c = 0; c < 4; ++c ){
+		for( int r = 0; r < 3; ++r ){
+			m[c][r] = _mm_set1_ps( transform[c][r] );
+		}
+	}
+	__m128 minX = _mm_set1_ps( min->x ), minY = _mm_set1_ps( min->y ), minZ = _mm_set1_ps( min->z );
+	__m128 maxX = _mm_set1_ps( max->x ), maxY = _mm_set1_ps( max->y ), maxZ = _mm_set1_ps( max->z );
+	float lanes[3][4];
+	for( ; i + 4 <= count; i += 4 ){
+		__m128 px = _mm_loadu_ps( x + i ), py = _mm_loadu_ps( y + i ), pz = _mm_loadu_ps( z + i );
+		__m128 ox = _mm_add_ps( _mm_add_ps( _mm_add_ps( m[3][0], _mm_mul_ps( m[0][0], px ) ), _mm_mul_ps( m[1][0], py ) ), _mm_mul_ps( m[2][0], pz ) );
+		__m128 oy = _mm_add_ps( _mm_add_ps( _mm_add_ps( m[3][1], _mm_mul_ps( m[0][1], px ) ), _mm_mul_ps( m[1][1], py ) ), _mm_mul_ps( m[2][1], pz ) );
+		__m128 oz = _mm_add_ps( _mm_add_ps( _mm_add_ps( m[3][2], _mm_mul_ps( m[0][2], px ) ), _mm_mul_ps( m[1][2], py ) ), _mm_mul_ps( m[2][2], pz ) );
+		minX = _mm_min_ps( minX, ox ); maxX = _mm_max_ps( maxX, ox );
+		minY = _mm_min_ps( minY, oy ); maxY = _mm_max_ps( maxY, oy );
+		minZ = _mm_min_ps( minZ, oz ); maxZ = _mm_max_ps( maxZ, oz );
+		// sse has no interleaved store, go back to xyz triplets through the stack
+		_mm_storeu_ps( lanes[0], ox ); _mm_storeu_ps( lanes[1], oy ); _mm_storeu_ps( lanes[2], oz );
+		for( int l = 0; l < 4; ++l ){
+			dst[i + l] = vec3( lanes[0][l], lanes[1][l], lanes[2][l] );
+		}
+	}
+	float bounds[6][4];
+	_mm_storeu_ps( bounds[0], minX ); _mm_storeu_ps( bounds[1], minY ); _mm_storeu_ps( bounds[2], minZ );
+	_mm_storeu_ps( bounds[3], maxX ); _mm_storeu_ps( bounds[4], maxY ); _mm_storeu_ps( bounds[5], maxZ );
+	for( int l = 0; l < 4; ++l ){
+		*min = glm::min( *min, vec3( bounds[0][l], bounds[1][l], bounds[2][l] ) );
+		*max = glm::max( *max, vec3( bounds[3][l], bounds[4][l], bounds[5][l] ) );
+	}
+#endif
+	
+	// scalar path and remaining positions
+	for( ; i < count; ++i ){
+		vec3 p;
+		p.x		= transform[3][0] + transform[0][0] * x[i] + transform[1][0] * y[i] + transform[2][0] * z[i];
+		p.y		= transform[3][1] + transform[0][1] * x[i] + transform[1][1] * y[i] + transform[2][1] * z[i];
+		p.z		= transform[3][2] + transform[0][2] * x[i] + transform[1][2] * y[i] + transform[2][2] * z[i];
+		dst[i]	= p;
+		*min	= glm::min( *min, p );
+		*max	= glm::max( *max, p );
+	}
+}
+
+} // namespace VertexTransform
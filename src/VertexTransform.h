@@ -0,0 +1,55 @@
+/*
+ Copyright (c) 2015 Simon Geilfus
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+#pragma once
+
+#include "cinder/Vector.h"
+#include "cinder/Matrix.h"
+
+#include <algorithm>
+#include <vector>
+
+//! Batch position transforms over structure of arrays copies of a mesh positions. Uses NEON
+//! or SSE when available and falls back to scalar code, results are the same on every path.
+namespace VertexTransform {
+	
+	//! structure of arrays copy of a set of positions
+	struct Positions {
+		Positions() {}
+		Positions( const ci::vec3 *positions, size_t numPositions );
+		
+		//! returns the number of positions
+		size_t size() const { return mX.size(); }
+		
+		std::vector<float>	mX, mY, mZ;
+	};
+	
+	//! writes \a positions transformed by the affine part of \a transform to \a dst and grows \a min and \a max with them
+	void transformAffine( const Positions &positions, const ci::mat4 &transform, ci::vec3 *dst, ci::vec3 *min, ci::vec3 *max );
+	
+	//! writes \a value to the \a count first elements of \a dst, used for per-instance constant attributes
+	template<typename T>
+	void fill( T *dst, size_t count, const T &value )
+	{
+		std::fill_n( dst, count, value );
+	}
+	
+} // namespace VertexTransform